@@ -0,0 +1,147 @@
+"""
+Minimal CBOR (RFC 8949) codec for the /mcp binary framing, used when the
+cbor2 package is not installed. It covers the JSON data model: maps, arrays,
+text, integers, floats, booleans and null. Byte strings decode to bytes and
+tags are dropped, keeping the tagged value.
+"""
+
+import struct
+
+MAX_DEPTH = 64
+
+def _head(major, value):
+    if value < 24:
+        return bytes([major << 5 | value])
+    for info, fmt in ((24, '>B'), (25, '>H'), (26, '>I'), (27, '>Q')):
+        if value < 1 << (8 * struct.calcsize(fmt)):
+            return bytes([major << 5 | info]) + struct.pack(fmt, value)
+    raise ValueError("integer too large for CBOR")
+
+def _encode(value, out, depth):
+    if depth > MAX_DEPTH:
+        raise ValueError("CBOR nesting too deep")
+    if value is None:
+        out.append(b'\xf6')
+    elif value is True or value is False:
+        out.append(b'\xf5' if value else b'\xf4')
+    elif isinstance(value, int):
+        if value >= 0:
+            out.append(_head(0, value))
+        else:
+            out.append(_head(1, -1 - value))
+    elif isinstance(value, float):
+        out.append(b'\xfb' + struct.pack('>d', value))
+    elif isinstance(value, str):
+        data = value.encode('utf-8')
+        out.append(_head(3, len(data)))
+        out.append(data)
+    elif isinstance(value, (bytes, bytearray)):
+        out.append(_head(2, len(value)))
+        out.append(bytes(value))
+    elif isinstance(value, (list, tuple)):
+        out.append(_head(4, len(value)))
+        for item in value:
+            _encode(item, out, depth + 1)
+    elif isinstance(value, dict):
+        out.append(_head(5, len(value)))
+        for key, item in value.items():
+            _encode(key, out, depth + 1)
+            _encode(item, out, depth + 1)
+    else:
+        raise TypeError(f"cannot encode {type(value).__name__} as CBOR")
+
+def dumps(value):
+    out = []
+    _encode(value, out, 0)
+    return b''.join(out)
+
+class _Reader:
+    def __init__(self, data):
+        self.data = bytes(data)
+        self.pos = 0
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise ValueError("truncated CBOR")
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def head(self):
+        initial = self.take(1)[0]
+        major, info = initial >> 5, initial & 0x1f
+        if info < 24:
+            return major, info, info
+        if info == 31:
+            return major, info, None
+        if info > 27:
+            raise ValueError("reserved CBOR additional info")
+        size = 1 << (info - 24)
+        return major, info, int.from_bytes(self.take(size), 'big')
+
+    def at_break(self):
+        if self.pos < len(self.data) and self.data[self.pos] == 0xff:
+            self.pos += 1
+            return True
+        return False
+
+def _string(reader, major, length):
+    if length is not None:
+        return reader.take(length)
+    chunks = []
+    while not reader.at_break():
+        chunk_major, _, chunk_length = reader.head()
+        if chunk_major != major or chunk_length is None:
+            raise ValueError("bad CBOR string chunk")
+        chunks.append(reader.take(chunk_length))
+    return b''.join(chunks)
+
+def _decode(reader, depth):
+    if depth > MAX_DEPTH:
+        raise ValueError("CBOR nesting too deep")
+    major, info, value = reader.head()
+    if value is None and major not in (2, 3, 4, 5):
+        raise ValueError("unexpected CBOR break or indefinite length")
+    if major == 0:
+        return value
+    if major == 1:
+        return -1 - value
+    if major == 2:
+        return _string(reader, 2, value)
+    if major == 3:
+        return _string(reader, 3, value).decode('utf-8')
+    if major == 4:
+        items = []
+        while (len(items) < value) if value is not None else not reader.at_break():
+            items.append(_decode(reader, depth + 1))
+        return items
+    if major == 5:
+        items = {}
+        count = 0
+        while (count < value) if value is not None else not reader.at_break():
+            key = _decode(reader, depth + 1)
+            if isinstance(key, (list, dict)):
+                raise ValueError("unhashable CBOR map key")
+            items[key] = _decode(reader, depth + 1)
+            count += 1
+        return items
+    if major == 6:
+        return _decode(reader, depth + 1)
+    # Major type 7: simple values and floats
+    if info == 25:
+        return struct.unpack('>e', value.to_bytes(2, 'big'))[0]
+    if info == 26:
+        return struct.unpack('>f', value.to_bytes(4, 'big'))[0]
+    if info == 27:
+        return struct.unpack('>d', value.to_bytes(8, 'big'))[0]
+    simple = {20: False, 21: True, 22: None, 23: None}
+    if value in simple:
+        return simple[value]
+    raise ValueError("unsupported CBOR simple value")
+
+def loads(data):
+    reader = _Reader(data)
+    value = _decode(reader, 0)
+    if reader.pos != len(reader.data):
+        raise ValueError("trailing bytes after CBOR item")
+    return value
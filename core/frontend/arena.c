@@ -0,0 +1,117 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t capacity;
+    size_t used;
+    char data[];
+};
+
+static ArenaBlock *block_new(size_t capacity) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + capacity);
+    
+    if (!block) return NULL;
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+static void blocks_free(ArenaBlock *block) {
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+// Carve size bytes off the end of block, aligned, or NULL if they do not fit
+static void *block_take(ArenaBlock *block, size_t size, size_t *taken) {
+    uintptr_t at = (uintptr_t)(block->data + block->used);
+    size_t pad = (size_t)(-at & (ARENA_ALIGN - 1));
+    
+    if (pad + size > block->capacity - block->used) return NULL;
+    void *ptr = block->data + block->used + pad;
+    block->used += pad + size;
+    *taken = pad + size;
+    return ptr;
+}
+
+static ArenaBlock *current_block(const Arena *arena) {
+    return arena->spill ? arena->spill : arena->base;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    ArenaBlock *block = current_block(arena);
+    size_t taken = 0;
+    void *ptr = NULL;
+    
+    if (!block) {
+        arena->base = block_new(size + ARENA_ALIGN > ARENA_MIN_BLOCK ? size + ARENA_ALIGN : ARENA_MIN_BLOCK);
+        if (!arena->base) return NULL;
+        block = arena->base;
+    }
+    ptr = block_take(block, size, &taken);
+    if (!ptr) {
+        // Each spill at least doubles, so a large call needs only a few
+        size_t capacity = block->capacity * 2;
+        if (capacity < size + ARENA_ALIGN) capacity = size + ARENA_ALIGN;
+        ArenaBlock *spill = block_new(capacity);
+        if (!spill) return NULL;
+        spill->next = arena->spill;
+        arena->spill = spill;
+        arena->spills++;
+        ptr = block_take(spill, size, &taken);
+    }
+    
+    arena->used += taken;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    arena->last = ptr;
+    return ptr;
+}
+
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    ArenaBlock *block = current_block(arena);
+    
+    if (ptr && ptr == arena->last && block) {
+        size_t offset = (size_t)((char *)ptr - block->data);
+        if (new_size <= block->capacity - offset) {
+            size_t end = offset + new_size;
+            if (end > block->used) {
+                arena->used += end - block->used;
+                if (arena->used > arena->peak) arena->peak = arena->used;
+            }
+            block->used = end;
+            return ptr;
+        }
+    }
+    
+    void *grown = arena_alloc(arena, new_size);
+    if (grown && ptr) memcpy(grown, ptr, old_size < new_size ? old_size : new_size);
+    return grown;
+}
+
+void arena_reset(Arena *arena) {
+    if (arena->spill) {
+        // Replace the chain with one block that holds what this call needed,
+        // rounded up so a slightly bigger call next time still fits
+        size_t capacity = ARENA_MIN_BLOCK;
+        while (capacity < arena->used) capacity *= 2;
+        blocks_free(arena->spill);
+        blocks_free(arena->base);
+        arena->spill = NULL;
+        arena->base = block_new(capacity);
+    }
+    if (arena->base) arena->base->used = 0;
+    arena->used = 0;
+    arena->last = NULL;
+}
+
+void arena_free(Arena *arena) {
+    blocks_free(arena->spill);
+    blocks_free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
@@ -0,0 +1,38 @@
+#ifndef PHASE3_ARENA_H
+#define PHASE3_ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator for memory that lives exactly as long as one call: the
+// request and reply bodies, stream state, scanner text and per-call headers.
+// Allocating is a pointer bump and arena_reset releases everything at once.
+// A call that outgrows the block spills into extra heap blocks; the next
+// reset folds them into a single block big enough for that call, so a
+// long-running client settles on one block per handle and stops churning
+// the heap.
+#define ARENA_MIN_BLOCK (32 * 1024)
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *base;       // kept across resets
+    ArenaBlock *spill;      // this call's extra blocks, newest first
+    size_t used;            // bytes taken since the last reset, padding included
+    size_t peak;            // largest used over the arena's life
+    void *last;             // most recent allocation, which can grow in place
+    long spills;
+} Arena;
+
+// NULL only when the heap is exhausted
+void *arena_alloc(Arena *arena, size_t size);
+
+// Resize ptr, an allocation of this arena. The most recent allocation grows
+// in place while its block has room; anything else is copied (old_size
+// bytes) to a new allocation. A NULL ptr is a plain arena_alloc.
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+#endif
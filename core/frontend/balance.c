@@ -0,0 +1,169 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "balance.h"
+#include "stats.h"
+
+// web_server.py serves /health at the root, whatever path /mcp is under
+static char *health_url(const char *url) {
+    const char *host = strstr(url, "://");
+    const char *path = strchr(host ? host + 3 : url, '/');
+    size_t len = path ? (size_t)(path - url) : strlen(url);
+    char *out = malloc(len + sizeof("/health"));
+    
+    if (!out) return NULL;
+    memcpy(out, url, len);
+    memcpy(out + len, "/health", sizeof("/health"));
+    return out;
+}
+
+int balancer_add(Balancer *balancer, const char *url) {
+    if (balancer->count == MCP_MAX_ENDPOINTS) return -1;
+    
+    McpEndpoint *endpoint = &balancer->endpoints[balancer->count];
+    memset(endpoint, 0, sizeof(*endpoint));
+    endpoint->url = strdup(url);
+    endpoint->health_url = health_url(url);
+    if (!endpoint->url || !endpoint->health_url) {
+        free(endpoint->url);
+        free(endpoint->health_url);
+        memset(endpoint, 0, sizeof(*endpoint));
+        return -1;
+    }
+    balancer->count++;
+    return 0;
+}
+
+void balancer_free(Balancer *balancer) {
+    for (size_t i = 0; i < balancer->count; i++) {
+        free(balancer->endpoints[i].url);
+        free(balancer->endpoints[i].health_url);
+    }
+    memset(balancer, 0, sizeof(*balancer));
+}
+
+int endpoint_available(const McpEndpoint *endpoint, double now_ms) {
+    return endpoint->retry_at_ms <= 0 || now_ms >= endpoint->retry_at_ms;
+}
+
+// Lower is better. An endpoint with no completed calls yet borrows the
+// fastest known EWMA so it is tried rather than starved.
+static double endpoint_score(const Balancer *balancer, const McpEndpoint *endpoint, double best_ewma_ms) {
+    if (balancer->policy == BALANCE_LEAST_OUTSTANDING) return (double)endpoint->outstanding;
+    double ewma_ms = endpoint->ewma_ms > 0 ? endpoint->ewma_ms : best_ewma_ms;
+    return (ewma_ms > 0 ? ewma_ms : 1.0) * (double)(endpoint->outstanding + 1);
+}
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+static uint64_t url_hash(const char *url) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *url; url++) h = (h ^ (unsigned char)*url) * 0x100000001b3ULL;
+    return h;
+}
+
+// Highest hash of key and URL among the available endpoints, so a key only
+// moves when its endpoint goes away or the list changes
+static McpEndpoint *affine_endpoint(Balancer *balancer, uint64_t affinity, double now_ms) {
+    McpEndpoint *best = NULL;
+    uint64_t best_weight = 0;
+    size_t least = SIZE_MAX;
+    
+    for (size_t i = 0; i < balancer->count; i++) {
+        McpEndpoint *endpoint = &balancer->endpoints[i];
+        if (!endpoint_available(endpoint, now_ms)) continue;
+        uint64_t weight = mix64(affinity ^ url_hash(endpoint->url));
+        if (!best || weight > best_weight) {
+            best = endpoint;
+            best_weight = weight;
+        }
+        if (endpoint->outstanding < least) least = endpoint->outstanding;
+    }
+    return best && best->outstanding <= least + MCP_AFFINITY_SLACK ? best : NULL;
+}
+
+McpEndpoint *balancer_pick(Balancer *balancer, int pinned, uint64_t affinity, double now_ms) {
+    McpEndpoint *best = NULL;
+    double best_score = 0, best_ewma_ms = 0;
+    
+    if (pinned) {
+        for (size_t i = 0; i < balancer->count; i++) {
+            if (endpoint_available(&balancer->endpoints[i], now_ms)) return &balancer->endpoints[i];
+        }
+        return NULL;
+    }
+    if (affinity && (best = affine_endpoint(balancer, affinity, now_ms))) return best;
+    
+    for (size_t i = 0; i < balancer->count; i++) {
+        double ewma_ms = balancer->endpoints[i].ewma_ms;
+        if (ewma_ms > 0 && (best_ewma_ms == 0 || ewma_ms < best_ewma_ms)) best_ewma_ms = ewma_ms;
+    }
+    
+    // Start the scan one past the last pick, so ties go round robin
+    for (size_t n = 0; n < balancer->count; n++) {
+        McpEndpoint *endpoint = &balancer->endpoints[(balancer->next + n) % balancer->count];
+        if (!endpoint_available(endpoint, now_ms)) continue;
+        
+        double score = endpoint_score(balancer, endpoint, best_ewma_ms);
+        if (!best || score < best_score) {
+            best = endpoint;
+            best_score = score;
+        }
+    }
+    if (best) balancer->next = (size_t)(best - balancer->endpoints) + 1;
+    return best;
+}
+
+static void endpoint_healthy(McpEndpoint *endpoint) {
+    endpoint->consecutive_failures = 0;
+    endpoint->backoff_ms = 0;
+    endpoint->retry_at_ms = 0;
+}
+
+// Failed connects double the backoff, starting from MCP_BACKOFF_MIN_MS
+static void endpoint_back_off(McpEndpoint *endpoint, double now_ms) {
+    endpoint->backoff_ms = endpoint->backoff_ms > 0 ? endpoint->backoff_ms * 2 : MCP_BACKOFF_MIN_MS;
+    if (endpoint->backoff_ms > MCP_BACKOFF_MAX_MS) endpoint->backoff_ms = MCP_BACKOFF_MAX_MS;
+    endpoint->retry_at_ms = now_ms + endpoint->backoff_ms;
+    STAT_ADD(endpoint->backoffs, 1);
+}
+
+void balancer_done(McpEndpoint *endpoint, CallOutcome outcome, double latency_ms, double now_ms) {
+    if (endpoint->outstanding > 0) STAT_SUB(endpoint->outstanding, 1);
+    if (outcome == OUTCOME_CANCELLED) return;
+    
+    STAT_ADD(endpoint->calls, 1);
+    switch (outcome) {
+        case OUTCOME_OK:
+            endpoint->ewma_ms = endpoint->ewma_ms > 0 ?
+                endpoint->ewma_ms + MCP_EWMA_ALPHA * (latency_ms - endpoint->ewma_ms) : latency_ms;
+            endpoint_healthy(endpoint);
+            break;
+        case OUTCOME_CONNECT_FAILED:
+            STAT_ADD(endpoint->failures, 1);
+            endpoint_back_off(endpoint, now_ms);
+            break;
+        default:
+            STAT_ADD(endpoint->failures, 1);
+            // Back from an ejection, one more failure sends it straight out again
+            if (++endpoint->consecutive_failures >= MCP_EJECT_FAILURES) {
+                endpoint->retry_at_ms = now_ms + MCP_EJECT_MS;
+                endpoint->consecutive_failures = MCP_EJECT_FAILURES - 1;
+                STAT_ADD(endpoint->ejections, 1);
+            }
+            break;
+    }
+}
+
+void balancer_probe_done(McpEndpoint *endpoint, int healthy, double now_ms) {
+    if (healthy) endpoint_healthy(endpoint);
+    else if (endpoint_available(endpoint, now_ms)) endpoint_back_off(endpoint, now_ms);
+}
@@ -0,0 +1,75 @@
+#ifndef PHASE3_BALANCE_H
+#define PHASE3_BALANCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Endpoint selection for a client talking to several MCP servers. Each
+// endpoint tracks its outstanding calls and an EWMA of call latency. One
+// that refuses connections backs off exponentially between
+// MCP_BACKOFF_MIN_MS and MCP_BACKOFF_MAX_MS; one that fails
+// MCP_EJECT_FAILURES calls in a row after connecting is ejected for
+// MCP_EJECT_MS. Until then selection skips it, and calls fail at once if no
+// endpoint is left. A passing health probe readmits an endpoint early.
+#define MCP_MAX_ENDPOINTS 16
+#define MCP_BACKOFF_MIN_MS 100
+#define MCP_BACKOFF_MAX_MS 5000
+#define MCP_EJECT_FAILURES 3
+#define MCP_EJECT_MS 5000
+#define MCP_EWMA_ALPHA 0.3
+
+// Calls carrying the same affinity key go to the same endpoint (rendezvous
+// hashing over the available ones), so a server-side cache keyed on what
+// they share gets hits. Once that endpoint has this many more calls
+// outstanding than the least loaded one, further calls follow the policy.
+#define MCP_AFFINITY_SLACK 8
+
+typedef enum {
+    BALANCE_LEAST_OUTSTANDING,
+    BALANCE_EWMA,           // lowest latency EWMA times (outstanding + 1)
+} BalancePolicy;
+
+typedef enum {
+    OUTCOME_OK,
+    OUTCOME_CANCELLED,      // dropped by the caller; says nothing about the server
+    OUTCOME_CONNECT_FAILED, // never got a connection
+    OUTCOME_FAILED,         // transport error or 5xx once connected
+} CallOutcome;
+
+typedef struct {
+    char *url;
+    char *health_url;       // /health on the same host
+    size_t outstanding;
+    double ewma_ms;         // 0 until a call completes
+    long calls;
+    long failures;
+    int consecutive_failures;
+    double backoff_ms;
+    double retry_at_ms;     // skipped by selection until then
+    long backoffs;
+    long ejections;
+} McpEndpoint;
+
+typedef struct {
+    McpEndpoint endpoints[MCP_MAX_ENDPOINTS];
+    size_t count;
+    BalancePolicy policy;
+    size_t next;            // rotates ties between equal endpoints
+} Balancer;
+
+int balancer_add(Balancer *balancer, const char *url);
+void balancer_free(Balancer *balancer);
+
+int endpoint_available(const McpEndpoint *endpoint, double now_ms);
+
+// Endpoint for the next call, or NULL when every endpoint is backing off or
+// ejected. Pinned calls take the first available endpoint in list order;
+// calls with a nonzero affinity key the endpoint that key hashes to; the
+// others follow the policy.
+McpEndpoint *balancer_pick(Balancer *balancer, int pinned, uint64_t affinity, double now_ms);
+
+// Account a call picked from this endpoint once it is over
+void balancer_done(McpEndpoint *endpoint, CallOutcome outcome, double latency_ms, double now_ms);
+void balancer_probe_done(McpEndpoint *endpoint, int healthy, double now_ms);
+
+#endif
@@ -0,0 +1,417 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_tokens.h"
+#include "mcp_client.h"
+#include "stats.h"
+#include "telemetry.h"
+
+#define MAX_MIX 16
+#define DEFAULT_MIX "get_status"
+#define DEFAULT_CONCURRENCY 4
+#define DEFAULT_REQUESTS 1000
+
+// Load generator for the MCP endpoint. Calls go through run_mcp_calls and
+// are timed by the client's own per-tool histograms, so the numbers match
+// what the panel and batch mode see.
+
+typedef struct {
+    char tool[32];
+    char *args;
+    unsigned weight;
+} MixEntry;
+
+typedef struct {
+    McpCall call;
+    int busy;
+} BenchSlot;
+
+typedef struct {
+    MixEntry mix[MAX_MIX];
+    size_t nmix;
+    unsigned total_weight;
+    BenchSlot slots[MCP_MAX_PARALLEL];
+    size_t nslots;
+    unsigned rng;
+    long issued;
+    long limit;             // stop after this many calls, 0 for none
+    double deadline_ms;     // stop issuing at this time, 0 for none
+} BenchRun;
+
+static unsigned next_random(BenchRun *run) {
+    // xorshift32: cheap and reproducible for a given --seed
+    unsigned x = run->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    run->rng = x;
+    return x;
+}
+
+static const char *default_args(const char *tool) {
+    return strcmp(tool, "generate") == 0 ? "{\"prompt\":\"benchmark\"}" : "{}";
+}
+
+// "tool[:weight],tool[:weight]..."
+static int parse_mix(BenchRun *run, const char *spec) {
+    char *copy = strdup(spec);
+    char *save = NULL;
+    
+    if (!copy) return -1;
+    for (char *item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        if (run->nmix == MAX_MIX) break;
+        MixEntry *entry = &run->mix[run->nmix];
+        char *colon = strchr(item, ':');
+        entry->weight = 1;
+        if (colon) {
+            *colon = 0;
+            entry->weight = (unsigned)atoi(colon + 1);
+        }
+        if (*item == 0 || entry->weight == 0) continue;
+        snprintf(entry->tool, sizeof(entry->tool), "%s", item);
+        run->total_weight += entry->weight;
+        run->nmix++;
+    }
+    free(copy);
+    return run->nmix > 0 ? 0 : -1;
+}
+
+// "tool={json}" overrides the arguments sent with that tool
+static int set_mix_args(BenchRun *run, const char *spec) {
+    const char *eq = strchr(spec, '=');
+    if (!eq) return -1;
+    
+    for (size_t i = 0; i < run->nmix; i++) {
+        MixEntry *entry = &run->mix[i];
+        if (strlen(entry->tool) == (size_t)(eq - spec) && strncmp(entry->tool, spec, eq - spec) == 0) {
+            free(entry->args);
+            entry->args = strdup(eq + 1);
+            return entry->args ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+static McpCall *next_bench_call(void *source) {
+    BenchRun *run = source;
+    
+    if (run->limit > 0 && run->issued >= run->limit) return NULL;
+    if (run->deadline_ms > 0 && mcp_now_ms() >= run->deadline_ms) return NULL;
+    
+    for (size_t i = 0; i < run->nslots; i++) {
+        BenchSlot *slot = &run->slots[i];
+        if (slot->busy) continue;
+        
+        unsigned pick = next_random(run) % run->total_weight;
+        MixEntry *entry = &run->mix[0];
+        for (size_t m = 0; m < run->nmix; m++) {
+            if (pick < run->mix[m].weight) {
+                entry = &run->mix[m];
+                break;
+            }
+            pick -= run->mix[m].weight;
+        }
+        
+        memset(&slot->call, 0, sizeof(slot->call));
+        slot->call.tool = entry->tool;
+        slot->call.args = entry->args ? entry->args : default_args(entry->tool);
+        slot->call.context = slot;
+        slot->busy = 1;
+        run->issued++;
+        return &slot->call;
+    }
+    return NULL;
+}
+
+static void bench_call_done(McpCall *call, void *userdata) {
+    BenchSlot *slot = call->context;
+    (void)userdata;
+    slot->busy = 0;
+}
+
+static void print_row(const char *name, long calls, long errors, double elapsed_ms, const Histogram *h) {
+    printf("%-18s %8ld %6ld %10.1f %9.3f %9.3f %9.3f %9.3f\n", name, calls, errors,
+           elapsed_ms > 0 ? calls * 1000.0 / elapsed_ms : 0.0,
+           hist_percentile(h, 0.50) / 1000.0, hist_percentile(h, 0.99) / 1000.0,
+           hist_percentile(h, 0.999) / 1000.0, h->max_us / 1000.0);
+}
+
+static void write_row_json(FILE *out, long calls, long errors, double elapsed_ms, const Histogram *h,
+                           const DeviceState *device) {
+    fprintf(out, "{\"calls\":%ld,\"errors\":%ld,\"rps\":%.2f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,"
+            "\"p999_ms\":%.3f,\"max_ms\":%.3f", calls, errors,
+            elapsed_ms > 0 ? calls * 1000.0 / elapsed_ms : 0.0,
+            hist_percentile(h, 0.50) / 1000.0, hist_percentile(h, 0.99) / 1000.0,
+            hist_percentile(h, 0.999) / 1000.0, h->max_us / 1000.0);
+    if (device->samples > 0) {
+        fprintf(out, ",\"device\":");
+        device_write_json(device, out);
+    }
+    fputc('}', out);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  --url URL           MCP endpoint (default %s); repeat to balance over several\n", MCP_URL);
+    printf("  --balance P         least (outstanding calls, default) or ewma (latency)\n");
+    printf("Token throughput (streamed generate calls):\n");
+    printf("  --corpus FILE       prompts, one per line, replayed in order; --requests is per level (default %d)\n",
+           TOKEN_DEFAULT_CALLS);
+    printf("  --sweep N|A,B,...   concurrency levels: 1, 2, 4 ... N, or the listed ones\n");
+    printf("  --label TEXT        configuration name (model, quantization) for the reports\n");
+    printf("  --csv FILE          write one CSV row per level; --json writes the levels as JSON\n");
+    printf("  --transport SPEC    http (default), http2, unix[:PATH], shm[:NAME], stdio:COMMAND or mock;\n");
+    printf("                      mock answers from inside the process, a baseline for the client alone\n");
+    printf("  --unix PATH         connect over a Unix domain socket (--transport unix:PATH)\n");
+    printf("  --framing F         json (default) or cbor request and reply bodies\n");
+    printf("  --shm NAME          call through the shared memory rings at NAME, e.g. %s (--transport shm:NAME)\n",
+           SHM_RING_NAME);
+    printf("  --concurrency N     calls in flight (default %d, max %d)\n", DEFAULT_CONCURRENCY, MCP_MAX_PARALLEL);
+    printf("  --requests N        total measured calls (default %d)\n", DEFAULT_REQUESTS);
+    printf("  --duration SEC      run for SEC seconds instead of a fixed count\n");
+    printf("  --mix SPEC          tool[:weight],... (default %s)\n", DEFAULT_MIX);
+    printf("  --args TOOL=JSON    arguments for TOOL (repeatable)\n");
+    printf("  --warmup N          unmeasured calls before the run (default 0)\n");
+    printf("  --seed N            seed for the request mix (default 1)\n");
+    printf("  --json FILE         also write the report as JSON\n");
+    printf("  --max-p99 MS        exit with status 1 if overall p99 exceeds MS\n");
+    printf("  --deadline MS       per-call deadline instead of each tool's default\n");
+    printf("  --hedge PCT         resend read-only calls still running past their PCT percentile\n");
+    printf("  --telemetry MS      read GPU load and clock, EMC clock, temperature and RAM every MS (0 for\n"
+           "                      %d) and report the worst seen during each tool's calls\n", TELEMETRY_DEFAULT_MS);
+}
+
+int main(int argc, char **argv) {
+    BenchRun run;
+    McpClient client;
+    const char *urls[MCP_MAX_ENDPOINTS] = { MCP_URL };
+    size_t nurls = 0;
+    const char *url = MCP_URL;
+    BalancePolicy policy = BALANCE_LEAST_OUTSTANDING;
+    McpFraming framing = MCP_FRAMING_JSON;
+    const char *transport = NULL;
+    char shorthand[256];
+    const char *mix = DEFAULT_MIX;
+    const char *json_path = NULL;
+    const char *arg_specs[MAX_MIX];
+    size_t narg_specs = 0;
+    long requests = DEFAULT_REQUESTS, warmup = 0;
+    double duration_s = 0, max_p99_ms = 0, deadline_ms = 0, hedge = 0;
+    size_t concurrency = DEFAULT_CONCURRENCY;
+    unsigned seed = 1;
+    TokenBenchOptions tokens;
+    int requests_set = 0;
+    int telemetry_ms = -1;
+    McpTelemetry telemetry = { .running = 0 };
+    
+    memset(&run, 0, sizeof(run));
+    memset(&tokens, 0, sizeof(tokens));
+    
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(opt, "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        }
+        if (!val) {
+            usage(argv[0]);
+            return 2;
+        }
+        if (strcmp(opt, "--url") == 0 && nurls < MCP_MAX_ENDPOINTS) urls[nurls++] = val;
+        else if (strcmp(opt, "--balance") == 0 && strcmp(val, "ewma") == 0) policy = BALANCE_EWMA;
+        else if (strcmp(opt, "--balance") == 0 && strcmp(val, "least") == 0) policy = BALANCE_LEAST_OUTSTANDING;
+        else if (strcmp(opt, "--transport") == 0) transport = val;
+        else if (strcmp(opt, "--unix") == 0 || strcmp(opt, "--shm") == 0) {
+            snprintf(shorthand, sizeof(shorthand), "%s:%s", opt + 2, val);
+            transport = shorthand;
+        }
+        else if (strcmp(opt, "--framing") == 0 && strcmp(val, "json") == 0) framing = MCP_FRAMING_JSON;
+        else if (strcmp(opt, "--framing") == 0 && strcmp(val, "cbor") == 0) framing = MCP_FRAMING_CBOR;
+        else if (strcmp(opt, "--concurrency") == 0) concurrency = (size_t)atoi(val);
+        else if (strcmp(opt, "--requests") == 0) {
+            requests = atol(val);
+            requests_set = 1;
+        } else if (strcmp(opt, "--duration") == 0) duration_s = atof(val);
+        else if (strcmp(opt, "--mix") == 0) mix = val;
+        else if (strcmp(opt, "--args") == 0 && narg_specs < MAX_MIX) arg_specs[narg_specs++] = val;
+        else if (strcmp(opt, "--warmup") == 0) warmup = atol(val);
+        else if (strcmp(opt, "--seed") == 0) seed = (unsigned)atol(val);
+        else if (strcmp(opt, "--json") == 0) json_path = val;
+        else if (strcmp(opt, "--max-p99") == 0) max_p99_ms = atof(val);
+        else if (strcmp(opt, "--deadline") == 0) deadline_ms = atof(val);
+        else if (strcmp(opt, "--hedge") == 0) hedge = atof(val);
+        else if (strcmp(opt, "--telemetry") == 0) telemetry_ms = atoi(val);
+        else if (strcmp(opt, "--corpus") == 0) tokens.corpus_path = val;
+        else if (strcmp(opt, "--label") == 0) tokens.label = val;
+        else if (strcmp(opt, "--csv") == 0) tokens.csv_path = val;
+        else if (strcmp(opt, "--sweep") == 0) {
+            if (token_parse_sweep(&tokens, val) != 0) {
+                fprintf(stderr, "Invalid --sweep %s\n", val);
+                return 2;
+            }
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    
+    if (parse_mix(&run, mix) != 0) {
+        fprintf(stderr, "Invalid --mix %s\n", mix);
+        return 2;
+    }
+    for (size_t i = 0; i < narg_specs; i++) {
+        if (set_mix_args(&run, arg_specs[i]) != 0) {
+            fprintf(stderr, "--args %s does not name a tool in the mix\n", arg_specs[i]);
+            return 2;
+        }
+    }
+    if (concurrency == 0 || concurrency > MCP_MAX_PARALLEL) concurrency = MCP_MAX_PARALLEL;
+    run.nslots = concurrency;
+    run.rng = seed ? seed : 1;
+    
+    url = urls[0];
+    
+    int failed = mcp_client_init(&client, url) != 0;
+    for (size_t i = 1; i < nurls && !failed; i++) failed = mcp_client_add_endpoint(&client, urls[i]) != 0;
+    if (failed || mcp_client_set_framing(&client, framing) != 0) {
+        fprintf(stderr, "Failed to initialize MCP client\n");
+        mcp_global_cleanup();
+        return 1;
+    }
+    if (transport && mcp_client_set_transport(&client, transport) != 0) {
+        fprintf(stderr, "Cannot set up transport %s\n", transport);
+        mcp_client_cleanup(&client);
+        mcp_global_cleanup();
+        return 1;
+    }
+    client.balancer.policy = policy;
+    client.deadline_ms = deadline_ms;
+    client.hedge_percentile = hedge / 100.0;
+    if (telemetry_ms >= 0) {
+        if (telemetry_start(&telemetry, telemetry_ms) != 0) {
+            fprintf(stderr, "No device telemetry to read here\n");
+            mcp_client_cleanup(&client);
+            mcp_global_cleanup();
+            return 1;
+        }
+        client.telemetry = &telemetry;
+    }
+    
+    if (tokens.corpus_path) {
+        if (tokens.nlevels == 0) tokens.levels[tokens.nlevels++] = concurrency;
+        tokens.calls = requests_set ? requests : 0;
+        tokens.warmup = warmup;
+        tokens.json_path = json_path;
+        int status = run_token_bench(&client, &tokens);
+        for (size_t i = 0; i < run.nmix; i++) free(run.mix[i].args);
+        mcp_client_cleanup(&client);
+        mcp_global_cleanup();
+        telemetry_stop(&telemetry);
+        return status;
+    }
+    
+    if (warmup > 0) {
+        run.limit = warmup;
+        run_mcp_calls(&client, next_bench_call, &run, concurrency, bench_call_done, NULL);
+        memset(client.stats, 0, sizeof(*client.stats));
+        run.issued = 0;
+    }
+    
+    run.limit = duration_s > 0 ? 0 : requests;
+    double start = mcp_now_ms();
+    run.deadline_ms = duration_s > 0 ? start + duration_s * 1000.0 : 0;
+    run_mcp_calls(&client, next_bench_call, &run, concurrency, bench_call_done, NULL);
+    double elapsed = mcp_now_ms() - start;
+    
+    Histogram all;
+    DeviceState all_device = { 0 };
+    long all_calls = 0, all_errors = 0;
+    unsigned long long wire_bytes = 0, body_bytes = 0;
+    memset(&all, 0, sizeof(all));
+    
+    char route[256];
+    mcp_client_describe_transport(&client, route, sizeof(route));
+    printf("Benchmark: %s, concurrency %zu, %ld calls in %.1f ms\n", route, concurrency, run.issued, elapsed);
+    printf("%-18s %8s %6s %10s %9s %9s %9s %9s\n",
+           "Tool", "Calls", "Errors", "req/s", "p50 ms", "p99 ms", "p999 ms", "max ms");
+    for (size_t i = 0; i < client.stats->ntools; i++) {
+        const ToolStats *entry = &client.stats->tools[i];
+        print_row(entry->tool, entry->calls, entry->errors, elapsed, &entry->phase[STAT_TOTAL]);
+        hist_merge(&all, &entry->phase[STAT_TOTAL]);
+        device_fold(&all_device, &entry->device);
+        all_calls += entry->calls;
+        all_errors += entry->errors;
+        wire_bytes += entry->wire_bytes;
+        body_bytes += entry->body_bytes;
+    }
+    print_row("all", all_calls, all_errors, elapsed, &all);
+    long arena_spills = 0;
+    size_t arena_peak = mcp_client_arena_peak(&client, &arena_spills);
+    printf("Bytes: %llu on the wire, %llu decoded\n", wire_bytes, body_bytes);
+    printf("Arena: %zu bytes peak per call, %ld spills\n", arena_peak, arena_spills);
+    for (size_t i = 0; i < client.stats->ntools; i++) {
+        const ToolStats *entry = &client.stats->tools[i];
+        if (entry->device.samples == 0) continue;
+        printf("Device during %s: ", entry->tool);
+        device_print(&entry->device, stdout);
+        printf("\n");
+    }
+    for (size_t i = 0; client.balancer.count > 1 && i < client.balancer.count; i++) {
+        const McpEndpoint *endpoint = &client.balancer.endpoints[i];
+        printf("Endpoint %s: %ld calls, %ld failed, ewma %.1f ms, %ld ejections\n", endpoint->url,
+               endpoint->calls, endpoint->failures, endpoint->ewma_ms, endpoint->ejections);
+    }
+    if (hedge > 0) printf("Hedged: %ld sent, %ld answered first\n", client.hedges, client.hedge_wins);
+    
+    if (json_path) {
+        FILE *out = fopen(json_path, "w");
+        if (out) {
+            fprintf(out, "{\"url\":");
+            mcp_write_json_string(out, url, strlen(url));
+            if (client.unix_path) {
+                fprintf(out, ",\"unix_socket\":");
+                mcp_write_json_string(out, client.unix_path, strlen(client.unix_path));
+            }
+            fprintf(out, ",\"transport\":");
+            mcp_write_json_string(out, route, strlen(route));
+            fprintf(out, ",\"concurrency\":%zu,\"elapsed_ms\":%.1f,\"tools\":{", concurrency, elapsed);
+            for (size_t i = 0; i < client.stats->ntools; i++) {
+                const ToolStats *entry = &client.stats->tools[i];
+                fprintf(out, "%s\"%s\":", i ? "," : "", entry->tool);
+                write_row_json(out, entry->calls, entry->errors, elapsed, &entry->phase[STAT_TOTAL], &entry->device);
+            }
+            fprintf(out, "},\"all\":");
+            write_row_json(out, all_calls, all_errors, elapsed, &all, &all_device);
+            fprintf(out, ",\"wire_bytes\":%llu,\"body_bytes\":%llu,\"arena_peak_bytes\":%zu,\"arena_spills\":%ld,"
+                    "\"hedges\":%ld,\"hedge_wins\":%ld,\"endpoints\":[", wire_bytes, body_bytes, arena_peak,
+                    arena_spills, client.hedges, client.hedge_wins);
+            for (size_t i = 0; i < client.balancer.count; i++) {
+                const McpEndpoint *endpoint = &client.balancer.endpoints[i];
+                fprintf(out, "%s{\"url\":", i ? "," : "");
+                mcp_write_json_string(out, endpoint->url, strlen(endpoint->url));
+                fprintf(out, ",\"calls\":%ld,\"failures\":%ld,\"ewma_ms\":%.3f,\"ejections\":%ld}",
+                        endpoint->calls, endpoint->failures, endpoint->ewma_ms, endpoint->ejections);
+            }
+            fprintf(out, "]}\n");
+            fclose(out);
+        } else {
+            fprintf(stderr, "Cannot write %s\n", json_path);
+        }
+    }
+    
+    int status = 0;
+    if (max_p99_ms > 0 && hist_percentile(&all, 0.99) / 1000.0 > max_p99_ms) {
+        fprintf(stderr, "p99 %.3f ms exceeds --max-p99 %.3f ms\n", hist_percentile(&all, 0.99) / 1000.0, max_p99_ms);
+        status = 1;
+    }
+    
+    for (size_t i = 0; i < run.nmix; i++) free(run.mix[i].args);
+    mcp_client_cleanup(&client);
+    mcp_global_cleanup();
+    telemetry_stop(&telemetry);
+    return status;
+}
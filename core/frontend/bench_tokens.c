@@ -0,0 +1,288 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_tokens.h"
+#include "stats.h"
+#include "telemetry.h"
+
+typedef struct {
+    size_t concurrency;
+    long calls;
+    long errors;
+    long tokens;
+    double elapsed_ms;
+    Histogram first_frame;  // call start to its first streamed chunk
+    Histogram inter_frame;  // gap between consecutive chunks of one call
+    Histogram total;
+    DeviceState device;     // worst over the level's calls, with --telemetry
+} TokenLevel;
+
+typedef struct {
+    McpCall call;
+    int busy;
+    double last_token_ms;
+    TokenLevel *level;
+} TokenSlot;
+
+typedef struct {
+    char **args;            // {"prompt": ...} for each corpus line
+    size_t nargs;
+    size_t next;
+    TokenSlot slots[MCP_MAX_PARALLEL];
+    size_t nslots;
+    long issued;
+    long limit;
+    TokenLevel *level;
+} TokenRun;
+
+int token_parse_sweep(TokenBenchOptions *opts, const char *spec) {
+    opts->nlevels = 0;
+    if (!strchr(spec, ',')) {
+        size_t max = (size_t)atoi(spec);
+        if (max == 0 || max > MCP_MAX_PARALLEL) return -1;
+        for (size_t n = 1; n < max && opts->nlevels < TOKEN_MAX_LEVELS - 1; n *= 2) opts->levels[opts->nlevels++] = n;
+        opts->levels[opts->nlevels++] = max;
+        return 0;
+    }
+    
+    for (const char *p = spec; *p && opts->nlevels < TOKEN_MAX_LEVELS; p++) {
+        size_t n = (size_t)atoi(p);
+        if (n == 0 || n > MCP_MAX_PARALLEL) return -1;
+        opts->levels[opts->nlevels++] = n;
+        p += strspn(p, "0123456789");
+        if (*p != ',') break;
+    }
+    return opts->nlevels > 0 ? 0 : -1;
+}
+
+static void free_corpus(TokenRun *run) {
+    for (size_t i = 0; i < run->nargs; i++) free(run->args[i]);
+    free(run->args);
+    run->args = NULL;
+    run->nargs = 0;
+}
+
+// Each non-empty line becomes the arguments of one generate call, with the
+// prompt escaped by the same writer the NDJSON output uses
+static int load_corpus(TokenRun *run, const char *path) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    char *line = NULL;
+    size_t cap = 0, alloc = 0;
+    ssize_t len;
+    
+    if (!in) return -1;
+    while ((len = getline(&line, &cap, in)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+        if (len == 0) continue;
+        
+        if (run->nargs == alloc) {
+            size_t grown = alloc ? alloc * 2 : 64;
+            char **args = realloc(run->args, grown * sizeof(char *));
+            if (!args) break;
+            run->args = args;
+            alloc = grown;
+        }
+        char *json = NULL;
+        size_t size = 0;
+        FILE *out = open_memstream(&json, &size);
+        if (!out) break;
+        fputs("{\"prompt\":", out);
+        mcp_write_json_string(out, line, (size_t)len);
+        fputc('}', out);
+        if (fclose(out) != 0) {
+            free(json);
+            break;
+        }
+        run->args[run->nargs++] = json;
+    }
+    
+    free(line);
+    if (in != stdin) fclose(in);
+    return run->nargs > 0 ? 0 : -1;
+}
+
+static void token_arrived(McpCall *call, const char *text, size_t len) {
+    TokenSlot *slot = call->context;
+    double now = mcp_now_ms();
+    (void)text;
+    (void)len;
+    
+    // A JSON-RPC error's text, not a token
+    if (call->reply.is_error) return;
+    if (call->tokens > 0) hist_record(&slot->level->inter_frame, (uint64_t)((now - slot->last_token_ms) * 1000.0));
+    slot->last_token_ms = now;
+    slot->level->tokens++;
+}
+
+static McpCall *next_token_call(void *source) {
+    TokenRun *run = source;
+    
+    if (run->issued >= run->limit) return NULL;
+    for (size_t i = 0; i < run->nslots; i++) {
+        TokenSlot *slot = &run->slots[i];
+        if (slot->busy) continue;
+        
+        memset(&slot->call, 0, sizeof(slot->call));
+        slot->call.tool = "generate";
+        slot->call.args = run->args[run->next++ % run->nargs];
+        slot->call.context = slot;
+        slot->call.on_token = token_arrived;
+        slot->level = run->level;
+        slot->busy = 1;
+        run->issued++;
+        return &slot->call;
+    }
+    return NULL;
+}
+
+static void token_call_done(McpCall *call, void *userdata) {
+    TokenSlot *slot = call->context;
+    TokenLevel *level = slot->level;
+    (void)userdata;
+    
+    slot->busy = 0;
+    level->calls++;
+    device_fold(&level->device, &call->timing.device);
+    if (call->res != CURLE_OK || call->reply.is_error || call->tokens == 0) {
+        level->errors++;
+        return;
+    }
+    hist_record(&level->first_frame, (uint64_t)((call->first_token_ms - call->start_ms) * 1000.0));
+    hist_record(&level->total, (uint64_t)((call->end_ms - call->start_ms) * 1000.0));
+}
+
+static void run_level(McpClient *client, TokenRun *run, TokenLevel *level, size_t concurrency, long calls) {
+    memset(level, 0, sizeof(*level));
+    level->concurrency = concurrency;
+    run->level = level;
+    run->nslots = concurrency;
+    run->issued = 0;
+    run->limit = calls;
+    
+    double start = mcp_now_ms();
+    run_mcp_calls(client, next_token_call, run, concurrency, token_call_done, NULL);
+    level->elapsed_ms = mcp_now_ms() - start;
+}
+
+static double tokens_per_s(const TokenLevel *level) {
+    return level->elapsed_ms > 0 ? level->tokens * 1000.0 / level->elapsed_ms : 0.0;
+}
+
+static double pct_ms(const Histogram *h, double p) {
+    return hist_percentile(h, p) / 1000.0;
+}
+
+// One CSV field per device reading, empty where there is none
+static void write_device_csv(FILE *out, const DeviceState *device) {
+    long values[] = { device->gpu_load, device->gpu_mhz, device->emc_mhz, device->temp_mc, device->ram_used_mb };
+    
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        if (device->samples == 0 || values[i] < 0) fputc(',', out);
+        else if (i == 0) fprintf(out, ",%.1f", values[i] / 10.0);
+        else if (i == 3) fprintf(out, ",%.1f", values[i] / 1000.0);
+        else fprintf(out, ",%ld", values[i]);
+    }
+}
+
+static void write_csv(FILE *out, const TokenBenchOptions *opts, const TokenLevel *levels, size_t count) {
+    fprintf(out, "label,concurrency,calls,errors,tokens,tokens_per_s,first_frame_p50_ms,first_frame_p99_ms,"
+            "inter_frame_p50_ms,inter_frame_p99_ms,total_p50_ms,total_p99_ms,gpu_load_pct,gpu_mhz,emc_mhz,temp_c,ram_used_mb\n");
+    for (size_t i = 0; i < count; i++) {
+        const TokenLevel *l = &levels[i];
+        // Labels are written as a quoted field with quotes doubled
+        fputc('"', out);
+        for (const char *c = opts->label ? opts->label : ""; *c; c++) {
+            if (*c == '"') fputc('"', out);
+            fputc(*c, out);
+        }
+        fprintf(out, "\",%zu,%ld,%ld,%ld,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f", l->concurrency, l->calls,
+                l->errors, l->tokens, tokens_per_s(l), pct_ms(&l->first_frame, 0.50), pct_ms(&l->first_frame, 0.99),
+                pct_ms(&l->inter_frame, 0.50), pct_ms(&l->inter_frame, 0.99), pct_ms(&l->total, 0.50), pct_ms(&l->total, 0.99));
+        write_device_csv(out, &l->device);
+        fputc('\n', out);
+    }
+}
+
+static void write_json(FILE *out, const McpClient *client, const TokenBenchOptions *opts,
+                       const TokenLevel *levels, size_t count) {
+    const char *label = opts->label ? opts->label : "";
+    
+    fprintf(out, "{\"mode\":\"tokens\",\"url\":");
+    mcp_write_json_string(out, client->url, strlen(client->url));
+    fprintf(out, ",\"label\":");
+    mcp_write_json_string(out, label, strlen(label));
+    fprintf(out, ",\"levels\":[");
+    for (size_t i = 0; i < count; i++) {
+        const TokenLevel *l = &levels[i];
+        fprintf(out, "%s{\"concurrency\":%zu,\"calls\":%ld,\"errors\":%ld,\"tokens\":%ld,\"elapsed_ms\":%.1f,"
+                "\"tokens_per_s\":%.2f,\"first_frame\":", i ? "," : "", l->concurrency, l->calls, l->errors,
+                l->tokens, l->elapsed_ms, tokens_per_s(l));
+        hist_write_json(&l->first_frame, out);
+        fprintf(out, ",\"inter_frame\":");
+        hist_write_json(&l->inter_frame, out);
+        fprintf(out, ",\"total\":");
+        hist_write_json(&l->total, out);
+        if (l->device.samples > 0) {
+            fprintf(out, ",\"device\":");
+            device_write_json(&l->device, out);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "]}\n");
+}
+
+static int write_report(const char *path, const McpClient *client, const TokenBenchOptions *opts,
+                        const TokenLevel *levels, size_t count, int csv) {
+    FILE *out = fopen(path, "w");
+    
+    if (!out) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        return -1;
+    }
+    if (csv) write_csv(out, opts, levels, count);
+    else write_json(out, client, opts, levels, count);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+int run_token_bench(McpClient *client, const TokenBenchOptions *opts) {
+    static TokenRun run;
+    TokenLevel levels[TOKEN_MAX_LEVELS];
+    long calls = opts->calls > 0 ? opts->calls : TOKEN_DEFAULT_CALLS;
+    int status = 0;
+    
+    memset(&run, 0, sizeof(run));
+    if (load_corpus(&run, opts->corpus_path) != 0) {
+        fprintf(stderr, "No prompts in %s\n", opts->corpus_path);
+        free_corpus(&run);
+        return 2;
+    }
+    
+    if (opts->warmup > 0) run_level(client, &run, &levels[0], opts->levels[0], opts->warmup);
+    
+    printf("Token benchmark: %s, %zu prompts, %ld calls per level%s%s\n", client->url, run.nargs, calls,
+           opts->label ? ", " : "", opts->label ? opts->label : "");
+    printf("%6s %6s %6s %8s %10s %9s %9s %9s %9s %9s\n", "Conc", "Calls", "Errors", "Tokens", "tok/s",
+           "First p50", "First p99", "Inter p50", "Inter p99", "p50 ms");
+    for (size_t i = 0; i < opts->nlevels; i++) {
+        TokenLevel *l = &levels[i];
+        run_level(client, &run, l, opts->levels[i], calls);
+        printf("%6zu %6ld %6ld %8ld %10.1f %9.3f %9.3f %9.3f %9.3f %9.3f\n", l->concurrency, l->calls, l->errors,
+               l->tokens, tokens_per_s(l), pct_ms(&l->first_frame, 0.50), pct_ms(&l->first_frame, 0.99),
+               pct_ms(&l->inter_frame, 0.50), pct_ms(&l->inter_frame, 0.99), pct_ms(&l->total, 0.50));
+        if (l->device.samples > 0) {
+            printf("%6s device: ", "");
+            device_print(&l->device, stdout);
+            printf("\n");
+        }
+        fflush(stdout);
+        if (l->errors > 0) status = 1;
+    }
+    printf("First: ms to a call's first streamed frame; Inter: ms between its frames\n");
+    
+    if (opts->csv_path && write_report(opts->csv_path, client, opts, levels, opts->nlevels, 1) != 0) status = 1;
+    if (opts->json_path && write_report(opts->json_path, client, opts, levels, opts->nlevels, 0) != 0) status = 1;
+    free_corpus(&run);
+    return status;
+}
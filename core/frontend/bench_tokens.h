@@ -0,0 +1,33 @@
+#ifndef PHASE3_BENCH_TOKENS_H
+#define PHASE3_BENCH_TOKENS_H
+
+#include <stddef.h>
+#include "mcp_client.h"
+
+#define TOKEN_MAX_LEVELS 16
+#define TOKEN_DEFAULT_CALLS 32
+
+// Token-throughput mode of phase3_bench: streams a prompt corpus through
+// generate at each concurrency level of a sweep and reports tokens/s, the
+// time to the first streamed frame and the gap between frames. A "token" is
+// one streamed text chunk, which is what the server sends per delta; only
+// against a server that emits deltas while decoding are these the time to
+// first token and the inter-token latency.
+typedef struct {
+    const char *corpus_path;    // one prompt per line
+    const char *label;          // e.g. model and quantization, copied into the reports
+    size_t levels[TOKEN_MAX_LEVELS];
+    size_t nlevels;
+    long calls;                 // measured calls per level
+    long warmup;                // unmeasured calls before the first level
+    const char *csv_path;
+    const char *json_path;
+} TokenBenchOptions;
+
+// "1,2,8" lists the levels; a single N doubles from 1 up to N
+int token_parse_sweep(TokenBenchOptions *opts, const char *spec);
+
+// Returns 0 when every level completed with no failed calls
+int run_token_bench(McpClient *client, const TokenBenchOptions *opts);
+
+#endif
@@ -6,7 +6,7 @@ set -e
 
 echo "Installing dependencies..."
 sudo apt-get update
-sudo apt-get install -y libcurl4-openssl-dev libjson-c-dev gcc make
+sudo apt-get install -y libcurl4-openssl-dev gcc make
 
 echo "Building frontend..."
 cd /home/petr/jetson/phase3/frontend
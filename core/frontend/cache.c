@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+
+static const struct { const char *tool; double ttl_ms; } cache_policy[] = {
+    { "get_status", 2000 },
+    { "db_status", 2000 },
+    { "get_agent_config", 30000 },
+    { "get_settings", 30000 },
+};
+
+static const char *const mutating_tools[] = {
+    "set_debug", "start_frontend", "set_agent_config", "set_setting", "db_query", "restart_service",
+};
+
+double cache_ttl_ms(const char *tool) {
+    for (size_t i = 0; i < sizeof(cache_policy) / sizeof(cache_policy[0]); i++) {
+        if (strcmp(cache_policy[i].tool, tool) == 0) return cache_policy[i].ttl_ms;
+    }
+    return 0;
+}
+
+int cache_invalidates(const char *tool) {
+    for (size_t i = 0; i < sizeof(mutating_tools) / sizeof(mutating_tools[0]); i++) {
+        if (strcmp(mutating_tools[i], tool) == 0) return 1;
+    }
+    return 0;
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Walks args the way a key stores them: whitespace outside strings dropped.
+// Returns the next significant byte, or 0 at the end.
+static char next_canonical(const char **args, int *in_string, int *escaped) {
+    while (**args) {
+        char c = *(*args)++;
+        if (*in_string) {
+            if (*escaped) *escaped = 0;
+            else if (c == '\\') *escaped = 1;
+            else if (c == '"') *in_string = 0;
+            return c;
+        }
+        if (is_space(c)) continue;
+        if (c == '"') *in_string = 1;
+        return c;
+    }
+    return 0;
+}
+
+static int key_matches(const CacheEntry *entry, const char *tool, const char *args) {
+    size_t tool_len = strlen(tool);
+    int in_string = 0, escaped = 0;
+    
+    if (entry->key_len <= tool_len || memcmp(entry->key, tool, tool_len + 1) != 0) return 0;
+    
+    const char *key = entry->key + tool_len + 1;
+    const char *end = entry->key + entry->key_len;
+    for (;;) {
+        char c = next_canonical(&args, &in_string, &escaped);
+        if (key == end) return c == 0;
+        if (c != *key++) return 0;
+    }
+}
+
+CacheEntry *cache_find(McpCache *cache, const char *tool, const char *args) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (key_matches(&cache->entries[i], tool, args)) return &cache->entries[i];
+    }
+    return NULL;
+}
+
+static void entry_free(CacheEntry *entry) {
+    free(entry->key);
+    free(entry->body);
+    memset(entry, 0, sizeof(*entry));
+}
+
+int cache_store(McpCache *cache, const char *tool, const char *args, const char *body, size_t size,
+                int cbor, const char *etag, double now_ms) {
+    CacheEntry *entry = cache_find(cache, tool, args);
+    
+    if (!entry && cache->count < MCP_CACHE_ENTRIES) {
+        entry = &cache->entries[cache->count++];
+    } else if (!entry) {
+        // Full: replace whichever entry goes stale first
+        entry = &cache->entries[0];
+        for (size_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].expires_ms < entry->expires_ms) entry = &cache->entries[i];
+        }
+    }
+    entry_free(entry);
+    
+    size_t tool_len = strlen(tool);
+    entry->key = malloc(tool_len + 1 + strlen(args) + 1);
+    entry->body = malloc(size + 1);
+    if (!entry->key || !entry->body) {
+        entry_free(entry);
+        *entry = cache->entries[--cache->count];
+        memset(&cache->entries[cache->count], 0, sizeof(CacheEntry));
+        return -1;
+    }
+    
+    memcpy(entry->key, tool, tool_len + 1);
+    size_t len = tool_len + 1;
+    int in_string = 0, escaped = 0;
+    char c;
+    while ((c = next_canonical(&args, &in_string, &escaped)) != 0) entry->key[len++] = c;
+    entry->key[len] = 0;
+    entry->key_len = len;
+    
+    memcpy(entry->body, body, size);
+    entry->body[size] = 0;
+    entry->size = size;
+    entry->cbor = cbor;
+    snprintf(entry->etag, sizeof(entry->etag), "%s", etag ? etag : "");
+    entry->expires_ms = now_ms + cache_ttl_ms(tool);
+    return 0;
+}
+
+void cache_clear(McpCache *cache) {
+    for (size_t i = 0; i < cache->count; i++) entry_free(&cache->entries[i]);
+    cache->count = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef PHASE3_CACHE_H
+#define PHASE3_CACHE_H
+
+#include <stddef.h>
+
+// Reply cache for read-only tools, keyed by tool name plus the arguments
+// with whitespace outside strings removed. Entries are fresh for the tool's
+// TTL; after that they are revalidated with If-None-Match and kept if the
+// server answers 304.
+#define MCP_CACHE_ENTRIES 32
+
+typedef struct {
+    char *key;              // tool, NUL, canonical args
+    size_t key_len;
+    char *body;             // raw reply body as first received
+    size_t size;
+    int cbor;               // body is CBOR, not JSON
+    char etag[80];
+    double expires_ms;
+} CacheEntry;
+
+typedef struct {
+    int enabled;
+    CacheEntry entries[MCP_CACHE_ENTRIES];
+    size_t count;
+    long hits;
+    long misses;
+    long revalidated;       // 304 answers that kept an entry
+    long invalidations;
+} McpCache;
+
+// TTL for a read-only tool, 0 for tools that are never cached
+double cache_ttl_ms(const char *tool);
+
+// Tools that change server state and so drop every cached reply
+int cache_invalidates(const char *tool);
+
+CacheEntry *cache_find(McpCache *cache, const char *tool, const char *args);
+int cache_store(McpCache *cache, const char *tool, const char *args, const char *body, size_t size,
+                int cbor, const char *etag, double now_ms);
+void cache_clear(McpCache *cache);
+
+#endif
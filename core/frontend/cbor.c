@@ -0,0 +1,652 @@
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cbor.h"
+
+#define CBOR_INDEFINITE 31
+#define CBOR_BREAK 0xff
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_NULL 0xf6
+#define CBOR_FLOAT64 0xfb
+
+int cbor_write_head(CborWrite write, void *out, int major, uint64_t value) {
+    unsigned char head[9];
+    size_t n = 0;
+    
+    if (value < 24) {
+        head[0] = (unsigned char)(major << 5 | (int)value);
+    } else {
+        int info = value <= 0xff ? 24 : value <= 0xffff ? 25 : value <= 0xffffffffu ? 26 : 27;
+        n = (size_t)1 << (info - 24);
+        head[0] = (unsigned char)(major << 5 | info);
+        for (size_t i = 0; i < n; i++) head[n - i] = (unsigned char)(value >> (8 * i));
+    }
+    return write(out, head, n + 1);
+}
+
+int cbor_write_text(CborWrite write, void *out, const char *text, size_t len) {
+    if (cbor_write_head(write, out, CBOR_TEXT, len) != 0) return -1;
+    return len > 0 ? write(out, text, len) : 0;
+}
+
+static int write_byte(CborWrite write, void *out, unsigned char byte) {
+    return write(out, &byte, 1);
+}
+
+typedef struct {
+    const char *p;
+    const char *end;
+    CborWrite write;
+    void *out;
+} JsonIn;
+
+static void skip_ws(JsonIn *in) {
+    while (in->p < in->end && (*in->p == ' ' || *in->p == '\t' || *in->p == '\n' || *in->p == '\r')) in->p++;
+}
+
+static int hex4(const char *p, const char *end, unsigned *value) {
+    *value = 0;
+    if (end - p < 4) return -1;
+    for (int i = 0; i < 4; i++) {
+        int c = (unsigned char)p[i], digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return -1;
+        *value = *value << 4 | (unsigned)digit;
+    }
+    return 0;
+}
+
+static size_t utf8_encode(unsigned cp, unsigned char *buf) {
+    if (cp < 0x80) {
+        buf[0] = (unsigned char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        buf[0] = (unsigned char)(0xc0 | cp >> 6);
+        buf[1] = (unsigned char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        buf[0] = (unsigned char)(0xe0 | cp >> 12);
+        buf[1] = (unsigned char)(0x80 | (cp >> 6 & 0x3f));
+        buf[2] = (unsigned char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    buf[0] = (unsigned char)(0xf0 | cp >> 18);
+    buf[1] = (unsigned char)(0x80 | (cp >> 12 & 0x3f));
+    buf[2] = (unsigned char)(0x80 | (cp >> 6 & 0x3f));
+    buf[3] = (unsigned char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// Next decoded piece of a JSON string body: 1 with up to 4 bytes in buf, 0
+// at the closing quote, -1 if the string is malformed. A lone surrogate
+// escape becomes U+FFFD.
+static int string_next(const char **pp, const char *end, unsigned char *buf, size_t *n) {
+    const char *p = *pp;
+    unsigned cp, low;
+    
+    if (p >= end || (unsigned char)*p < 0x20) return -1;
+    if (*p == '"') {
+        *pp = p + 1;
+        return 0;
+    }
+    if (*p != '\\') {
+        buf[0] = (unsigned char)*p;
+        *n = 1;
+        *pp = p + 1;
+        return 1;
+    }
+    if (++p >= end) return -1;
+    switch (*p++) {
+        case '"': cp = '"'; break;
+        case '\\': cp = '\\'; break;
+        case '/': cp = '/'; break;
+        case 'b': cp = '\b'; break;
+        case 'f': cp = '\f'; break;
+        case 'n': cp = '\n'; break;
+        case 'r': cp = '\r'; break;
+        case 't': cp = '\t'; break;
+        case 'u':
+            if (hex4(p, end, &cp) != 0) return -1;
+            p += 4;
+            if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                hex4(p + 2, end, &low) == 0 && low >= 0xdc00 && low < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                p += 6;
+            } else if (cp >= 0xd800 && cp < 0xe000) {
+                cp = 0xfffd;
+            }
+            break;
+        default:
+            return -1;
+    }
+    *n = utf8_encode(cp, buf);
+    *pp = p;
+    return 1;
+}
+
+// Called just past the opening quote. The string is walked once to learn
+// its decoded length for the head and once more to emit it in chunks.
+static int json_string(JsonIn *in) {
+    unsigned char piece[4], chunk[256];
+    const char *p = in->p;
+    size_t len = 0, n = 0, used = 0;
+    int more;
+    
+    while ((more = string_next(&p, in->end, piece, &n)) == 1) len += n;
+    if (more < 0 || cbor_write_head(in->write, in->out, CBOR_TEXT, len) != 0) return -1;
+    
+    while (string_next(&in->p, in->end, piece, &n) == 1) {
+        if (used + n > sizeof(chunk)) {
+            if (in->write(in->out, chunk, used) != 0) return -1;
+            used = 0;
+        }
+        memcpy(chunk + used, piece, n);
+        used += n;
+    }
+    return used > 0 ? in->write(in->out, chunk, used) : 0;
+}
+
+static int write_double(CborWrite write, void *out, double value) {
+    unsigned char bytes[9];
+    uint64_t bits;
+    
+    memcpy(&bits, &value, sizeof(bits));
+    bytes[0] = CBOR_FLOAT64;
+    for (int i = 0; i < 8; i++) bytes[8 - i] = (unsigned char)(bits >> (8 * i));
+    return write(out, bytes, sizeof(bytes));
+}
+
+// Integers that fit go out as CBOR integers, everything else as float64
+static int json_number(JsonIn *in) {
+    const char *start = in->p, *p = in->p;
+    int integer = 1;
+    
+    if (p < in->end && *p == '-') p++;
+    if (p >= in->end || !isdigit((unsigned char)*p)) return -1;
+    if (*p == '0') p++;
+    else while (p < in->end && isdigit((unsigned char)*p)) p++;
+    if (p < in->end && *p == '.') {
+        integer = 0;
+        if (++p >= in->end || !isdigit((unsigned char)*p)) return -1;
+        while (p < in->end && isdigit((unsigned char)*p)) p++;
+    }
+    if (p < in->end && (*p == 'e' || *p == 'E')) {
+        integer = 0;
+        if (++p < in->end && (*p == '+' || *p == '-')) p++;
+        if (p >= in->end || !isdigit((unsigned char)*p)) return -1;
+        while (p < in->end && isdigit((unsigned char)*p)) p++;
+    }
+    in->p = p;
+    
+    if (integer) {
+        int negative = *start == '-', overflow = 0;
+        uint64_t value = 0;
+        for (const char *d = start + negative; d < p; d++) {
+            unsigned digit = (unsigned)(*d - '0');
+            if (value > (UINT64_MAX - digit) / 10) overflow = 1;
+            value = value * 10 + digit;
+        }
+        if (!overflow && negative && value > 0) return cbor_write_head(in->write, in->out, CBOR_NEGINT, value - 1);
+        if (!overflow) return cbor_write_head(in->write, in->out, CBOR_UINT, value);
+    }
+    
+    char digits[64];
+    size_t len = (size_t)(p - start);
+    if (len >= sizeof(digits)) return -1;
+    memcpy(digits, start, len);
+    digits[len] = 0;
+    return write_double(in->write, in->out, strtod(digits, NULL));
+}
+
+static int json_literal(JsonIn *in, const char *word, unsigned char byte) {
+    size_t len = strlen(word);
+    
+    if ((size_t)(in->end - in->p) < len || memcmp(in->p, word, len) != 0) return -1;
+    in->p += len;
+    return write_byte(in->write, in->out, byte);
+}
+
+static int json_value(JsonIn *in, int depth);
+
+static int json_container(JsonIn *in, int depth) {
+    int object = *in->p++ == '{';
+    char close = object ? '}' : ']';
+    
+    if (write_byte(in->write, in->out, (unsigned char)((object ? CBOR_MAP : CBOR_ARRAY) << 5 | CBOR_INDEFINITE)) != 0) {
+        return -1;
+    }
+    skip_ws(in);
+    if (in->p < in->end && *in->p == close) {
+        in->p++;
+        return write_byte(in->write, in->out, CBOR_BREAK);
+    }
+    for (;;) {
+        if (object) {
+            skip_ws(in);
+            if (in->p >= in->end || *in->p != '"') return -1;
+            in->p++;
+            if (json_string(in) != 0) return -1;
+            skip_ws(in);
+            if (in->p >= in->end || *in->p++ != ':') return -1;
+        }
+        if (json_value(in, depth + 1) != 0) return -1;
+        skip_ws(in);
+        if (in->p >= in->end) return -1;
+        char c = *in->p++;
+        if (c == close) return write_byte(in->write, in->out, CBOR_BREAK);
+        if (c != ',') return -1;
+    }
+}
+
+static int json_value(JsonIn *in, int depth) {
+    if (depth > CBOR_MAX_DEPTH) return -1;
+    skip_ws(in);
+    if (in->p >= in->end) return -1;
+    
+    switch (*in->p) {
+        case '{':
+        case '[':
+            return json_container(in, depth);
+        case '"':
+            in->p++;
+            return json_string(in);
+        case 't': return json_literal(in, "true", CBOR_TRUE);
+        case 'f': return json_literal(in, "false", CBOR_FALSE);
+        case 'n': return json_literal(in, "null", CBOR_NULL);
+        default: return json_number(in);
+    }
+}
+
+int cbor_from_json(CborWrite write, void *out, const char *json, size_t len) {
+    JsonIn in = { json, json + len, write, out };
+    
+    if (json_value(&in, 0) != 0) return -1;
+    skip_ws(&in);
+    return in.p == in.end ? 0 : -1;
+}
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+} Cursor;
+
+static size_t remaining(const Cursor *c) {
+    return (size_t)(c->end - c->p);
+}
+
+// One item head. Floats leave their raw bits in value; info is
+// CBOR_INDEFINITE for an indefinite-length string or container and for a
+// break.
+static int read_head(Cursor *c, int *major, int *info, uint64_t *value) {
+    if (c->p >= c->end) return -1;
+    
+    unsigned char byte = *c->p++;
+    *major = byte >> 5;
+    *info = byte & 31;
+    *value = 0;
+    if (*info < 24) {
+        *value = (uint64_t)*info;
+        return 0;
+    }
+    if (*info == CBOR_INDEFINITE) return (*major >= CBOR_BYTES && *major <= CBOR_MAP) || *major == CBOR_SIMPLE ? 0 : -1;
+    if (*info > 27) return -1;
+    
+    size_t n = (size_t)1 << (*info - 24);
+    if (remaining(c) < n) return -1;
+    for (size_t i = 0; i < n; i++) *value = *value << 8 | *c->p++;
+    return 0;
+}
+
+static int peek_major(const Cursor *c) {
+    return c->p < c->end ? *c->p >> 5 : -1;
+}
+
+// Entries left in a container, or -1 for indefinite length. Every entry
+// takes at least a byte, so a count past the end of data is malformed.
+static int container_left(const Cursor *c, int info, uint64_t value, int64_t *left) {
+    if (info == CBOR_INDEFINITE) {
+        *left = -1;
+        return 0;
+    }
+    if (value > remaining(c)) return -1;
+    *left = (int64_t)value;
+    return 0;
+}
+
+// 1 while another entry follows, 0 past the last one, -1 if data ends first
+static int more(Cursor *c, int64_t *left) {
+    if (*left >= 0) return (*left)-- > 0 ? 1 : 0;
+    if (c->p >= c->end) return -1;
+    if (*c->p == CBOR_BREAK) {
+        c->p++;
+        return 0;
+    }
+    return 1;
+}
+
+static int open_container(Cursor *c, int major, int64_t *left) {
+    int got, info;
+    uint64_t value;
+    
+    if (read_head(c, &got, &info, &value) != 0 || got != major) return -1;
+    return container_left(c, info, value, left);
+}
+
+// Chunks of an indefinite-length string, each a definite string of the same major type
+static int skip_chunks(Cursor *c, int major) {
+    int got, info;
+    uint64_t value;
+    
+    for (;;) {
+        if (c->p >= c->end) return -1;
+        if (*c->p == CBOR_BREAK) {
+            c->p++;
+            return 0;
+        }
+        if (read_head(c, &got, &info, &value) != 0 || got != major || info == CBOR_INDEFINITE) return -1;
+        if (value > remaining(c)) return -1;
+        c->p += value;
+    }
+}
+
+static int skip_item(Cursor *c, int depth) {
+    int major, info, next;
+    uint64_t value;
+    int64_t left;
+    
+    if (depth > CBOR_MAX_DEPTH || read_head(c, &major, &info, &value) != 0) return -1;
+    switch (major) {
+        case CBOR_BYTES:
+        case CBOR_TEXT:
+            if (info == CBOR_INDEFINITE) return skip_chunks(c, major);
+            if (value > remaining(c)) return -1;
+            c->p += value;
+            return 0;
+        case CBOR_ARRAY:
+        case CBOR_MAP:
+            if (container_left(c, info, value, &left) != 0) return -1;
+            while ((next = more(c, &left)) == 1) {
+                if (skip_item(c, depth + 1) != 0) return -1;
+                if (major == CBOR_MAP && skip_item(c, depth + 1) != 0) return -1;
+            }
+            return next;
+        case CBOR_TAG:
+            return skip_item(c, depth + 1);
+        case CBOR_SIMPLE:
+            return info == CBOR_INDEFINITE ? -1 : 0;     // a break outside any container
+        default:
+            return 0;
+    }
+}
+
+// 1 with a definite-length text string, 0 when the item is something else
+// (and has been skipped), -1 if data is malformed
+static int read_text(Cursor *c, int depth, const char **text, size_t *len) {
+    if (peek_major(c) != CBOR_TEXT || (*c->p & 31) == CBOR_INDEFINITE) return skip_item(c, depth) == 0 ? 0 : -1;
+    
+    int major, info;
+    uint64_t value;
+    if (read_head(c, &major, &info, &value) != 0 || value > remaining(c)) return -1;
+    *text = (const char *)c->p;
+    *len = (size_t)value;
+    c->p += value;
+    return 1;
+}
+
+static int read_long(Cursor *c, int depth, long *out, int *found) {
+    int major = peek_major(c), info;
+    uint64_t value;
+    
+    if (major != CBOR_UINT && major != CBOR_NEGINT) return skip_item(c, depth);
+    if (read_head(c, &major, &info, &value) != 0) return -1;
+    if (value > LONG_MAX) value = LONG_MAX;
+    *out = major == CBOR_UINT ? (long)value : -1 - (long)value;
+    if (found) *found = 1;
+    return 0;
+}
+
+static int key_is(const char *key, size_t len, const char *name) {
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
+
+// Walk a map, handing each text key to fn with the cursor on its value.
+// fn must consume the value; entries with other keys are skipped.
+typedef int (*MapEntry)(Cursor *c, int depth, const char *key, size_t len, JsonScanReply *reply);
+
+static int walk_map(Cursor *c, int depth, MapEntry fn, JsonScanReply *reply) {
+    int64_t left;
+    int next;
+    
+    if (depth > CBOR_MAX_DEPTH) return -1;
+    if (peek_major(c) != CBOR_MAP) return skip_item(c, depth);
+    if (open_container(c, CBOR_MAP, &left) != 0) return -1;
+    while ((next = more(c, &left)) == 1) {
+        const char *key = NULL;
+        size_t len = 0;
+        int is_text = read_text(c, depth + 1, &key, &len);
+        if (is_text < 0) return -1;
+        if (is_text ? fn(c, depth + 1, key, len, reply) != 0 : skip_item(c, depth + 1) != 0) return -1;
+    }
+    return next;
+}
+
+static int error_entry(Cursor *c, int depth, const char *key, size_t len, JsonScanReply *reply) {
+    if (key_is(key, len, "code")) return read_long(c, depth, &reply->error_code, NULL);
+    if (key_is(key, len, "message")) return read_text(c, depth, &reply->message, &reply->message_len) < 0 ? -1 : 0;
+    return skip_item(c, depth);
+}
+
+static int content_entry(Cursor *c, int depth, const char *key, size_t len, JsonScanReply *reply) {
+    if (key_is(key, len, "text")) return read_text(c, depth, &reply->text, &reply->text_len) < 0 ? -1 : 0;
+    return skip_item(c, depth);
+}
+
+// result.content[0].text; later content items are skipped
+static int result_entry(Cursor *c, int depth, const char *key, size_t len, JsonScanReply *reply) {
+    int64_t left;
+    int next;
+    
+    if (!key_is(key, len, "content") || peek_major(c) != CBOR_ARRAY) return skip_item(c, depth);
+    if (open_container(c, CBOR_ARRAY, &left) != 0) return -1;
+    for (int index = 0; (next = more(c, &left)) == 1; index++) {
+        if (index == 0 ? walk_map(c, depth + 1, content_entry, reply) != 0 : skip_item(c, depth + 1) != 0) return -1;
+    }
+    return next;
+}
+
+static int reply_entry(Cursor *c, int depth, const char *key, size_t len, JsonScanReply *reply) {
+    if (key_is(key, len, "id")) return read_long(c, depth, &reply->id, &reply->has_id);
+    if (key_is(key, len, "error")) {
+        reply->has_error = 1;
+        return walk_map(c, depth, error_entry, reply);
+    }
+    if (key_is(key, len, "result")) return walk_map(c, depth, result_entry, reply);
+    return skip_item(c, depth);
+}
+
+static int scan_reply(Cursor *c, int depth, JsonScanReply *reply) {
+    memset(reply, 0, sizeof(*reply));
+    reply->text = reply->message = "";
+    return walk_map(c, depth, reply_entry, reply);
+}
+
+int cbor_scan_replies(const unsigned char *data, size_t len, CborReply fn, void *userdata) {
+    Cursor c = { data, data + len };
+    JsonScanReply reply;
+    
+    if (peek_major(&c) != CBOR_ARRAY) {
+        if (scan_reply(&c, 0, &reply) != 0 || c.p != c.end) return -1;
+        fn(userdata, &reply);
+        return 0;
+    }
+    
+    int64_t left;
+    int next;
+    if (open_container(&c, CBOR_ARRAY, &left) != 0) return -1;
+    while ((next = more(&c, &left)) == 1) {
+        if (scan_reply(&c, 1, &reply) != 0) return -1;
+        fn(userdata, &reply);
+    }
+    return next == 0 && c.p == c.end ? 1 : -1;
+}
+
+static void json_chars(FILE *out, const unsigned char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = s[i];
+        switch (ch) {
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if (ch < 0x20) fprintf(out, "\\u%04x", ch);
+                else fputc(ch, out);
+        }
+    }
+}
+
+static double half_to_double(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16, exp = (half >> 10) & 0x1f, mant = half & 0x3ff, bits;
+    float value;
+    
+    if (exp == 0x1f) {
+        bits = sign | 0x7f800000 | mant << 13;
+    } else if (exp > 0) {
+        bits = sign | (exp + 112) << 23 | mant << 13;
+    } else if (mant == 0) {
+        bits = sign;
+    } else {
+        // Subnormal: shift the mantissa up until the implicit bit appears
+        exp = 113;
+        while (!(mant & 0x400)) {
+            mant <<= 1;
+            exp--;
+        }
+        bits = sign | exp << 23 | (mant & 0x3ff) << 13;
+    }
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Shortest form that reads back the same, always with a fraction or
+// exponent so it stays a float; JSON has no NaN or infinity
+static void json_double(FILE *out, double value) {
+    char buf[32];
+    
+    if (!isfinite(value)) {
+        fputs("null", out);
+        return;
+    }
+    snprintf(buf, sizeof(buf), "%.15g", value);
+    if (strtod(buf, NULL) != value) snprintf(buf, sizeof(buf), "%.17g", value);
+    fputs(buf, out);
+    if (!strpbrk(buf, ".e")) fputs(".0", out);
+}
+
+static void json_simple(FILE *out, int info, uint64_t value) {
+    if (info == 20) {
+        fputs("false", out);
+    } else if (info == 21) {
+        fputs("true", out);
+    } else if (info == 25) {
+        json_double(out, half_to_double((uint16_t)value));
+    } else if (info == 26) {
+        uint32_t bits = (uint32_t)value;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        json_double(out, f);
+    } else if (info == 27) {
+        double d;
+        memcpy(&d, &value, sizeof(d));
+        json_double(out, d);
+    } else {
+        fputs("null", out);     // null, undefined and unassigned simple values
+    }
+}
+
+// Chunks of an indefinite-length string are joined into one JSON string
+static void json_string_item(FILE *out, Cursor *c, int major, int info, uint64_t value) {
+    int chunked = info == CBOR_INDEFINITE;
+    
+    fputc('"', out);
+    for (;;) {
+        if (chunked) {
+            if (*c->p == CBOR_BREAK) {
+                c->p++;
+                break;
+            }
+            read_head(c, &major, &info, &value);
+        }
+        if (major == CBOR_TEXT) {
+            json_chars(out, c->p, (size_t)value);
+        } else {
+            for (uint64_t i = 0; i < value; i++) fprintf(out, "%02x", c->p[i]);
+        }
+        c->p += value;
+        if (!chunked) break;
+    }
+    fputc('"', out);
+}
+
+// Only called on data skip_item has already accepted
+static void json_item(FILE *out, Cursor *c, int key) {
+    int major, info;
+    uint64_t value;
+    int64_t left = 0;
+    
+    read_head(c, &major, &info, &value);
+    // JSON object keys must be strings
+    int quote = key && major != CBOR_TEXT && major != CBOR_BYTES && major != CBOR_TAG;
+    if (quote) fputc('"', out);
+    switch (major) {
+        case CBOR_UINT:
+            fprintf(out, "%llu", (unsigned long long)value);
+            break;
+        case CBOR_NEGINT:
+            if (value == UINT64_MAX) fputs("-18446744073709551616", out);
+            else fprintf(out, "-%llu", (unsigned long long)value + 1);
+            break;
+        case CBOR_BYTES:
+        case CBOR_TEXT:
+            json_string_item(out, c, major, info, value);
+            break;
+        case CBOR_ARRAY:
+        case CBOR_MAP:
+            container_left(c, info, value, &left);
+            fputc(major == CBOR_ARRAY ? '[' : '{', out);
+            for (int first = 1; more(c, &left) == 1; first = 0) {
+                if (!first) fputc(',', out);
+                json_item(out, c, major == CBOR_MAP);
+                if (major == CBOR_MAP) {
+                    fputc(':', out);
+                    json_item(out, c, 0);
+                }
+            }
+            fputc(major == CBOR_ARRAY ? ']' : '}', out);
+            break;
+        case CBOR_TAG:
+            json_item(out, c, key);
+            break;
+        default:
+            json_simple(out, info, value);
+            break;
+    }
+    if (quote) fputc('"', out);
+}
+
+int cbor_write_json(FILE *out, const unsigned char *data, size_t len) {
+    Cursor c = { data, data + len };
+    
+    if (skip_item(&c, 0) != 0 || c.p != c.end) return -1;
+    c.p = data;
+    json_item(out, &c, 0);
+    return 0;
+}
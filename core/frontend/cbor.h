@@ -0,0 +1,41 @@
+#ifndef PHASE3_CBOR_H
+#define PHASE3_CBOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "json_scan.h"
+
+// Binary framing for /mcp (Content-Type: application/cbor, RFC 8949),
+// limited to what the tools/call envelope needs. JSON arguments are
+// transcoded in one pass, with objects and arrays written as
+// indefinite-length containers so nothing has to be counted first. Replies
+// are walked in place for the same fields JsonScan extracts, without
+// building a tree.
+#define CBOR_MAX_DEPTH 64
+
+enum { CBOR_UINT, CBOR_NEGINT, CBOR_BYTES, CBOR_TEXT, CBOR_ARRAY, CBOR_MAP, CBOR_TAG, CBOR_SIMPLE };
+
+// Sink for encoded bytes; returns 0, or -1 to abort the encoding
+typedef int (*CborWrite)(void *out, const void *bytes, size_t len);
+
+int cbor_write_head(CborWrite write, void *out, int major, uint64_t value);
+int cbor_write_text(CborWrite write, void *out, const char *text, size_t len);
+
+// Transcode one JSON value. Returns -1 if json is not exactly one
+// well-formed value, or if write failed.
+int cbor_from_json(CborWrite write, void *out, const char *json, size_t len);
+
+// Hand each reply in data to fn: the top-level map, or every map of a
+// top-level array (a batch). Unlike JsonScan, text and message point into
+// data and are not NUL terminated. Returns 1 for an array, 0 for a single
+// reply and -1 if data is not one well-formed CBOR item.
+typedef void (*CborReply)(void *userdata, const JsonScanReply *reply);
+int cbor_scan_replies(const unsigned char *data, size_t len, CborReply fn, void *userdata);
+
+// Render one CBOR item as compact single-line JSON. Byte strings become
+// hex strings and numeric map keys are quoted. Nothing is written, and -1
+// returned, when data is not well formed.
+int cbor_write_json(FILE *out, const unsigned char *data, size_t len);
+
+#endif
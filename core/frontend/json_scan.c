@@ -0,0 +1,534 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json_scan.h"
+
+enum { ST_VALUE, ST_KEY_OR_END, ST_KEY, ST_COLON, ST_AFTER, ST_STRING, ST_ESCAPE, ST_UNICODE, ST_SCALAR, ST_END };
+enum { T_OBJECT, T_ARRAY };
+enum { ROLE_OTHER, ROLE_BATCH, ROLE_REPLY, ROLE_ERROR, ROLE_RESULT, ROLE_CONTENT, ROLE_ITEM };
+enum { KEY_OTHER, KEY_ID, KEY_ERROR, KEY_RESULT, KEY_CODE, KEY_MESSAGE, KEY_CONTENT, KEY_TEXT, KEY_DELTA };
+enum { DEST_NONE, DEST_KEY, DEST_ID, DEST_CODE, DEST_MESSAGE, DEST_TEXT };
+
+static const struct { const char *name; int key; } known_keys[] = {
+    { "id", KEY_ID }, { "error", KEY_ERROR }, { "result", KEY_RESULT }, { "code", KEY_CODE },
+    { "message", KEY_MESSAGE }, { "content", KEY_CONTENT }, { "text", KEY_TEXT }, { "delta", KEY_DELTA },
+};
+
+void json_scan_init(JsonScan *scan) {
+    char *text = scan->text, *message = scan->message;
+    size_t text_cap = scan->text_cap, message_cap = scan->message_cap;
+    Arena *arena = scan->arena;
+    
+    memset(scan, 0, sizeof(*scan));
+    scan->text = text;
+    scan->text_cap = text_cap;
+    scan->message = message;
+    scan->message_cap = message_cap;
+    scan->arena = arena;
+    scan->state = ST_VALUE;
+}
+
+void json_scan_free(JsonScan *scan) {
+    if (!scan->arena) {
+        free(scan->text);
+        free(scan->message);
+    }
+    memset(scan, 0, sizeof(*scan));
+}
+
+void json_scan_use_arena(JsonScan *scan, Arena *arena) {
+    if (!scan->arena) {
+        free(scan->text);
+        free(scan->message);
+    }
+    scan->text = scan->message = NULL;
+    scan->text_len = scan->text_cap = 0;
+    scan->message_len = scan->message_cap = 0;
+    scan->arena = arena;
+}
+
+static int append(Arena *arena, char **buf, size_t *len, size_t *cap, const char *src, size_t n) {
+    if (*len + n + 1 > *cap) {
+        size_t new_cap = *cap ? *cap : 256;
+        while (new_cap < *len + n + 1) new_cap *= 2;
+        char *ptr = arena ? arena_grow(arena, *buf, *buf ? *len + 1 : 0, new_cap) : realloc(*buf, new_cap);
+        if (!ptr) return -1;
+        *buf = ptr;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, src, n);
+    *len += n;
+    (*buf)[*len] = 0;
+    return 0;
+}
+
+static void flush_text(JsonScan *scan) {
+    if (scan->on_text && scan->text_len > 0) {
+        scan->on_text(scan->userdata, scan->text, scan->text_len);
+        scan->text_len = 0;
+    }
+}
+
+static void emit_chars(JsonScan *scan, const char *src, size_t n) {
+    int ok = 0;
+    switch (scan->dest) {
+        case DEST_KEY:
+            if (scan->key_len + n < sizeof(scan->key)) {
+                memcpy(scan->key + scan->key_len, src, n);
+            }
+            // Over-long keys are never interesting; keep the length so they don't match
+            scan->key_len += n;
+            return;
+        case DEST_ID:
+        case DEST_CODE:
+            if (scan->scalar_len + n < sizeof(scan->scalar)) {
+                memcpy(scan->scalar + scan->scalar_len, src, n);
+                scan->scalar_len += n;
+            }
+            return;
+        case DEST_TEXT:
+            ok = append(scan->arena, &scan->text, &scan->text_len, &scan->text_cap, src, n);
+            break;
+        case DEST_MESSAGE:
+            ok = append(scan->arena, &scan->message, &scan->message_len, &scan->message_cap, src, n);
+            break;
+        default:
+            return;
+    }
+    if (ok != 0) scan->failed = 1;
+}
+
+static void emit_codepoint(JsonScan *scan, unsigned cp) {
+    char utf8[4];
+    size_t n;
+    
+    if (cp < 0x80) {
+        utf8[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        utf8[0] = (char)(0xc0 | (cp >> 6));
+        utf8[1] = (char)(0x80 | (cp & 0x3f));
+        n = 2;
+    } else if (cp < 0x10000) {
+        utf8[0] = (char)(0xe0 | (cp >> 12));
+        utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        utf8[2] = (char)(0x80 | (cp & 0x3f));
+        n = 3;
+    } else {
+        utf8[0] = (char)(0xf0 | (cp >> 18));
+        utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+        utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        utf8[3] = (char)(0x80 | (cp & 0x3f));
+        n = 4;
+    }
+    emit_chars(scan, utf8, n);
+}
+
+static JsonScanFrame *top(JsonScan *scan) {
+    return scan->depth > 0 ? &scan->stack[scan->depth - 1] : NULL;
+}
+
+static int container_role(const JsonScanFrame *parent, int type) {
+    if (!parent) return type == T_OBJECT ? ROLE_REPLY : ROLE_BATCH;
+    if (type == T_OBJECT) {
+        if (parent->role == ROLE_BATCH) return ROLE_REPLY;
+        if (parent->role == ROLE_REPLY && parent->key == KEY_ERROR) return ROLE_ERROR;
+        if (parent->role == ROLE_REPLY && parent->key == KEY_RESULT) return ROLE_RESULT;
+        if (parent->role == ROLE_CONTENT && parent->index == 0) return ROLE_ITEM;
+    } else if (parent->role == ROLE_RESULT && parent->key == KEY_CONTENT) {
+        return ROLE_CONTENT;
+    }
+    return ROLE_OTHER;
+}
+
+static int scalar_dest(const JsonScanFrame *parent, int is_string) {
+    if (!parent || parent->type != T_OBJECT) return DEST_NONE;
+    if (parent->role == ROLE_REPLY && parent->key == KEY_ID) return DEST_ID;
+    if (parent->role == ROLE_REPLY && parent->key == KEY_DELTA && is_string) return DEST_TEXT;
+    if (parent->role == ROLE_ERROR && parent->key == KEY_CODE) return DEST_CODE;
+    if (parent->role == ROLE_ERROR && parent->key == KEY_MESSAGE && is_string) return DEST_MESSAGE;
+    if (parent->role == ROLE_ITEM && parent->key == KEY_TEXT && is_string) return DEST_TEXT;
+    return DEST_NONE;
+}
+
+static void reply_begin(JsonScan *scan) {
+    memset(&scan->reply, 0, sizeof(scan->reply));
+    scan->text_len = 0;
+    scan->message_len = 0;
+    if (scan->text) scan->text[0] = 0;
+    if (scan->message) scan->message[0] = 0;
+}
+
+static void reply_end(JsonScan *scan) {
+    flush_text(scan);
+    scan->reply.text = scan->text ? scan->text : "";
+    scan->reply.text_len = scan->text_len;
+    scan->reply.message = scan->message ? scan->message : "";
+    scan->reply.message_len = scan->message_len;
+    if (scan->on_reply) scan->on_reply(scan->userdata, &scan->reply);
+}
+
+static void value_done(JsonScan *scan) {
+    JsonScanFrame *parent = top(scan);
+    if (!parent) {
+        scan->complete = 1;
+        scan->state = ST_END;
+        return;
+    }
+    parent->index++;
+    scan->state = ST_AFTER;
+}
+
+static void scalar_done(JsonScan *scan) {
+    char *end;
+    scan->scalar[scan->scalar_len] = 0;
+    long value = strtol(scan->scalar, &end, 10);
+    
+    // A null (or otherwise non-numeric) id is no id at all
+    if (scan->dest == DEST_ID && end != scan->scalar) {
+        scan->reply.has_id = 1;
+        scan->reply.id = value;
+    } else if (scan->dest == DEST_CODE) {
+        scan->reply.error_code = value;
+    }
+    scan->scalar_len = 0;
+    scan->dest = DEST_NONE;
+}
+
+static int open_container(JsonScan *scan, int type) {
+    if (scan->depth == JSON_SCAN_DEPTH) return -1;
+    
+    JsonScanFrame *parent = top(scan);
+    JsonScanFrame *frame = &scan->stack[scan->depth++];
+    frame->type = (unsigned char)type;
+    frame->role = (unsigned char)container_role(parent, type);
+    frame->key = KEY_OTHER;
+    frame->index = 0;
+    
+    if (frame->role == ROLE_REPLY) reply_begin(scan);
+    if (frame->role == ROLE_ERROR) scan->reply.has_error = 1;
+    scan->state = type == T_OBJECT ? ST_KEY_OR_END : ST_VALUE;
+    return 0;
+}
+
+static int close_container(JsonScan *scan, int type) {
+    JsonScanFrame *frame = top(scan);
+    if (!frame || frame->type != type) return -1;
+    
+    scan->depth--;
+    if (frame->role == ROLE_REPLY) reply_end(scan);
+    value_done(scan);
+    return 0;
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void string_done(JsonScan *scan) {
+    if (scan->high_surrogate) {
+        emit_codepoint(scan, 0xfffd);
+        scan->high_surrogate = 0;
+    }
+    
+    if (scan->dest == DEST_KEY) {
+        JsonScanFrame *frame = top(scan);
+        frame->key = KEY_OTHER;
+        for (size_t i = 0; i < sizeof(known_keys) / sizeof(known_keys[0]); i++) {
+            if (scan->key_len == strlen(known_keys[i].name) &&
+                memcmp(scan->key, known_keys[i].name, scan->key_len) == 0) {
+                frame->key = (unsigned char)known_keys[i].key;
+                break;
+            }
+        }
+        scan->key_len = 0;
+        scan->dest = DEST_NONE;
+        scan->state = ST_COLON;
+        return;
+    }
+    if (scan->dest == DEST_ID || scan->dest == DEST_CODE) {
+        scalar_done(scan);
+    }
+    scan->dest = DEST_NONE;
+    value_done(scan);
+}
+
+static void unicode_done(JsonScan *scan) {
+    unsigned cp = scan->codepoint;
+    
+    if (cp >= 0xd800 && cp <= 0xdbff) {
+        if (scan->high_surrogate) emit_codepoint(scan, 0xfffd);
+        scan->high_surrogate = cp;
+        return;
+    }
+    if (cp >= 0xdc00 && cp <= 0xdfff) {
+        if (scan->high_surrogate) {
+            cp = 0x10000 + ((scan->high_surrogate - 0xd800) << 10) + (cp - 0xdc00);
+        } else {
+            cp = 0xfffd;
+        }
+        scan->high_surrogate = 0;
+    } else if (scan->high_surrogate) {
+        emit_codepoint(scan, 0xfffd);
+        scan->high_surrogate = 0;
+    }
+    emit_codepoint(scan, cp);
+}
+
+static int begin_value(JsonScan *scan, char c) {
+    switch (c) {
+        case '{':
+            return open_container(scan, T_OBJECT);
+        case '[':
+            return open_container(scan, T_ARRAY);
+        case '"':
+            scan->dest = scalar_dest(top(scan), 1);
+            scan->state = ST_STRING;
+            return 0;
+        default:
+            if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+                scan->dest = scalar_dest(top(scan), 0);
+                scan->scalar_len = 0;
+                emit_chars(scan, &c, 1);
+                scan->state = ST_SCALAR;
+                return 0;
+            }
+            return -1;
+    }
+}
+
+int json_scan_set_reply(JsonScan *scan, const JsonScanReply *reply) {
+    scan->text_len = scan->message_len = 0;
+    if (append(scan->arena, &scan->text, &scan->text_len, &scan->text_cap, reply->text, reply->text_len) != 0 ||
+        append(scan->arena, &scan->message, &scan->message_len, &scan->message_cap, reply->message,
+               reply->message_len) != 0) {
+        scan->failed = 1;
+        return -1;
+    }
+    scan->reply = *reply;
+    scan->reply.text = scan->text;
+    scan->reply.message = scan->message;
+    scan->complete = 1;
+    if (scan->on_reply) scan->on_reply(scan->userdata, &scan->reply);
+    return 0;
+}
+
+int json_scan_feed(JsonScan *scan, const char *bytes, size_t len) {
+    size_t i = 0;
+    
+    if (scan->failed) return -1;
+    
+    while (i < len) {
+        char c = bytes[i];
+        
+        if (scan->state == ST_STRING) {
+            // Copy the run up to the next quote, escape or control byte at once
+            size_t run = i;
+            while (run < len && bytes[run] != '"' && bytes[run] != '\\' && (unsigned char)bytes[run] >= 0x20) run++;
+            if (run > i) {
+                if (scan->high_surrogate) {
+                    emit_codepoint(scan, 0xfffd);
+                    scan->high_surrogate = 0;
+                }
+                emit_chars(scan, bytes + i, run - i);
+                i = run;
+                continue;
+            }
+            if (c == '"') string_done(scan);
+            else if (c == '\\') scan->state = ST_ESCAPE;
+            else goto fail;
+            i++;
+            continue;
+        }
+        
+        switch (scan->state) {
+            case ST_ESCAPE: {
+                char out;
+                switch (c) {
+                    case '"': out = '"'; break;
+                    case '\\': out = '\\'; break;
+                    case '/': out = '/'; break;
+                    case 'b': out = '\b'; break;
+                    case 'f': out = '\f'; break;
+                    case 'n': out = '\n'; break;
+                    case 'r': out = '\r'; break;
+                    case 't': out = '\t'; break;
+                    case 'u':
+                        scan->codepoint = 0;
+                        scan->hex_left = 4;
+                        scan->state = ST_UNICODE;
+                        i++;
+                        continue;
+                    default:
+                        goto fail;
+                }
+                if (scan->high_surrogate) {
+                    emit_codepoint(scan, 0xfffd);
+                    scan->high_surrogate = 0;
+                }
+                emit_chars(scan, &out, 1);
+                scan->state = ST_STRING;
+                break;
+            }
+            case ST_UNICODE: {
+                int h = hex_value(c);
+                if (h < 0) goto fail;
+                scan->codepoint = (scan->codepoint << 4) | (unsigned)h;
+                if (--scan->hex_left == 0) {
+                    unicode_done(scan);
+                    scan->state = ST_STRING;
+                }
+                break;
+            }
+            case ST_SCALAR:
+                if (is_space(c) || c == ',' || c == '}' || c == ']') {
+                    scalar_done(scan);
+                    value_done(scan);
+                    continue;       // the delimiter is handled in the new state
+                }
+                emit_chars(scan, &c, 1);
+                break;
+            case ST_VALUE:
+                if (is_space(c)) break;
+                if (c == ']') {
+                    JsonScanFrame *frame = top(scan);
+                    if (!frame || frame->type != T_ARRAY || frame->index != 0) goto fail;
+                    if (close_container(scan, T_ARRAY) != 0) goto fail;
+                    break;
+                }
+                if (begin_value(scan, c) != 0) goto fail;
+                break;
+            case ST_KEY_OR_END:
+                if (is_space(c)) break;
+                if (c == '}') {
+                    if (close_container(scan, T_OBJECT) != 0) goto fail;
+                    break;
+                }
+                // fall through
+            case ST_KEY:
+                if (is_space(c)) break;
+                if (c != '"') goto fail;
+                scan->dest = DEST_KEY;
+                scan->key_len = 0;
+                scan->state = ST_STRING;
+                break;
+            case ST_COLON:
+                if (is_space(c)) break;
+                if (c != ':') goto fail;
+                scan->state = ST_VALUE;
+                break;
+            case ST_AFTER:
+                if (is_space(c)) break;
+                if (c == ',') {
+                    scan->state = top(scan)->type == T_OBJECT ? ST_KEY : ST_VALUE;
+                } else if (c == '}' || c == ']') {
+                    if (close_container(scan, c == '}' ? T_OBJECT : T_ARRAY) != 0) goto fail;
+                } else {
+                    goto fail;
+                }
+                break;
+            case ST_END:
+                if (!is_space(c)) goto fail;
+                break;
+        }
+        i++;
+    }
+
+    flush_text(scan);
+    return 0;
+
+fail:
+    scan->failed = 1;
+    return -1;
+}
+
+static size_t skip_space(const char *json, size_t i, size_t len) {
+    while (i < len && is_space(json[i])) i++;
+    return i;
+}
+
+// Index just past the string that opens at json[i], or 0 if unterminated
+static size_t skip_string(const char *json, size_t i, size_t len) {
+    for (i++; i < len; i++) {
+        if (json[i] == '\\') i++;
+        else if (json[i] == '"') return i + 1;
+    }
+    return 0;
+}
+
+// Index just past the value that starts at json[i], or 0 if malformed
+static size_t skip_value(const char *json, size_t i, size_t len) {
+    int depth = 0;
+
+    if (i >= len) return 0;
+    if (json[i] == '"') return skip_string(json, i, len);
+    if (json[i] != '{' && json[i] != '[') {
+        size_t start = i;
+        while (i < len && !is_space(json[i]) && json[i] != ',' && json[i] != '}' && json[i] != ']') i++;
+        return i > start ? i : 0;
+    }
+    for (; i < len; i++) {
+        if (json[i] == '"') {
+            if (!(i = skip_string(json, i, len))) return 0;
+            i--;
+        } else if (json[i] == '{' || json[i] == '[') {
+            depth++;
+        } else if ((json[i] == '}' || json[i] == ']') && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+int json_each_member(const char *json, size_t len, JsonMember fn, void *userdata) {
+    size_t i = skip_space(json, 0, len);
+
+    if (i == len || json[i] != '{') return -1;
+    i = skip_space(json, i + 1, len);
+    if (i < len && json[i] == '}') return 0;
+
+    while (i < len && json[i] == '"') {
+        size_t key_end = skip_string(json, i, len);
+        if (!key_end) return -1;
+        size_t colon = skip_space(json, key_end, len);
+        if (colon == len || json[colon] != ':') return -1;
+        size_t value = skip_space(json, colon + 1, len);
+        size_t value_end = skip_value(json, value, len);
+        if (!value_end) return -1;
+
+        fn(userdata, json + i + 1, key_end - i - 2, json + value, value_end - value);
+
+        i = skip_space(json, value_end, len);
+        if (i < len && json[i] == '}') return 0;
+        if (i == len || json[i] != ',') return -1;
+        i = skip_space(json, i + 1, len);
+    }
+    return -1;
+}
+
+int json_each_element(const char *json, size_t len, JsonElement fn, void *userdata) {
+    size_t i = skip_space(json, 0, len);
+    
+    if (i == len || json[i] != '[') return -1;
+    i = skip_space(json, i + 1, len);
+    if (i < len && json[i] == ']') return 0;
+    
+    while (i < len) {
+        size_t value_end = skip_value(json, i, len);
+        if (!value_end) return -1;
+        
+        fn(userdata, json + i, value_end - i);
+        
+        i = skip_space(json, value_end, len);
+        if (i < len && json[i] == ']') return 0;
+        if (i == len || json[i] != ',') return -1;
+        i = skip_space(json, i + 1, len);
+    }
+    return -1;
+}
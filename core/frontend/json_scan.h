@@ -0,0 +1,90 @@
+#ifndef PHASE3_JSON_SCAN_H
+#define PHASE3_JSON_SCAN_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Incremental JSON-RPC reply scanner. Bytes are fed as they arrive from the
+// network; the scanner tracks just enough structure to pull out id,
+// error.code, error.message and result.content[0].text (or a streaming
+// "delta") without building an object tree. A top-level array is treated as
+// a batch and reported one reply at a time.
+#define JSON_SCAN_DEPTH 64
+
+typedef struct {
+    int has_id;
+    long id;
+    int has_error;
+    long error_code;
+    const char *text;       // unescaped UTF-8, NUL terminated
+    size_t text_len;
+    const char *message;
+    size_t message_len;
+} JsonScanReply;
+
+// on_text receives text as it is decoded; when set, text is not kept in the
+// reply. on_reply fires as each reply object closes.
+typedef void (*JsonScanText)(void *userdata, const char *text, size_t len);
+typedef void (*JsonScanDone)(void *userdata, const JsonScanReply *reply);
+
+typedef struct {
+    unsigned char type;
+    unsigned char role;
+    unsigned char key;
+    size_t index;
+} JsonScanFrame;
+
+typedef struct {
+    JsonScanReply reply;
+    int complete;           // the top-level value has been closed
+    int failed;             // not well-formed JSON
+    
+    JsonScanText on_text;
+    JsonScanDone on_reply;
+    void *userdata;
+    
+    int state;
+    int dest;
+    JsonScanFrame stack[JSON_SCAN_DEPTH];
+    int depth;
+    char key[16];
+    size_t key_len;
+    char scalar[32];
+    size_t scalar_len;
+    unsigned codepoint;
+    unsigned high_surrogate;
+    int hex_left;
+    char *text;
+    size_t text_len, text_cap;
+    char *message;
+    size_t message_len, message_cap;
+    Arena *arena;           // NULL: text and message are on the heap
+} JsonScan;
+
+// Reset for a new document; hooks are cleared, buffers and arena are kept
+void json_scan_init(JsonScan *scan);
+void json_scan_free(JsonScan *scan);
+
+// Take text and message from arena from now on. The old buffers are
+// forgotten, not freed, so call this again after each arena_reset.
+void json_scan_use_arena(JsonScan *scan, Arena *arena);
+
+// Returns -1 once the input is known not to be well-formed JSON
+int json_scan_feed(JsonScan *scan, const char *bytes, size_t len);
+
+// Take a reply decoded from another encoding (a CBOR body) as if it had just
+// been scanned: text and message are copied into the scanner's buffers, the
+// document is marked complete and on_reply fires
+int json_scan_set_reply(JsonScan *scan, const JsonScanReply *reply);
+
+// Walk the top-level members of one complete JSON object, handing each key
+// (as written, without quotes) and the raw text of its value to fn. Returns
+// -1 if json is not a well-formed object.
+typedef void (*JsonMember)(void *userdata, const char *key, size_t key_len, const char *value, size_t value_len);
+int json_each_member(const char *json, size_t len, JsonMember fn, void *userdata);
+
+// The same for the elements of one complete JSON array
+typedef void (*JsonElement)(void *userdata, const char *value, size_t value_len);
+int json_each_element(const char *json, size_t len, JsonElement fn, void *userdata);
+
+#endif
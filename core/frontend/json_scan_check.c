@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <string.h>
+#include "json_scan.h"
+
+// make check: every reply is fed whole, byte by byte and split in two at
+// every offset, and each way must give the same fields as written below.
+// Malformed input must fail however it is cut.
+
+typedef struct {
+    const char *name;
+    const char *json;
+    int ok;                 // 0: json_scan_feed must return -1
+    int complete;
+    int has_id;
+    long id;
+    int has_error;
+    long error_code;
+    const char *text;
+    const char *message;
+    int replies;            // on_reply calls
+} ScanCase;
+
+static const ScanCase scan_cases[] = {
+    { "result text", "{\"jsonrpc\":\"2.0\",\"id\":7,\"result\":{\"content\":[{\"type\":\"text\",\"text\":\"hello\"}]}}",
+      1, 1, 1, 7, 0, 0, "hello", "", 1 },
+    { "first item only", "{\"id\":1,\"result\":{\"content\":[{\"text\":\"a\"},{\"text\":\"b\"}]}}",
+      1, 1, 1, 1, 0, 0, "a", "", 1 },
+    { "text outside content", "{\"id\":2,\"result\":{\"text\":\"no\",\"content\":[]},\"text\":\"no\"}",
+      1, 1, 1, 2, 0, 0, "", "", 1 },
+    { "escapes", "{\"id\":3,\"result\":{\"content\":[{\"text\":\"q\\\" b\\\\ s\\/ \\b\\f\\n\\r\\t\"}]}}",
+      1, 1, 1, 3, 0, 0, "q\" b\\ s/ \b\f\n\r\t", "", 1 },
+    { "unicode", "{\"result\":{\"content\":[{\"text\":\"\\u00e9\\u20AC\\u0041\"}]}}",
+      1, 1, 0, 0, 0, 0, "\xc3\xa9\xe2\x82\xac" "A", "", 1 },
+    { "surrogate pair", "{\"result\":{\"content\":[{\"text\":\"\\ud83d\\ude00!\"}]}}",
+      1, 1, 0, 0, 0, 0, "\xf0\x9f\x98\x80!", "", 1 },
+    { "lone high surrogate", "{\"result\":{\"content\":[{\"text\":\"\\ud83dx\"}]}}",
+      1, 1, 0, 0, 0, 0, "\xef\xbf\xbdx", "", 1 },
+    { "high surrogate at end", "{\"result\":{\"content\":[{\"text\":\"a\\ud83d\"}]}}",
+      1, 1, 0, 0, 0, 0, "a\xef\xbf\xbd", "", 1 },
+    { "two high surrogates", "{\"result\":{\"content\":[{\"text\":\"\\ud83d\\ud83d\\ude00\"}]}}",
+      1, 1, 0, 0, 0, 0, "\xef\xbf\xbd\xf0\x9f\x98\x80", "", 1 },
+    { "lone low surrogate", "{\"result\":{\"content\":[{\"text\":\"\\ude00\"}]}}",
+      1, 1, 0, 0, 0, 0, "\xef\xbf\xbd", "", 1 },
+    { "high surrogate then escape", "{\"result\":{\"content\":[{\"text\":\"\\ud83d\\n\"}]}}",
+      1, 1, 0, 0, 0, 0, "\xef\xbf\xbd\n", "", 1 },
+    { "error reply", "{\"jsonrpc\":\"2.0\",\"id\":12,\"error\":{\"code\":-32601,\"message\":\"Unknown \\\"x\\\"\"}}",
+      1, 1, 1, 12, 1, -32601, "", "Unknown \"x\"", 1 },
+    { "error with data", "{\"error\":{\"data\":{\"code\":1,\"message\":\"no\"},\"code\":-1,\"message\":\"m\"},\"id\":4}",
+      1, 1, 1, 4, 1, -1, "", "m", 1 },
+    { "null id", "{\"id\":null,\"result\":{\"content\":[{\"text\":\"t\"}]}}",
+      1, 1, 0, 0, 0, 0, "t", "", 1 },
+    { "nested id ignored", "{\"result\":{\"id\":9,\"content\":[{\"id\":8,\"text\":\"t\"}]}}",
+      1, 1, 0, 0, 0, 0, "t", "", 1 },
+    { "delta frame", "{\"delta\":\"tok \"}", 1, 1, 0, 0, 0, 0, "tok ", "", 1 },
+    { "whitespace", " \r\n{ \"id\" : 5 ,\t\"result\" : { \"content\" : [ { \"text\" : \"w\" } ] } }\n ",
+      1, 1, 1, 5, 0, 0, "w", "", 1 },
+    { "batch", "[{\"id\":1,\"result\":{\"content\":[{\"text\":\"a\"}]}},{\"id\":2,\"error\":{\"code\":3,\"message\":\"e\"}}]",
+      1, 1, 1, 2, 1, 3, "", "e", 2 },
+    { "empty batch", "[]", 1, 1, 0, 0, 0, 0, "", "", 0 },
+    { "truncated", "{\"id\":1,\"result\":{\"content\":[{\"text\":\"par", 1, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "missing colon", "{\"id\" 1}", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "missing value", "{\"id\":}", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "bare key", "{id:1}", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "trailing comma", "[1,]", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "mismatched close", "{\"a\":[1}", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "bad escape", "{\"text\":\"\\x\"}", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "bad unicode", "{\"text\":\"\\u12g4\"}", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "control byte", "{\"text\":\"a\nb\"}", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "trailing data", "{\"id\":1} {", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+    { "not json", "Internal Server Error", 0, 0, 0, 0, 0, 0, NULL, NULL, 0 },
+};
+
+typedef struct {
+    char text[256];
+    size_t text_len;
+    int replies;
+} ScanSeen;
+
+static void seen_text(void *userdata, const char *text, size_t len) {
+    ScanSeen *seen = userdata;
+    
+    if (seen->text_len + len < sizeof(seen->text)) memcpy(seen->text + seen->text_len, text, len);
+    seen->text_len += len;
+}
+
+static void seen_reply(void *userdata, const JsonScanReply *reply) {
+    (void)reply;
+    ((ScanSeen *)userdata)->replies++;
+}
+
+static int failures;
+static long checks;
+
+static void fail(const ScanCase *c, const char *how, size_t cut, const char *what) {
+    fprintf(stderr, "json_scan: %s (%s, cut at %zu): %s\n", c->name, how, cut, what);
+    failures++;
+}
+
+// Feed json in pieces of at most step bytes after a first piece of cut
+// bytes; step 0 sends the rest in one piece
+static void run(JsonScan *scan, const ScanCase *c, const char *how, size_t cut, size_t step, int streamed) {
+    const char *json = c->json;
+    size_t len = strlen(json);
+    ScanSeen seen;
+    int status = 0;
+    
+    memset(&seen, 0, sizeof(seen));
+    json_scan_init(scan);
+    scan->on_reply = seen_reply;
+    scan->userdata = &seen;
+    if (streamed) scan->on_text = seen_text;
+    
+    status |= json_scan_feed(scan, json, cut);
+    for (size_t at = cut; at < len;) {
+        size_t n = step && len - at > step ? step : len - at;
+        status |= json_scan_feed(scan, json + at, n);
+        at += n;
+    }
+    checks++;
+    
+    if (!c->ok) {
+        if (status == 0) fail(c, how, cut, "malformed input accepted");
+        return;
+    }
+    if (status != 0) {
+        fail(c, how, cut, "rejected");
+        return;
+    }
+    if (scan->complete != c->complete) fail(c, how, cut, "complete");
+    if (!c->complete) return;
+    
+    const JsonScanReply *reply = &scan->reply;
+    const char *text = streamed ? seen.text : reply->text;
+    size_t text_len = streamed ? seen.text_len : reply->text_len;
+    if (seen.replies != c->replies) fail(c, how, cut, "number of replies");
+    if (c->replies == 0) return;
+    if (reply->has_id != c->has_id || (c->has_id && reply->id != c->id)) fail(c, how, cut, "id");
+    if (reply->has_error != c->has_error || reply->error_code != c->error_code) fail(c, how, cut, "error");
+    // With on_text, a batch hands over the text of every reply
+    if (!(streamed && c->replies > 1) && (text_len != strlen(c->text) || memcmp(text, c->text, text_len) != 0)) {
+        fail(c, how, cut, "text");
+    }
+    if (reply->message_len != strlen(c->message) || strcmp(reply->message, c->message) != 0) {
+        fail(c, how, cut, "message");
+    }
+}
+
+static void check_scan(void) {
+    JsonScan scan;
+    
+    memset(&scan, 0, sizeof(scan));
+    for (size_t i = 0; i < sizeof(scan_cases) / sizeof(scan_cases[0]); i++) {
+        const ScanCase *c = &scan_cases[i];
+        size_t len = strlen(c->json);
+        for (int streamed = 0; streamed < 2; streamed++) {
+            const char *how = streamed ? "on_text" : "kept";
+            run(&scan, c, how, len, 0, streamed);
+            run(&scan, c, how, 0, 1, streamed);
+            for (size_t cut = 1; cut < len; cut++) run(&scan, c, how, cut, 0, streamed);
+        }
+    }
+    
+    // The same through an arena, as the client runs it
+    Arena arena;
+    memset(&arena, 0, sizeof(arena));
+    for (size_t i = 0; i < sizeof(scan_cases) / sizeof(scan_cases[0]); i++) {
+        arena_reset(&arena);
+        json_scan_use_arena(&scan, &arena);
+        run(&scan, &scan_cases[i], "arena", 0, 1, 0);
+    }
+    json_scan_free(&scan);
+    arena_free(&arena);
+}
+
+typedef struct {
+    char out[256];
+    size_t len;
+} Walk;
+
+static void walk_add(Walk *walk, const char *part, size_t len) {
+    if (walk->len + len + 1 < sizeof(walk->out)) {
+        memcpy(walk->out + walk->len, part, len);
+        walk->len += len;
+        walk->out[walk->len++] = '|';
+        walk->out[walk->len] = 0;
+    }
+}
+
+static void walk_member(void *userdata, const char *key, size_t key_len, const char *value, size_t value_len) {
+    walk_add(userdata, key, key_len);
+    walk_add(userdata, value, value_len);
+}
+
+static void walk_element(void *userdata, const char *value, size_t value_len) {
+    walk_add(userdata, value, value_len);
+}
+
+// expect is every key and value (or element) followed by "|"; NULL when the
+// walk must return -1
+static void check_walk(int members, const char *json, const char *expect) {
+    Walk walk;
+    
+    memset(&walk, 0, sizeof(walk));
+    int status = members ? json_each_member(json, strlen(json), walk_member, &walk) :
+                 json_each_element(json, strlen(json), walk_element, &walk);
+    checks++;
+    if (!expect && status == 0) {
+        fprintf(stderr, "json_each_%s: %s accepted\n", members ? "member" : "element", json);
+        failures++;
+    } else if (expect && (status != 0 || strcmp(walk.out, expect) != 0)) {
+        fprintf(stderr, "json_each_%s: %s gave %d \"%s\", not \"%s\"\n", members ? "member" : "element", json,
+                status, walk.out, expect);
+        failures++;
+    }
+}
+
+static void check_walks(void) {
+    check_walk(1, "{}", "");
+    check_walk(1, " { \"a\" : 1 , \"b\":\"x,}\\\"\" } ", "a|1|b|\"x,}\\\"\"|");
+    check_walk(1, "{\"o\":{\"p\":[1,{\"q\":\"]\"}]},\"t\":true,\"n\":null}", "o|{\"p\":[1,{\"q\":\"]\"}]}|t|true|n|null|");
+    check_walk(1, "{\"k\\\"\":-1.5e3}", "k\\\"|-1.5e3|");
+    check_walk(1, "{not json}", NULL);
+    check_walk(1, "{\"a\" 1}", NULL);
+    check_walk(1, "{\"a\":1,}", NULL);
+    check_walk(1, "{\"a\":1", NULL);
+    check_walk(1, "{\"a\":\"open}", NULL);
+    check_walk(1, "{\"a\":[1,2}", NULL);
+    check_walk(1, "[1]", NULL);
+    check_walk(1, "", NULL);
+    check_walk(0, "[]", "");
+    check_walk(0, "[1, \"a]\", {\"b\":[2]}, [3]]", "1|\"a]\"|{\"b\":[2]}|[3]|");
+    check_walk(0, "[1,]", NULL);
+    check_walk(0, "[1 2]", NULL);
+    check_walk(0, "[\"a\"", NULL);
+    check_walk(0, "{}", NULL);
+}
+
+int main(void) {
+    check_scan();
+    check_walks();
+    if (failures > 0) {
+        fprintf(stderr, "%d of %ld checks failed\n", failures, checks);
+        return 1;
+    }
+    printf("json_scan: %ld checks passed\n", checks);
+    return 0;
+}
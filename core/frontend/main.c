@@ -1,79 +1,939 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <curl/curl.h>
-#include <json-c/json.h>
+#include "cbor.h"
+#include "mcp_client.h"
+#include "metrics.h"
+#include "pool.h"
+#include "prefix.h"
+#include "record.h"
+#include "stats.h"
+#include "telemetry.h"
+
+#define INPUT_CHUNK 1024
+#define BATCH_DEFAULT_INFLIGHT 8
+#define WATCH_MAX_FIELDS 32
+#define WATCH_INTERVAL_S 1.0
+
+// --startup-report: where a cold start went, on stderr at exit. CPU time
+// already used at main() is what the dynamic loader and the libraries'
+// constructors cost before any of our code ran.
+typedef struct {
+    int enabled;
+    double main_ms;
+    double loader_cpu_ms;
+    double ready_ms;        // options parsed and client configured
+    double first_reply_ms;  // 0 until a call finishes
+} StartupReport;
+
+static StartupReport startup;
+
+static void startup_begin(void) {
+    struct timespec cpu;
+    
+    startup.main_ms = mcp_now_ms();
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu) == 0) {
+        startup.loader_cpu_ms = cpu.tv_sec * 1000.0 + cpu.tv_nsec / 1e6;
+    }
+}
+
+static void startup_reply(void) {
+    if (startup.first_reply_ms == 0) startup.first_reply_ms = mcp_now_ms();
+}
+
+static void startup_print(const McpClient *client) {
+    if (!startup.enabled) return;
+    fprintf(stderr, "Startup: %.3f ms CPU before main, ready at %.3f ms, libcurl init %.3f ms", startup.loader_cpu_ms,
+            startup.ready_ms - startup.main_ms, client->curl_init_ms);
+    if (startup.first_reply_ms > 0) fprintf(stderr, ", first reply at %.3f ms", startup.first_reply_ms - startup.main_ms);
+    fprintf(stderr, ", exit at %.3f ms\n", mcp_now_ms() - startup.main_ms);
+}
+
+void print_client_stats(const McpClient *client) {
+    char transport[256];
+    
+    mcp_client_describe_transport(client, transport, sizeof(transport));
+    printf("Transport: %s\n", transport);
+    if (client->hedge_percentile > 0) {
+        printf("Hedged reads: %ld sent, %ld answered first (past p%g)\n", client->hedges, client->hedge_wins,
+               client->hedge_percentile * 100);
+    }
+    for (size_t i = 0; i < client->balancer.count; i++) {
+        const McpEndpoint *endpoint = &client->balancer.endpoints[i];
+        if (client->balancer.count == 1 && endpoint->backoffs == 0 && endpoint->ejections == 0) break;
+        printf("Endpoint %s: %ld calls, %ld failed, %zu outstanding, ewma %.1f ms, %ld backoffs, %ld ejections%s\n",
+               endpoint->url, endpoint->calls, endpoint->failures, endpoint->outstanding, endpoint->ewma_ms,
+               endpoint->backoffs, endpoint->ejections,
+               endpoint_available(endpoint, mcp_now_ms()) ? "" : " (unavailable)");
+    }
+    if (client->cache.enabled) {
+        printf("Cache: %ld hits, %ld misses, %ld revalidated, %ld invalidations, %zu entries\n",
+               client->cache.hits, client->cache.misses, client->cache.revalidated,
+               client->cache.invalidations, client->cache.count);
+    }
+    printf("Calls: %ld\n", client->calls);
+    printf("Reconnects: %ld\n", client->reconnects);
+    printf("Reused: %ld\n", client->calls - client->reconnects);
+    if (client->calls > 0) {
+        const McpTiming *t = &client->last_timing;
+        printf("Last call: %s\n", client->last_reused ? "reused connection" : "reconnected");
+        printf("Last timing (ms): connect %.3f, pretransfer %.3f, starttransfer %.3f, total %.3f, "
+               "serialize %.3f, parse %.3f\n", t->connect_ms, t->pretransfer_ms, t->starttransfer_ms,
+               t->total_ms, t->serialize_ms, t->parse_ms);
+        printf("Last size: %llu bytes on the wire, %llu decoded, %llu in the call arena\n",
+               (unsigned long long)t->wire_bytes, (unsigned long long)t->body_bytes,
+               (unsigned long long)t->arena_bytes);
+        if (t->device.samples > 0) {
+            printf("Last device: ");
+            device_print(&t->device, stdout);
+            printf("\n");
+        }
+        long spills = 0;
+        size_t peak = mcp_client_arena_peak(client, &spills);
+        printf("Arena: %zu bytes peak per call, %ld spills\n", peak, spills);
+    }
+}
+
+// Result text of a reply, its JSON-RPC error, or the raw body when it has
+// neither (not JSON, or a result without text content), CBOR shown as JSON
+static void print_reply(const char *label, const McpReply *reply) {
+    if (reply->is_error && (reply->error_code != 0 || reply->message.size > 0)) {
+        printf("%s: Error %ld: %.*s\n", label, reply->error_code,
+               (int)reply->message.size, reply->message.data);
+    } else if (!reply->is_error && reply->text.size > 0) {
+        printf("%s: %.*s\n", label, (int)reply->text.size, reply->text.data);
+    } else if (reply->cbor) {
+        printf("%s: ", label);
+        if (cbor_write_json(stdout, (const unsigned char *)reply->body.data, reply->body.size) != 0) {
+            printf("(%zu bytes of malformed CBOR)", reply->body.size);
+        }
+        printf("\n");
+    } else {
+        printf("%s: %.*s\n", label, (int)reply->body.size, reply->body.data);
+    }
+}
+
+// "Status (1.2 ms)", "Status (cached)" and so on, for a finished call
+static void describe_call(const McpCall *call, const char *prefix, char *label, size_t cap) {
+    if (call->reply.cached && call->end_ms == call->start_ms) {
+        snprintf(label, cap, "%s%s (cached)", prefix, call->label);
+    } else {
+        snprintf(label, cap, "%s%s (%.1f ms%s)", prefix, call->label, call->end_ms - call->start_ms,
+                 call->reply.cached ? ", not modified" : "");
+    }
+}
+
+// Stdin is read with read(2) into this buffer rather than through stdio, so
+// poll() on the descriptor always agrees with what is left to parse. The
+// buffer grows to the longest line seen.
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    char *line;             // last line taken; valid until the next one
+    size_t line_cap;
+    int eof;
+} Input;
+
+static void input_fill(Input *in) {
+    if (in->len == in->cap) {
+        size_t cap = in->cap ? in->cap * 2 : INPUT_CHUNK;
+        char *buf = realloc(in->buf, cap);
+        // Out of memory: stop reading rather than cut the line
+        if (!buf) {
+            in->eof = 1;
+            return;
+        }
+        in->buf = buf;
+        in->cap = cap;
+    }
+    ssize_t n = read(STDIN_FILENO, in->buf + in->len, in->cap - in->len);
+    if (n > 0) in->len += (size_t)n;
+    else if (n == 0) in->eof = 1;
+}
 
-#define MAX_RESPONSE 4096
-#define MAX_INPUT 1024
+// Take the next complete line, without its newline, or NULL if no line is
+// ready yet
+static char *input_line(Input *in) {
+    char *nl = in->len ? memchr(in->buf, '\n', in->len) : NULL;
+    size_t n;
+    
+    if (nl) n = (size_t)(nl - in->buf) + 1;
+    else if (in->eof && in->len > 0) n = in->len;
+    else return NULL;
+    
+    if (n + 1 > in->line_cap) {
+        char *line = realloc(in->line, n + 1);
+        if (!line) return NULL;
+        in->line = line;
+        in->line_cap = n + 1;
+    }
+    memcpy(in->line, in->buf, n);
+    in->line[n] = 0;
+    in->line[strcspn(in->line, "\r\n")] = 0;
+    memmove(in->buf, in->buf + n, in->len - n);
+    in->len -= n;
+    return in->line;
+}
+
+static void input_free(Input *in) {
+    free(in->buf);
+    free(in->line);
+}
+
+// Same views as the dashboard, fetched with one batched POST
+void show_batch_dashboard(McpClient *client) {
+    static const char *labels[] = { "Status", "Config", "Database", "Settings" };
+    McpBatchItem items[] = {
+        { .tool = "get_status", .args = "{}" },
+        { .tool = "get_agent_config", .args = "{}" },
+        { .tool = "db_status", .args = "{}" },
+        { .tool = "get_settings", .args = "{}" },
+    };
+    size_t count = sizeof(items) / sizeof(items[0]);
+    double start = mcp_now_ms();
+    
+    if (call_mcp_batch(client, items, count) != 0) {
+        printf("Error calling batch\n");
+        mcp_batch_release(items, count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!items[i].answered) {
+            printf("%s: no reply\n", labels[i]);
+        } else if (items[i].is_error) {
+            printf("%s: Error %ld: %s\n", labels[i], items[i].error_code, items[i].text ? items[i].text : "");
+        } else {
+            printf("%s: %s\n", labels[i], items[i].text ? items[i].text : "");
+        }
+    }
+    printf("Batch of %zu calls in %.1f ms\n", count, mcp_now_ms() - start);
+    mcp_batch_release(items, count);
+}
+
+// Watch mode: the server pushes a snapshot of the tool's fields once and
+// then only the fields that changed. On a terminal each field keeps its
+// line and only changed lines are redrawn; otherwise changes are logged.
+typedef struct {
+    char name[32];
+    char value[96];
+} WatchField;
 
 typedef struct {
-    char *data;
-    size_t size;
-} Response;
+    const char *tool;
+    WatchField fields[WATCH_MAX_FIELDS];
+    size_t count;
+    int tty;
+    Input *input;           // Enter on this input stops the watch, if set
+    long updates;
+} WatchView;
+
+static void watch_value(WatchField *field, const char *value, size_t len) {
+    // Plain strings are shown without their quotes
+    if (len >= 2 && value[0] == '"' && value[len - 1] == '"') {
+        value++;
+        len -= 2;
+    }
+    if (len == 4 && memcmp(value, "null", 4) == 0) {
+        value = "(removed)";
+        len = 9;
+    }
+    snprintf(field->value, sizeof(field->value), "%.*s", (int)len, value);
+}
+
+static void watch_draw(const WatchView *view, size_t i) {
+    printf("\r\033[K  %-24s %s", view->fields[i].name, view->fields[i].value);
+}
 
-static size_t WriteCallback(void *contents, size_t size, size_t nmemb, Response *response) {
-    size_t realsize = size * nmemb;
-    char *ptr = realloc(response->data, response->size + realsize + 1);
-    if (!ptr) return 0;
+static void watch_member(void *userdata, const char *key, size_t key_len, const char *value, size_t value_len) {
+    WatchView *view = userdata;
+    size_t i;
     
-    response->data = ptr;
-    memcpy(&(response->data[response->size]), contents, realsize);
-    response->size += realsize;
-    response->data[response->size] = 0;
-    return realsize;
+    for (i = 0; i < view->count; i++) {
+        if (strlen(view->fields[i].name) == key_len && memcmp(view->fields[i].name, key, key_len) == 0) break;
+    }
+    if (i == view->count) {
+        if (view->count == WATCH_MAX_FIELDS) return;
+        snprintf(view->fields[i].name, sizeof(view->fields[i].name), "%.*s", (int)key_len, key);
+        view->count++;
+        watch_value(&view->fields[i], value, value_len);
+        if (view->tty) watch_draw(view, i);
+        else printf("%s: %s", view->fields[i].name, view->fields[i].value);
+        printf("\n");
+        return;
+    }
+    
+    watch_value(&view->fields[i], value, value_len);
+    if (view->tty) {
+        // Step up to the field's line, rewrite it and come back down
+        size_t up = view->count - i;
+        printf("\033[%zuA", up);
+        watch_draw(view, i);
+        printf("\033[%zuB\r", up);
+    } else {
+        printf("%s: %s\n", view->fields[i].name, view->fields[i].value);
+    }
+}
+
+static int watch_event(void *userdata, const char *event, const char *data, size_t len) {
+    WatchView *view = userdata;
+    
+    if (strcmp(event, "snapshot") == 0) {
+        view->count = 0;
+        printf("Watching %s%s\n", view->tool, view->input ? " (Enter to stop)" : "");
+    } else if (strcmp(event, "error") == 0) {
+        printf("Watch error: %.*s\n", (int)len, data);
+        fflush(stdout);
+        return 0;
+    } else if (strcmp(event, "delta") != 0) {
+        return 0;
+    }
+    if (json_each_member(data, len, watch_member, view) != 0) {
+        printf("Unexpected watch data: %.*s\n", (int)len, data);
+    }
+    view->updates++;
+    fflush(stdout);
+    return 0;
+}
+
+static int watch_idle(void *userdata) {
+    WatchView *view = userdata;
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    
+    if (!view->input || view->input->eof) return 0;
+    if (poll(&pfd, 1, 0) > 0) input_fill(view->input);
+    return input_line(view->input) != NULL || view->input->eof;
+}
+
+int run_watch(McpClient *client, const char *tool, Input *input) {
+    WatchView view;
+    
+    memset(&view, 0, sizeof(view));
+    view.tool = tool;
+    view.tty = isatty(STDOUT_FILENO);
+    view.input = input;
+    
+    if (mcp_watch(client, tool, WATCH_INTERVAL_S, watch_event, watch_idle, &view) != 0) {
+        printf("Watch of %s failed (server without /mcp/watch?)\n", tool);
+        return 1;
+    }
+    printf("Watch ended after %ld updates\n", view.updates);
+    return 0;
+}
+
+// How every client is set up from the command line: the one main() uses,
+// and each batch worker's
+typedef struct {
+    const char *urls[MCP_MAX_ENDPOINTS];
+    size_t nurls;
+    const char *transport;
+    McpFraming framing;
+    BalancePolicy policy;
+    double deadline_ms, hedge;
+    McpRecorder *recorder;  // NULL unless --record
+    McpTelemetry *telemetry;    // NULL unless --telemetry
+} ClientConfig;
+
+static int setup_client(McpClient *client, void *arg) {
+    const ClientConfig *config = arg;
+    
+    int failed = mcp_client_init(client, config->urls[0]) != 0;
+    for (size_t i = 1; i < config->nurls && !failed; i++) {
+        failed = mcp_client_add_endpoint(client, config->urls[i]) != 0;
+    }
+    if (failed || mcp_client_set_framing(client, config->framing) != 0) {
+        fprintf(stderr, "Failed to initialize MCP client\n");
+        return -1;
+    }
+    if (config->transport && mcp_client_set_transport(client, config->transport) != 0) {
+        fprintf(stderr, "Cannot set up transport %s\n", config->transport);
+        mcp_client_cleanup(client);
+        return -1;
+    }
+    client->balancer.policy = config->policy;
+    client->deadline_ms = config->deadline_ms;
+    client->hedge_percentile = config->hedge / 100.0;
+    client->recorder = config->recorder;
+    client->telemetry = config->telemetry;
+    return 0;
+}
+
+// Batch mode: newline-delimited "tool {json args}" on input, one NDJSON
+// result per call on stdout in completion order, summary on stderr. With a
+// prefix window, that many lines are read ahead and sent in the order
+// prefix_plan gives them. With workers, calls go through a pool of threads
+// (pool.h) and results come out in the order the lines were sent.
+typedef struct {
+    McpCall call;
+    char *line;
+    size_t line_cap;
+    long seq;
+    long group;
+    size_t shared;
+    char *out;              // pool mode: the result line, formatted by the worker
+    size_t out_len;
+    int ok;
+} BatchSlot;
+
+typedef struct {
+    char *line;
+    size_t line_cap;
+    char *tool;
+    char *args;
+} BatchLine;
+
+typedef struct {
+    FILE *in;
+    BatchSlot slots[MCP_MAX_PARALLEL];
+    size_t nslots;
+    BatchSlot *queued;      // pool mode: POOL_QUEUE_SIZE slots, by seq
+    long seq;
+    long ok, failed;
+    double *latencies;
+    size_t lat_len, lat_cap;
+    BatchLine *window;      // NULL unless scheduling by prompt prefix
+    PrefixItem *plan;
+    size_t window_size, window_len, window_next;
+    PrefixStats prefix;
+} BatchRun;
+
+static BatchSlot *free_batch_slot(BatchRun *run) {
+    for (size_t i = 0; i < run->nslots; i++) {
+        if (run->slots[i].seq == 0) return &run->slots[i];
+    }
+    return NULL;
+}
+
+// Next call line into line, split in place into tool and args; -1 at the end
+static int read_batch_line(FILE *in, BatchLine *line) {
+    while (getline(&line->line, &line->line_cap, in) >= 0) {
+        char *tool = line->line;
+        while (isspace((unsigned char)*tool)) tool++;
+        if (*tool == 0 || *tool == '#') continue;
+        
+        char *end = tool;
+        while (*end && !isspace((unsigned char)*end)) end++;
+        char *args = end;
+        if (*args) *args++ = 0;
+        while (isspace((unsigned char)*args)) args++;
+        size_t args_len = strlen(args);
+        while (args_len > 0 && isspace((unsigned char)args[args_len - 1])) args[--args_len] = 0;
+        
+        line->tool = tool;
+        line->args = args_len > 0 ? args : "{}";
+        return 0;
+    }
+    return -1;
+}
+
+// Read the next window of lines and plan the order they go out in
+static void fill_window(BatchRun *run) {
+    run->window_len = run->window_next = 0;
+    while (run->window_len < run->window_size && read_batch_line(run->in, &run->window[run->window_len]) == 0) {
+        BatchLine *line = &run->window[run->window_len];
+        PrefixItem *item = &run->plan[run->window_len];
+        memset(item, 0, sizeof(*item));
+        item->index = run->window_len++;
+        if (strcmp(line->tool, "generate") != 0 ||
+            prefix_prompt(line->args, strlen(line->args), &item->prompt, &item->prompt_len) != 0) {
+            item->prompt = NULL;
+        }
+    }
+    if (run->window_len > 0) prefix_plan(run->plan, run->window_len, &run->prefix);
+}
+
+// The next line's call, set up in slot; NULL at the end of the input
+static McpCall *fill_batch_slot(BatchRun *run, BatchSlot *slot) {
+    BatchLine line = { NULL, 0, NULL, NULL };
+    const PrefixItem *item = NULL;
+    
+    if (run->window) {
+        if (run->window_next == run->window_len) fill_window(run);
+        if (run->window_next == run->window_len) return NULL;
+        item = &run->plan[run->window_next++];
+        // The slot takes the line's buffer; tool and args point into it
+        BatchLine *queued = &run->window[item->index];
+        line = *queued;
+        queued->line = slot->line;
+        queued->line_cap = slot->line_cap;
+        slot->line = line.line;
+        slot->line_cap = line.line_cap;
+    } else {
+        line.line = slot->line;
+        line.line_cap = slot->line_cap;
+        int more = read_batch_line(run->in, &line) == 0;
+        // getline may have moved the buffer either way
+        slot->line = line.line;
+        slot->line_cap = line.line_cap;
+        if (!more) return NULL;
+    }
+    
+    memset(&slot->call, 0, sizeof(slot->call));
+    slot->call.tool = line.tool;
+    slot->call.args = line.args;
+    slot->call.context = slot;
+    slot->call.affinity = item ? item->affinity : 0;
+    slot->group = item ? item->group : 0;
+    slot->shared = item ? item->shared : 0;
+    slot->seq = ++run->seq;
+    return &slot->call;
+}
+
+static McpCall *next_batch_call(void *source) {
+    BatchRun *run = source;
+    BatchSlot *slot = free_batch_slot(run);
+    
+    return slot ? fill_batch_slot(run, slot) : NULL;
+}
+
+static void record_latency(BatchRun *run, double ms) {
+    if (run->lat_len == run->lat_cap) {
+        size_t cap = run->lat_cap ? run->lat_cap * 2 : 1024;
+        double *ptr = realloc(run->latencies, cap * sizeof(double));
+        if (!ptr) return;
+        run->latencies = ptr;
+        run->lat_cap = cap;
+    }
+    run->latencies[run->lat_len++] = ms;
+}
+
+// One NDJSON result line; non-zero if the call succeeded
+static int write_batch_result(FILE *out, const McpCall *call, const BatchSlot *slot) {
+    double latency = call->end_ms - call->start_ms;
+    int ok = call->res == CURLE_OK && call->http_status >= 200 && call->http_status < 300 &&
+             !call->reply.is_error;
+             
+    fprintf(out, "{\"seq\":%ld,\"tool\":", slot->seq);
+    mcp_write_json_string(out, call->tool, strlen(call->tool));
+    fprintf(out, ",\"ok\":%s,\"status\":%ld,\"latency_ms\":%.3f,\"reused\":%s",
+            ok ? "true" : "false", call->http_status, latency, call->reused ? "true" : "false");
+    if (slot->group > 0) fprintf(out, ",\"prefix_group\":%ld,\"shared_prefix\":%zu", slot->group, slot->shared);
+    if (call->timing.device.samples > 0) {
+        fprintf(out, ",\"device\":");
+        device_write_json(&call->timing.device, out);
+    }
+    
+    if (call->res != CURLE_OK) {
+        const char *msg = mcp_call_error(call);
+        fprintf(out, ",\"error\":");
+        mcp_write_json_string(out, msg, strlen(msg));
+    } else {
+        const char *body = call->reply.body.data ? call->reply.body.data : "";
+        size_t start = 0;
+        while (start < call->reply.body.size && isspace((unsigned char)body[start])) start++;
+        
+        fprintf(out, ",\"result\":");
+        if (call->reply.cbor) {
+            if (cbor_write_json(out, (const unsigned char *)body, call->reply.body.size) != 0) fprintf(out, "null");
+        } else if (start < call->reply.body.size && (body[start] == '{' || body[start] == '[')) {
+            // Line breaks outside strings are plain whitespace; keep one line per result
+            for (size_t i = start; i < call->reply.body.size; i++) {
+                fputc(body[i] == '\n' || body[i] == '\r' ? ' ' : body[i], out);
+            }
+        } else {
+            mcp_write_json_string(out, body + start, call->reply.body.size - start);
+        }
+    }
+    fprintf(out, "}\n");
+    return ok;
+}
+
+static void count_batch_result(BatchRun *run, const McpCall *call, int ok) {
+    if (ok) run->ok++;
+    else run->failed++;
+    record_latency(run, call->end_ms - call->start_ms);
+}
+
+static void print_batch_result(McpCall *call, void *userdata) {
+    BatchRun *run = userdata;
+    BatchSlot *slot = call->context;
+    
+    startup_reply();
+    count_batch_result(run, call, write_batch_result(stdout, call, slot));
+    slot->seq = 0;
+}
+
+// Runs on the worker, while the reply is still there to format
+static void format_batch_result(McpCall *call, void *userdata) {
+    BatchSlot *slot = call->context;
+    FILE *out = open_memstream(&slot->out, &slot->out_len);
+    
+    (void)userdata;
+    slot->ok = 0;
+    if (!out) {
+        slot->out = NULL;
+        return;
+    }
+    slot->ok = write_batch_result(out, call, slot);
+    if (fclose(out) != 0) {
+        free(slot->out);
+        slot->out = NULL;
+        slot->ok = 0;
+    }
+}
+
+// Lines go to the workers while there is a slot for them; each result is
+// written once every one before it has been
+static void run_batch_pool(BatchRun *run, McpPool *pool) {
+    int more = 1;
+    
+    for (;;) {
+        while (more && pool->submitted - pool->collected < POOL_QUEUE_SIZE) {
+            McpCall *call = fill_batch_slot(run, &run->queued[run->seq % POOL_QUEUE_SIZE]);
+            more = call && pool_submit(pool, call) == 0;
+        }
+        McpCall *call = pool_collect(pool);
+        if (!call) break;
+        
+        BatchSlot *slot = call->context;
+        startup_reply();
+        if (slot->out) fwrite(slot->out, 1, slot->out_len, stdout);
+        count_batch_result(run, call, slot->ok);
+        free(slot->out);
+        slot->out = NULL;
+        slot->seq = 0;
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t idx = (size_t)(p * (n - 1) + 0.5);
+    return sorted[idx];
 }
 
-int call_mcp_tool(const char *tool, const char *args, char *result) {
-    CURL *curl;
-    CURLcode res;
-    Response response = {0};
+// workers > 0 runs the calls on that many threads of inflight calls each,
+// their clients set up from config; the metrics must stop before they go
+int run_batch_mode(McpClient *client, const char *path, size_t inflight, size_t prefix_window, size_t workers,
+                   ClientConfig *config, McpMetrics *metrics) {
+    BatchRun run;
+    McpPool *pool = NULL;
+    double start, elapsed;
     
-    curl = curl_easy_init();
-    if (!curl) return -1;
+    memset(&run, 0, sizeof(run));
+    run.in = (path && strcmp(path, "-") != 0) ? fopen(path, "r") : stdin;
+    if (!run.in) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    run.nslots = (inflight == 0 || inflight > MCP_MAX_PARALLEL) ? MCP_MAX_PARALLEL : inflight;
+    if (prefix_window > 0) {
+        run.window_size = prefix_window < PREFIX_WINDOW_MAX ? prefix_window : PREFIX_WINDOW_MAX;
+        run.window = calloc(run.window_size, sizeof(BatchLine));
+        run.plan = calloc(run.window_size, sizeof(PrefixItem));
+        if (!run.window || !run.plan) {
+            fprintf(stderr, "Cannot allocate a prefix window of %zu lines\n", run.window_size);
+            free(run.window);
+            free(run.plan);
+            if (run.in != stdin) fclose(run.in);
+            return 1;
+        }
+    }
+    
+    if (workers > 0) {
+        pool = malloc(sizeof(McpPool));
+        run.queued = calloc(POOL_QUEUE_SIZE, sizeof(BatchSlot));
+        if (!pool || !run.queued ||
+            pool_start(pool, workers, run.nslots, setup_client, config, format_batch_result, NULL) != 0) {
+            fprintf(stderr, "Cannot start %zu batch workers\n", workers);
+            free(pool);
+            free(run.queued);
+            free(run.window);
+            free(run.plan);
+            if (run.in != stdin) fclose(run.in);
+            return 1;
+        }
+        metrics_track(metrics, pool->clients, pool->nworkers);
+    }
+    
+    start = mcp_now_ms();
+    if (pool) run_batch_pool(&run, pool);
+    else run_mcp_calls(client, next_batch_call, &run, run.nslots, print_batch_result, &run);
+    fflush(stdout);
+    elapsed = mcp_now_ms() - start;
+    
+    qsort(run.latencies, run.lat_len, sizeof(double), compare_double);
+    fprintf(stderr, "Batch: %zu calls (%ld ok, %ld failed) in %.1f ms, %.1f calls/s, inflight %zu",
+            run.lat_len, run.ok, run.failed, elapsed,
+            elapsed > 0 ? run.lat_len * 1000.0 / elapsed : 0.0, run.nslots);
+    if (pool) fprintf(stderr, " on each of %zu workers", pool->nworkers);
+    fputc('\n', stderr);
+    if (run.lat_len > 0) {
+        fprintf(stderr, "Latency ms: min %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f\n",
+                run.latencies[0], percentile(run.latencies, run.lat_len, 0.50),
+                percentile(run.latencies, run.lat_len, 0.90), percentile(run.latencies, run.lat_len, 0.99),
+                run.latencies[run.lat_len - 1]);
+    }
     
-    // Create JSON-RPC request
-    json_object *request = json_object_new_object();
-    json_object *jsonrpc = json_object_new_string("2.0");
-    json_object *method = json_object_new_string("tools/call");
-    json_object *id = json_object_new_int(1);
-    json_object *params = json_object_new_object();
-    json_object *name = json_object_new_string(tool);
-    json_object *arguments = json_tokener_parse(args);
+    if (run.window) {
+        const PrefixStats *prefix = &run.prefix;
+        fprintf(stderr, "Prefixes: %ld prompts in %ld windows, %ld in %ld shared-prefix groups; "
+                "%llu of %llu prompt bytes (%.1f%%) shared with the prompt sent before\n",
+                prefix->prompts, prefix->windows, prefix->grouped, prefix->groups, prefix->shared_bytes,
+                prefix->prompt_bytes,
+                prefix->prompt_bytes ? 100.0 * prefix->shared_bytes / prefix->prompt_bytes : 0.0);
+    }
+    
+    if (pool) {
+        // The scrape thread reads the workers' clients until it stops
+        metrics_stop(metrics);
+        pool_stop(pool, client);
+        free(pool);
+        for (size_t i = 0; i < POOL_QUEUE_SIZE; i++) free(run.queued[i].line);
+        free(run.queued);
+    }
+    for (size_t i = 0; i < run.nslots; i++) free(run.slots[i].line);
+    for (size_t i = 0; i < run.window_size; i++) free(run.window[i].line);
+    free(run.window);
+    free(run.plan);
+    free(run.latencies);
+    if (run.in != stdin) fclose(run.in);
+    
+    return run.failed ? 1 : 0;
+}
+
+// Replay mode: the calls of a recording (record.h) sent again on the
+// recorded schedule, speed times as fast (0: as fast as --inflight allows),
+// then each tool's latency set against the recorded latency. Sessions
+// play back to back, each from its first call.
+typedef struct {
+    McpCall call;
+    char *line;
+    size_t line_cap;
+    int busy;
+} ReplaySlot;
+
+typedef struct {
+    FILE *in;
+    ReplaySlot slots[MCP_MAX_PARALLEL];
+    size_t nslots;
+    double speed;
+    RecordEntry next;
+    ReplaySlot *next_slot;  // holds next; NULL while none is read ahead
+    double next_ms;         // when next is due, in recorded time from the start of the replay
+    int ended;
+    int new_session;
+    double session_ms;      // recorded time the current session starts at
+    double last_ms;
+    StatsTable *recorded;
+    long ok, failed;
+    double max_lag_ms;
+} ReplayRun;
+
+static ReplaySlot *free_replay_slot(ReplayRun *run) {
+    for (size_t i = 0; i < run->nslots; i++) {
+        if (!run->slots[i].busy) return &run->slots[i];
+    }
+    return NULL;
+}
+
+// Read ahead the next call, and count its recorded latency
+static void replay_read(ReplayRun *run) {
+    ReplaySlot *slot = free_replay_slot(run);
+    RecordEntry *entry = &run->next;
     
-    json_object_object_add(params, "name", name);
-    json_object_object_add(params, "arguments", arguments);
-    json_object_object_add(request, "jsonrpc", jsonrpc);
-    json_object_object_add(request, "method", method);
-    json_object_object_add(request, "id", id);
-    json_object_object_add(request, "params", params);
+    if (!slot) return;
+    for (;;) {
+        if (record_read(run->in, entry, &slot->line, &slot->line_cap) != 0) {
+            run->ended = 1;
+            return;
+        }
+        if (!entry->session) break;
+        run->new_session = 1;
+    }
+    if (run->new_session) {
+        run->session_ms = run->last_ms - entry->offset_ms;
+        run->new_session = 0;
+    }
+    run->next_ms = run->last_ms = run->session_ms + entry->offset_ms;
+    run->next_slot = slot;
     
-    const char *json_string = json_object_to_json_string(request);
+    ToolStats *tool = stats_tool(run->recorded, entry->tool);
+    tool->calls++;
+    if (entry->failed) tool->errors++;
+    hist_record(&tool->phase[STAT_TOTAL], (uint64_t)(entry->latency_ms * 1000.0 + 0.5));
+}
+
+static void replay_done(McpCall *call, void *userdata) {
+    ReplayRun *run = userdata;
+    ReplaySlot *slot = call->context;
     
-    // Setup curl for local MCP server
-    curl_easy_setopt(curl, CURLOPT_URL, "http://localhost:8080/mcp");
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_string);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    if (call->res == CURLE_OK && call->http_status >= 200 && call->http_status < 300 && !call->reply.is_error) {
+        run->ok++;
+    } else {
+        run->failed++;
+    }
+    slot->busy = 0;
+}
+
+static const ToolStats *find_tool(const StatsTable *table, const char *tool) {
+    for (size_t i = 0; i < table->ntools; i++) {
+        if (strcmp(table->tools[i].tool, tool) == 0) return &table->tools[i];
+    }
+    return NULL;
+}
+
+static void print_change(const char *name, uint64_t was_us, uint64_t now_us) {
+    fprintf(stderr, ", %s %.3f -> %.3f ms", name, was_us / 1000.0, now_us / 1000.0);
+    if (was_us > 0) fprintf(stderr, " (%+.1f%%)", 100.0 * ((double)now_us - (double)was_us) / (double)was_us);
+}
+
+static void print_replay_diff(const StatsTable *recorded, const StatsTable *replayed) {
+    static const Histogram none;
     
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    for (size_t i = 0; i < recorded->ntools; i++) {
+        const ToolStats *was = &recorded->tools[i];
+        const ToolStats *now = find_tool(replayed, was->tool);
+        const Histogram *a = &was->phase[STAT_TOTAL];
+        const Histogram *b = now ? &now->phase[STAT_TOTAL] : &none;
+        fprintf(stderr, "  %s: %ld -> %ld calls, %ld -> %ld errors", was->tool, was->calls, now ? now->calls : 0,
+                was->errors, now ? now->errors : 0);
+        print_change("p50", hist_percentile(a, 0.50), hist_percentile(b, 0.50));
+        print_change("p90", hist_percentile(a, 0.90), hist_percentile(b, 0.90));
+        print_change("p99", hist_percentile(a, 0.99), hist_percentile(b, 0.99));
+        print_change("max", a->max_us, b->max_us);
+        fputc('\n', stderr);
+    }
+}
+
+static int run_replay(McpClient *client, const char *path, double speed, size_t inflight) {
+    ReplayRun run;
     
-    res = curl_easy_perform(curl);
+    memset(&run, 0, sizeof(run));
+    run.in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    run.recorded = calloc(1, sizeof(StatsTable));
+    if (!run.in || !run.recorded) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        if (run.in && run.in != stdin) fclose(run.in);
+        free(run.recorded);
+        return 1;
+    }
+    run.nslots = (inflight == 0 || inflight > MCP_MAX_PARALLEL) ? MCP_MAX_PARALLEL : inflight;
+    run.speed = speed;
+    run.new_session = 1;
     
-    if (res == CURLE_OK && response.data) {
-        strncpy(result, response.data, MAX_RESPONSE - 1);
-        result[MAX_RESPONSE - 1] = '\0';
+    double start = mcp_now_ms();
+    for (;;) {
+        if (!run.next_slot && !run.ended) replay_read(&run);
+        if (!run.next_slot && run.ended && client->inflight == 0) break;
+        
+        double now = mcp_now_ms(), wait_ms = 1000;
+        if (run.next_slot) {
+            double due = speed > 0 ? start + run.next_ms / speed : now;
+            if (now >= due) {
+                // Running late when the server is slower or --inflight is full
+                if (now - due > run.max_lag_ms) run.max_lag_ms = now - due;
+                ReplaySlot *slot = run.next_slot;
+                memset(&slot->call, 0, sizeof(slot->call));
+                slot->call.tool = run.next.tool;
+                slot->call.args = run.next.args;
+                slot->call.context = slot;
+                slot->busy = 1;
+                run.next_slot = NULL;
+                mcp_call_start(client, &slot->call, replay_done, &run);
+                continue;
+            }
+            wait_ms = due - now;
+        }
+        if (client->inflight > 0) {
+            if (mcp_call_poll(client, NULL, 0, (int)wait_ms, replay_done, &run) < 0) break;
+        } else {
+            poll(NULL, 0, (int)wait_ms);
+        }
     }
+    double elapsed = mcp_now_ms() - start;
     
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    json_object_put(request);
-    if (response.data) free(response.data);
+    fprintf(stderr, "Replay: %ld calls (%ld ok, %ld failed) in %.1f ms", run.ok + run.failed, run.ok, run.failed,
+            elapsed);
+    if (speed > 0) fprintf(stderr, " at %gx, at most %.1f ms behind schedule\n", speed, run.max_lag_ms);
+    else fprintf(stderr, " as fast as inflight %zu allows\n", run.nslots);
+    fprintf(stderr, "Recorded -> replayed:\n");
+    print_replay_diff(run.recorded, client->stats);
     
-    return (res == CURLE_OK) ? 0 : -1;
+    for (size_t i = 0; i < run.nslots; i++) free(run.slots[i].line);
+    free(run.recorded);
+    if (run.in != stdin) fclose(run.in);
+    return run.failed ? 1 : 0;
+}
+
+// One generate call with its prompt streamed from path, "-" for stdin
+static int run_prompt_file(McpClient *client, const char *path, size_t window) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    
+    if (!in) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    int status = call_mcp_generate_from(client, in, window);
+    if (in != stdin) fclose(in);
+    return status == 0 ? 0 : 1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--url URL]... [--unix [PATH]] [--batch [FILE]] [--inflight N] [--stats-json FILE] [--no-cache]\n"
+           "       [--watch [TOOL]] [--deadline MS] [--hedge PCT] [--balance least|ewma] [--framing json|cbor]\n"
+           "       [--transport SPEC] [--shm [NAME]] [--prefix-window N] [--metrics PORT|unix:PATH]\n"
+           "       [--prompt-file FILE] [--io-window BYTES] [--workers N] [--record FILE]\n"
+           "       [--replay FILE] [--replay-speed X] [--telemetry [MS]] [--startup-report]\n", prog);
+    printf("  --url URL      MCP endpoint (default %s); repeat to balance over several\n", MCP_URL);
+    printf("  --unix [PATH]  connect over a Unix domain socket (default %s)\n", MCP_SOCKET);
+    printf("  --batch [FILE] read \"tool {json}\" lines from FILE or stdin, write NDJSON\n");
+    printf("  --inflight N   concurrent calls in batch mode (default %d, max %d)\n",
+           BATCH_DEFAULT_INFLIGHT, MCP_MAX_PARALLEL);
+    printf("  --workers N    run batch calls on N threads (max %d) of --inflight calls each, with\n"
+           "                 a client apiece; results in input order\n", POOL_MAX_WORKERS);
+    printf("  --prefix-window N  read N batch lines ahead and send generate prompts sharing a prefix\n");
+    printf("                 back to back to one endpoint (max %d)\n", PREFIX_WINDOW_MAX);
+    printf("  --stats-json F write per-tool latency histograms to F as JSON on exit\n");
+    printf("  --no-cache     always fetch read-only views from the server\n");
+    printf("  --watch [TOOL] follow server-pushed changes to TOOL (default get_status)\n");
+    printf("  --deadline MS  give every call MS instead of its tool's default deadline\n");
+    printf("  --hedge PCT    resend read-only calls still running past their tool's PCT percentile\n");
+    printf("  --balance P    spread calls by least outstanding (default) or latency ewma\n");
+    printf("  --framing F    request bodies as json (default) or cbor; streamed generate stays JSON\n");
+    printf("  --transport S  http (default), http2, unix[:PATH], shm[:NAME], stdio:COMMAND or mock\n");
+    printf("                 (canned replies from inside the frontend, for a baseline without a server)\n");
+    printf("  --shm [NAME]   call a same-host server through its shared memory rings (default %s)\n",
+           SHM_RING_NAME);
+    printf("  --prompt-file F  generate from the prompt in F (- for stdin) of any size, streamed\n");
+    printf("                 in and out through a window of --io-window bytes (default %d)\n", MCP_IO_WINDOW);
+    printf("  --record F     append every call sent to F, with its timing, for --replay\n");
+    printf("  --replay F     send the calls recorded in F again on their schedule (- for stdin) and\n"
+           "                 compare latency per tool; up to --inflight at once\n");
+    printf("  --replay-speed X  replay X times as fast (default 1; 0 sends calls as fast as possible)\n");
+    printf("  --telemetry [MS]  read GPU load and clock, EMC clock, temperature and RAM every MS\n"
+           "                 (default %d) and report them with each call's timing\n", TELEMETRY_DEFAULT_MS);
+    printf("  --metrics M    serve Prometheus metrics at /metrics on 127.0.0.1:PORT or a Unix socket\n");
+    printf("  --startup-report  print where startup time went to stderr on exit\n");
+}
+
+static void dump_stats(const McpClient *client, const char *path) {
+    if (path && stats_dump_json(client->stats, path) != 0) {
+        fprintf(stderr, "Cannot write stats to %s\n", path);
+    }
+}
+
+// Stop everything main() started and exit with status
+static int shut_down(McpClient *client, McpMetrics *metrics, McpRecorder *recorder, McpTelemetry *telemetry,
+                     int status) {
+    metrics_stop(metrics);
+    mcp_client_cleanup(client);
+    mcp_global_cleanup();
+    telemetry_stop(telemetry);
+    if (record_close(recorder) != 0) {
+        fprintf(stderr, "The recording is incomplete\n");
+        return status ? status : 1;
+    }
+    return status;
 }
 
 void print_menu() {
@@ -86,90 +946,427 @@ void print_menu() {
     printf("6. Database Management\n");
     printf("7. Settings\n");
     printf("8. Exit\n");
+    printf("9. Client Stats\n");
+    printf("10. Dashboard\n");
+    printf("11. Dashboard (single batch request)\n");
+    printf("12. Latency Stats\n");
+    printf("13. Watch Status\n");
+    printf("14. Jobs\n");
+    printf("15. Cancel Job\n");
     printf("Choice: ");
 }
 
-int main() {
-    char input[MAX_INPUT];
-    char result[MAX_RESPONSE];
-    int choice;
+#define MAX_JOBS 16
+
+// Interactive panel: one event loop over stdin and the client's multi
+// handle. Every network action runs as a background job, so the menu stays
+// live, several jobs can be in flight and any of them can be cancelled.
+typedef struct {
+    McpCall call;
+    int id;                 // 0 while the slot is free
+    int group;              // dashboard refresh the job belongs to, or 0
+    char *args;             // kept until the slot is reused
+} Job;
+
+typedef struct {
+    McpClient *client;
+    Job jobs[MAX_JOBS];
+    int next_id;
+    int pending;            // menu choice waiting for its argument line, or 0
+    int group;              // latest dashboard refresh
+    int group_left;
+    double group_start_ms;
+    int quit;
+    Input input;
+} Panel;
+
+static void panel_prompt(const Panel *panel) {
+    switch (panel->pending) {
+        case 1: printf("Enter prompt: "); break;
+        case 4: printf("Debug level (0-3): "); break;
+        case 15: printf("Job to cancel: "); break;
+        default: printf("Choice: ");
+    }
+    fflush(stdout);
+}
+
+static void job_token(McpCall *call, const char *text, size_t len) {
+    Job *job = call->context;
+    if (call->tokens == 0) printf("\n[%d] %s: ", job->id, call->label);
+    fwrite(text, 1, len, stdout);
+    fflush(stdout);
+}
+
+static void job_done(McpCall *call, void *userdata) {
+    Panel *panel = userdata;
+    Job *job = call->context;
+    char label[96], prefix[16];
     
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    startup_reply();
+    snprintf(prefix, sizeof(prefix), "[%d] ", job->id);
+    if (call->res != CURLE_OK) {
+        printf("\n%s%s: error (%s)\n", prefix, call->label, mcp_call_error(call));
+    } else if (call->on_token && call->reply.is_error) {
+        // Its error went out through job_token
+        printf("\n%s%s failed in %.1f ms\n", prefix, call->label, call->end_ms - call->start_ms);
+    } else if (call->tokens > 0) {
+        printf("\n%sFirst frame: %.1f ms, total: %.1f ms (%zu chunks)\n", prefix,
+               call->first_token_ms - call->start_ms, call->end_ms - call->start_ms, call->tokens);
+    } else {
+        describe_call(call, prefix, label, sizeof(label));
+        printf("\n");
+        print_reply(label, &call->reply);
+    }
     
-    printf("Phase 3 C Frontend v1.0\n");
+    if (job->group && job->group == panel->group && --panel->group_left == 0) {
+        printf("Dashboard refreshed in %.1f ms\n", mcp_now_ms() - panel->group_start_ms);
+    }
+    job->id = 0;
+    if (!panel->quit) panel_prompt(panel);
+}
+
+// Returns -1 only if every job slot is taken; cache hits and local failures
+// have been reported through job_done by the time this returns
+static int start_job(Panel *panel, const char *tool, const char *args, const char *label, int group,
+                     McpCallToken on_token) {
+    Job *job = NULL;
     
-    while (1) {
-        print_menu();
-        if (scanf("%d", &choice) != 1) {
-            printf("Invalid input\n");
-            continue;
+    for (int i = 0; i < MAX_JOBS && !job; i++) {
+        if (panel->jobs[i].id == 0) job = &panel->jobs[i];
+    }
+    if (!job) {
+        printf("Too many jobs running\n");
+        return -1;
+    }
+    
+    char *copy = strdup(args);
+    if (!copy) {
+        printf("Out of memory\n");
+        return -1;
+    }
+    free(job->args);
+    job->args = copy;
+    memset(&job->call, 0, sizeof(job->call));
+    job->id = ++panel->next_id;
+    job->group = group;
+    job->call.tool = tool;
+    job->call.args = job->args;
+    job->call.label = label;
+    job->call.context = job;
+    job->call.on_token = on_token;
+    
+    int id = job->id;
+    mcp_call_start(panel->client, &job->call, job_done, panel);
+    if (job->id == id && !group) printf("[%d] %s started\n", id, label);
+    return 0;
+}
+
+static void start_dashboard(Panel *panel) {
+    static const char *const views[][2] = {
+        { "get_status", "Status" },
+        { "get_agent_config", "Config" },
+        { "db_status", "Database" },
+        { "get_settings", "Settings" },
+    };
+    
+    panel->group++;
+    panel->group_left = 4;
+    panel->group_start_ms = mcp_now_ms();
+    for (int i = 0; i < 4; i++) {
+        if (start_job(panel, views[i][0], "{}", views[i][1], panel->group, NULL) < 0) panel->group_left--;
+    }
+}
+
+static void list_jobs(const Panel *panel) {
+    double now = mcp_now_ms();
+    int running = 0;
+    
+    for (int i = 0; i < MAX_JOBS; i++) {
+        const Job *job = &panel->jobs[i];
+        if (job->id == 0) continue;
+        printf("[%d] %s, running %.1f ms%s\n", job->id, job->call.label, now - job->call.start_ms,
+               job->call.cancel ? " (cancelling)" : "");
+        running++;
+    }
+    if (running == 0) printf("No jobs running\n");
+}
+
+static void cancel_job(Panel *panel, int id) {
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (panel->jobs[i].id == id && id != 0) {
+            panel->jobs[i].call.cancel = 1;
+            printf("Cancelling job %d\n", id);
+            return;
         }
+    }
+    printf("No job %d\n", id);
+}
+
+static void panel_quit(Panel *panel) {
+    panel->quit = 1;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (panel->jobs[i].id != 0) panel->jobs[i].call.cancel = 1;
+    }
+}
+
+// The prompt goes in as a JSON string, however long and whatever it holds
+static void generate_job(Panel *panel, const char *prompt) {
+    char *args = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&args, &len);
+    
+    if (!out) return;
+    fputs("{\"prompt\":", out);
+    mcp_write_json_string(out, prompt, strlen(prompt));
+    fputc('}', out);
+    if (fclose(out) == 0) start_job(panel, "generate", args, "Generate", 0, job_token);
+    free(args);
+}
+
+// Second line of a two-step action (prompt text, debug level, job id)
+static void panel_argument(Panel *panel, int choice, const char *line) {
+    char args[32];
+    
+    switch (choice) {
+        case 1:
+            generate_job(panel, line);
+            break;
+        case 4:
+            snprintf(args, sizeof(args), "{\"level\":%d}", atoi(line));
+            start_job(panel, "set_debug", args, "Debug", 0, NULL);
+            break;
+        case 15:
+            cancel_job(panel, atoi(line));
+            break;
+    }
+}
+
+static void panel_command(Panel *panel, const char *line) {
+    char *end;
+    
+    if (panel->pending) {
+        int choice = panel->pending;
+        panel->pending = 0;
+        panel_argument(panel, choice, line);
+        print_menu();
+        return;
+    }
+    
+    long choice = strtol(line, &end, 10);
+    if (end == line) {
+        if (*line) printf("Invalid input\n");
+        panel_prompt(panel);
+        return;
+    }
+    
+    switch (choice) {
+        case 1:
+        case 4:
+        case 15:
+            panel->pending = (int)choice;
+            panel_prompt(panel);
+            return;
+        case 2: start_job(panel, "get_status", "{}", "Status", 0, NULL); break;
+        case 3: start_job(panel, "start_frontend", "{}", "Frontend", 0, NULL); break;
+        case 5: start_job(panel, "get_agent_config", "{}", "Config", 0, NULL); break;
+        case 6: start_job(panel, "db_status", "{}", "Database", 0, NULL); break;
+        case 7: start_job(panel, "get_settings", "{}", "Settings", 0, NULL); break;
+        case 8:
+            panel_quit(panel);
+            return;
+        case 9: print_client_stats(panel->client); break;
+        case 10: start_dashboard(panel); break;
+        // These two run in the foreground; background jobs resume afterwards
+        case 11: show_batch_dashboard(panel->client); break;
+        case 13: run_watch(panel->client, "get_status", &panel->input); break;
+        case 12: stats_print(panel->client->stats, stdout); break;
+        case 14: list_jobs(panel); break;
+        default: printf("Invalid choice\n");
+    }
+    print_menu();
+}
+
+static void run_panel(McpClient *client) {
+    static Panel panel;
+    char *line;
+    
+    memset(&panel, 0, sizeof(panel));
+    panel.client = client;
+    print_menu();
+    fflush(stdout);
+    
+    while (!panel.quit || client->inflight > 0) {
+        struct curl_waitfd in = { .fd = STDIN_FILENO, .events = CURL_WAIT_POLLIN, .revents = 0 };
+        int reading = !panel.quit && !panel.input.eof;
         
-        switch (choice) {
-            case 1:
-                printf("Enter prompt: ");
-                getchar(); // consume newline
-                fgets(input, sizeof(input), stdin);
-                input[strcspn(input, "\n")] = 0; // remove newline
-                
-                snprintf(result, sizeof(result), "{\"prompt\":\"%s\"}", input);
-                if (call_mcp_tool("generate", result, result) == 0) {
-                    printf("Result: %s\n", result);
-                } else {
-                    printf("Error calling generate tool\n");
-                }
-                break;
-                
-            case 2:
-                if (call_mcp_tool("get_status", "{}", result) == 0) {
-                    printf("Status: %s\n", result);
-                } else {
-                    printf("Error getting status\n");
-                }
-                break;
-                
-            case 3:
-                if (call_mcp_tool("start_frontend", "{}", result) == 0) {
-                    printf("Frontend: %s\n", result);
-                } else {
-                    printf("Error starting frontend\n");
-                }
-                break;
-                
-            case 4:
-                printf("Debug level (0-3): ");
-                scanf("%d", &choice);
-                snprintf(result, sizeof(result), "{\"level\":%d}", choice);
-                if (call_mcp_tool("set_debug", result, result) == 0) {
-                    printf("Debug: %s\n", result);
-                }
-                break;
-                
-            case 5:
-                if (call_mcp_tool("get_agent_config", "{}", result) == 0) {
-                    printf("Config: %s\n", result);
-                }
-                break;
-                
-            case 6:
-                if (call_mcp_tool("db_status", "{}", result) == 0) {
-                    printf("Database: %s\n", result);
-                }
-                break;
-                
-            case 7:
-                if (call_mcp_tool("get_settings", "{}", result) == 0) {
-                    printf("Settings: %s\n", result);
-                }
-                break;
-                
-            case 8:
-                printf("Goodbye!\n");
-                curl_global_cleanup();
-                return 0;
-                
-            default:
-                printf("Invalid choice\n");
+        if (mcp_call_poll(client, reading ? &in : NULL, reading ? 1 : 0, 1000, job_done, &panel) < 0) break;
+        if (reading && (in.revents & CURL_WAIT_POLLIN)) input_fill(&panel.input);
+        
+        while (!panel.quit && (line = input_line(&panel.input))) {
+            panel_command(&panel, line);
+            fflush(stdout);
+        }
+        if (panel.input.eof && !panel.quit) panel_quit(&panel);
+    }
+    input_free(&panel.input);
+    for (int i = 0; i < MAX_JOBS; i++) free(panel.jobs[i].args);
+}
+
+int main(int argc, char **argv) {
+    McpClient client;
+    ClientConfig config = { .urls = { MCP_URL }, .policy = BALANCE_LEAST_OUTSTANDING, .framing = MCP_FRAMING_JSON };
+    char shorthand[256];
+    const char *batch_path = NULL;
+    const char *watch_tool = NULL;
+    const char *stats_path = NULL;
+    const char *metrics_spec = NULL;
+    const char *prompt_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    double replay_speed = 1;
+    size_t io_window = MCP_IO_WINDOW;
+    McpMetrics metrics = { .fd = -1 };
+    McpRecorder recorder = { .out = NULL };
+    McpTelemetry telemetry = { .running = 0 };
+    int telemetry_ms = -1;
+    int batch = 0;
+    int use_cache = 1;
+    size_t inflight = BATCH_DEFAULT_INFLIGHT;
+    size_t prefix_window = 0;
+    size_t workers = 0;
+    
+    startup_begin();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--url") == 0 && i + 1 < argc && config.nurls < MCP_MAX_ENDPOINTS) {
+            config.urls[config.nurls++] = argv[++i];
+        } else if (strcmp(argv[i], "--balance") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "least") == 0 || strcmp(argv[i + 1], "ewma") == 0)) {
+            config.policy = strcmp(argv[++i], "ewma") == 0 ? BALANCE_EWMA : BALANCE_LEAST_OUTSTANDING;
+        } else if (strcmp(argv[i], "--framing") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "json") == 0 || strcmp(argv[i + 1], "cbor") == 0)) {
+            config.framing = strcmp(argv[++i], "cbor") == 0 ? MCP_FRAMING_CBOR : MCP_FRAMING_JSON;
+        } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            config.transport = argv[++i];
+        } else if (strcmp(argv[i], "--unix") == 0 || strcmp(argv[i], "--shm") == 0) {
+            // Shorthands for --transport unix[:PATH] and shm[:NAME]
+            const char *kind = argv[i] + 2;
+            const char *target = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : NULL;
+            snprintf(shorthand, sizeof(shorthand), "%s%s%s", kind, target ? ":" : "", target ? target : "");
+            config.transport = shorthand;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+            if (i + 1 < argc && (argv[i + 1][0] != '-' || strcmp(argv[i + 1], "-") == 0)) {
+                batch_path = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--inflight") == 0 && i + 1 < argc) {
+            inflight = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--prefix-window") == 0 && i + 1 < argc) {
+            prefix_window = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (strcmp(argv[i], "--prompt-file") == 0 && i + 1 < argc) {
+            prompt_path = argv[++i];
+        } else if (strcmp(argv[i], "--io-window") == 0 && i + 1 < argc) {
+            io_window = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay-speed") == 0 && i + 1 < argc) {
+            replay_speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--telemetry") == 0) {
+            telemetry_ms = (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) ? atoi(argv[++i]) : 0;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_spec = argv[++i];
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = 0;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch_tool = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : "get_status";
+        } else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+            config.deadline_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--hedge") == 0 && i + 1 < argc) {
+            config.hedge = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--startup-report") == 0) {
+            startup.enabled = 1;
+        } else {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 2;
+        }
+    }
+    
+    // Shared memory rings carry one client's calls, and a pool's batch goes
+    // out through its workers only, so the main client takes no transport
+    int pooled = batch && workers > 0;
+    if (pooled && workers > 1 && config.transport && strncmp(config.transport, "shm", 3) == 0) {
+        fprintf(stderr, "The shm transport takes one client; use --workers 1 or another transport\n");
+        return 2;
+    }
+    if (record_path) {
+        if (record_open(&recorder, record_path) != 0) {
+            fprintf(stderr, "Cannot record to %s\n", record_path);
+            return 1;
         }
+        config.recorder = &recorder;
     }
+    if (telemetry_ms >= 0) {
+        if (telemetry_start(&telemetry, telemetry_ms) != 0) {
+            fprintf(stderr, "No device telemetry to read here\n");
+            record_close(&recorder);
+            return 1;
+        }
+        config.telemetry = &telemetry;
+    }
+    ClientConfig own = config;
+    if (pooled) own.transport = NULL;
+    if (setup_client(&client, &own) != 0) {
+        mcp_global_cleanup();
+        record_close(&recorder);
+        telemetry_stop(&telemetry);
+        return 1;
+    }
+    if (metrics_spec && metrics_start(&metrics, &client, metrics_spec) != 0) {
+        fprintf(stderr, "Cannot serve metrics on %s\n", metrics_spec);
+        return shut_down(&client, &metrics, &recorder, &telemetry, 1);
+    }
+    startup.ready_ms = mcp_now_ms();
+    
+    if (batch) {
+        int status = run_batch_mode(&client, batch_path, inflight, prefix_window, pooled ? workers : 0, &config,
+                                    &metrics);
+        dump_stats(&client, stats_path);
+        startup_print(&client);
+        return shut_down(&client, &metrics, &recorder, &telemetry, status);
+    }
+    
+    if (replay_path) {
+        int status = run_replay(&client, replay_path, replay_speed, inflight);
+        dump_stats(&client, stats_path);
+        startup_print(&client);
+        return shut_down(&client, &metrics, &recorder, &telemetry, status);
+    }
+    
+    if (prompt_path) {
+        int status = run_prompt_file(&client, prompt_path, io_window);
+        startup_print(&client);
+        return shut_down(&client, &metrics, &recorder, &telemetry, status);
+    }
+    
+    if (watch_tool) {
+        int status = run_watch(&client, watch_tool, NULL);
+        startup_print(&client);
+        return shut_down(&client, &metrics, &recorder, &telemetry, status);
+    }
+    
+    // Only the interactive views are cached; batch mode always asks the server
+    client.cache.enabled = use_cache;
+    printf("Phase 3 C Frontend v1.0\n");
+    
+    run_panel(&client);
+    
+    printf("Goodbye!\n");
+    dump_stats(&client, stats_path);
+    startup_print(&client);
+    return shut_down(&client, &metrics, &recorder, &telemetry, 0);
 }
@@ -0,0 +1,2305 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "cbor.h"
+#include "mcp_client.h"
+
+#define RESPONSE_MIN_CAPACITY 4096
+
+// Incremental state for a streamed call. Bytes are handed to the terminal as
+// they arrive; only the current SSE line and event are ever buffered.
+typedef struct {
+    CURL *curl;
+    int sse;                // -1 until the Content-Type is known
+    int raw;                // plain body that is not JSON, passed through as is
+    JsonScan scan;
+    Response line;
+    Response data;
+    char event[32];
+    size_t tokens;
+    size_t received;        // decoded body bytes, SSE framing included
+    int done;
+    int rpc_error;
+    double parse_ms;
+    double start_ms;
+    double first_token_ms;
+    int shown;              // something went out, text or an error
+    McpCall *call;              // set for streamed parallel calls: text goes to its on_token
+    McpWatchEvent on_event;     // set for watch streams: events go here, not to stdout
+    McpWatchIdle idle;
+    void *userdata;
+    int stop;
+} Stream;
+
+static int response_append(Response *response, const char *src, size_t n) {
+    size_t needed = response->size + n + 1;
+    
+    if (needed > response->capacity) {
+        size_t capacity = response->capacity ? response->capacity : RESPONSE_MIN_CAPACITY;
+        while (capacity < needed) capacity *= 2;
+        char *ptr = response->arena ? arena_grow(response->arena, response->data, response->size + 1, capacity) :
+                    realloc(response->data, capacity);
+        if (!ptr) return -1;
+        response->data = ptr;
+        response->capacity = capacity;
+    }
+    
+    memcpy(&(response->data[response->size]), src, n);
+    response->size += n;
+    response->data[response->size] = 0;
+    return 0;
+}
+
+static void response_reset(Response *response) {
+    response->size = 0;
+    if (response->data) response->data[0] = 0;
+}
+
+static void response_free(Response *response) {
+    if (!response->arena) free(response->data);
+    memset(response, 0, sizeof(*response));
+}
+
+// Take the buffer from arena from now on, forgetting what it held before
+static void response_use_arena(Response *response, Arena *arena) {
+    if (!response->arena) free(response->data);
+    memset(response, 0, sizeof(*response));
+    response->arena = arena;
+}
+
+static void reply_reset(Reply *reply) {
+    response_reset(&reply->body);
+    json_scan_init(&reply->scan);
+    reply->parse_ms = 0;
+    reply->cbor = 0;
+    reply->etag[0] = 0;
+}
+
+static void reply_free(Reply *reply) {
+    response_free(&reply->body);
+    json_scan_free(&reply->scan);
+    reply->headers = NULL;
+}
+
+// Start a handle's next call with an empty arena: whatever the previous call
+// on it left behind, bodies, stream state and headers, goes in one step
+static void begin_call(Arena *arena, Response *request, Reply *reply) {
+    arena_reset(arena);
+    response_use_arena(request, arena);
+    response_use_arena(&reply->body, arena);
+    json_scan_use_arena(&reply->scan, arena);
+    reply->headers = NULL;
+}
+
+// A body that did not scan as one complete reply counts as an error
+static int reply_failed(const Reply *reply) {
+    const JsonScan *scan = &reply->scan;
+    return scan->failed || !scan->complete || scan->reply.has_error;
+}
+
+static void reply_view(const Reply *reply, McpReply *view) {
+    const JsonScan *scan = &reply->scan;
+    
+    memset(view, 0, sizeof(*view));
+    view->body.data = reply->body.data ? reply->body.data : "";
+    view->body.size = reply->body.size;
+    view->text.data = view->message.data = "";
+    view->is_error = reply_failed(reply);
+    if (scan->complete && !scan->failed) {
+        view->text.data = scan->reply.text;
+        view->text.size = scan->reply.text_len;
+        view->message.data = scan->reply.message;
+        view->message.size = scan->reply.message_len;
+        view->has_id = scan->reply.has_id;
+        view->id = scan->reply.id;
+        view->error_code = scan->reply.error_code;
+    }
+    view->cbor = reply->cbor;
+}
+
+static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userdata) {
+    Reply *reply = userdata;
+    size_t realsize = size * nmemb;
+    
+    if (response_append(&reply->body, contents, realsize) != 0) return 0;
+    
+    // Scan while the bytes are hot; a body that is not JSON is kept but flagged
+    double start = mcp_now_ms();
+    json_scan_feed(&reply->scan, contents, realsize);
+    reply->parse_ms += mcp_now_ms() - start;
+    return realsize;
+}
+
+static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    Reply *reply = userdata;
+    size_t len = size * nitems;
+    
+    if (len > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+        size_t start = 5, end = len;
+        while (start < end && (buffer[start] == ' ' || buffer[start] == '\t')) start++;
+        while (end > start && (buffer[end - 1] == '\r' || buffer[end - 1] == '\n' || buffer[end - 1] == ' ')) end--;
+        if (end - start < sizeof(reply->etag)) {
+            memcpy(reply->etag, buffer + start, end - start);
+            reply->etag[end - start] = 0;
+        }
+    }
+    return len;
+}
+
+static void cbor_reply(void *userdata, const JsonScanReply *reply) {
+    json_scan_set_reply(userdata, reply);
+}
+
+// A CBOR body is walked in one pass once it is complete. The JSON scan
+// that ran as it arrived gave up at the first byte; its hooks are kept so
+// a batch is still routed reply by reply.
+static void reply_decode_cbor(Reply *reply) {
+    JsonScan *scan = &reply->scan;
+    JsonScanDone on_reply = scan->on_reply;
+    void *userdata = scan->userdata;
+    double start = mcp_now_ms();
+    
+    json_scan_init(scan);
+    scan->on_reply = on_reply;
+    scan->userdata = userdata;
+    if (cbor_scan_replies((const unsigned char *)reply->body.data, reply->body.size, cbor_reply, scan) < 0) {
+        scan->failed = 1;
+    }
+    reply->cbor = 1;
+    reply->parse_ms += mcp_now_ms() - start;
+}
+
+// Called once a plain (not streamed) transfer is over
+static void reply_arrived(Reply *reply, CURL *curl, CURLcode res) {
+    char *type = NULL;
+    
+    if (res != CURLE_OK) return;
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &type);
+    if (type && strncasecmp(type, "application/cbor", 16) == 0) reply_decode_cbor(reply);
+}
+
+// Refill reply from a cached body, scanning it as if it had just arrived
+static void reply_serve(Reply *reply, const char *body, size_t size, int cbor) {
+    reply_reset(reply);
+    if (!cbor) {
+        WriteCallback((void *)body, 1, size, reply);
+    } else if (response_append(&reply->body, body, size) == 0) {
+        reply_decode_cbor(reply);
+    }
+}
+
+static int cacheable(const McpClient *client, const char *tool) {
+    return client->cache.enabled && cache_ttl_ms(tool) > 0;
+}
+
+// Serve a fresh entry into reply without touching the network
+static int cache_hit(McpClient *client, const char *tool, const char *args, Reply *reply) {
+    if (!cacheable(client, tool)) return 0;
+    
+    CacheEntry *entry = cache_find(&client->cache, tool, args);
+    if (!entry || mcp_now_ms() >= entry->expires_ms) return 0;
+    reply_serve(reply, entry->body, entry->size, entry->cbor);
+    STAT_ADD(client->cache.hits, 1);
+    return 1;
+}
+
+// curl only reads the list, so its nodes can live in the call's arena
+static struct curl_slist *header_node(Arena *arena, const char *line, struct curl_slist *next) {
+    size_t len = strlen(line) + 1;
+    struct curl_slist *node = arena_alloc(arena, sizeof(*node) + len);
+    
+    if (!node) return NULL;
+    node->data = (char *)(node + 1);
+    memcpy(node->data, line, len);
+    node->next = next;
+    return node;
+}
+
+// Ask for the ETag back and, when a stale entry is held, make the request
+// conditional on it so an unchanged reply comes back as an empty 304
+static void cache_prepare(McpClient *client, CURL *curl, const char *tool, const char *args, Reply *reply) {
+    if (!cacheable(client, tool)) return;
+    
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, reply);
+    
+    CacheEntry *entry = cache_find(&client->cache, tool, args);
+    if (!entry || !entry->etag[0]) return;
+    
+    char line[112];
+    snprintf(line, sizeof(line), "If-None-Match: %s", entry->etag);
+    // The client's own headers, in order, then the condition
+    struct curl_slist **tail = &reply->headers;
+    int ok = 1;
+    *tail = NULL;
+    for (const struct curl_slist *h = client->headers; h && ok; h = h->next) {
+        ok = (*tail = header_node(reply->body.arena, h->data, NULL)) != NULL;
+        if (ok) tail = &(*tail)->next;
+    }
+    if (!ok || !(*tail = header_node(reply->body.arena, line, NULL))) reply->headers = NULL;
+    if (reply->headers) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, reply->headers);
+}
+
+// Store a good reply, or put the held body back on 304. The entry is looked
+// up again because other calls may have replaced it in the meantime. Returns
+// 1 when the reply now holds the cached body.
+static int cache_settle(McpClient *client, const char *tool, const char *args, Reply *reply, CURLcode res,
+                        long http_status) {
+    McpCache *cache = &client->cache;
+    int revalidated = 0;
+    
+    if (cacheable(client, tool)) {
+        CacheEntry *entry = cache_find(cache, tool, args);
+        if (res == CURLE_OK && http_status == 304 && entry) {
+            reply_serve(reply, entry->body, entry->size, entry->cbor);
+            entry->expires_ms = mcp_now_ms() + cache_ttl_ms(tool);
+            STAT_ADD(cache->revalidated, 1);
+            revalidated = 1;
+        } else {
+            STAT_ADD(cache->misses, 1);
+            if (res == CURLE_OK && http_status == 200 && !reply_failed(reply)) {
+                cache_store(cache, tool, args, reply->body.data, reply->body.size, reply->cbor, reply->etag,
+                            mcp_now_ms());
+            }
+        }
+    }
+    
+    if (client->cache.enabled && res == CURLE_OK && cache_invalidates(tool) && cache->count > 0) {
+        cache_clear(cache);
+        STAT_ADD(cache->invalidations, 1);
+    }
+    return revalidated;
+}
+
+static int cache_complete(McpClient *client, CURL *curl, const char *tool, const char *args,
+                          Reply *reply, CURLcode res) {
+    long http_status = 0;
+    
+    if (!cacheable(client, tool)) return cache_settle(client, tool, args, reply, res, 0);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status);
+    int revalidated = cache_settle(client, tool, args, reply, res, http_status);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+    if (reply->headers) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->headers);
+        reply->headers = NULL;
+    }
+    return revalidated;
+}
+
+const char *mcp_call_error(const McpCall *call) {
+    if (call->res == CURLE_BAD_FUNCTION_ARGUMENT) return "arguments are not a JSON object";
+    if (call->res == CURLE_ABORTED_BY_CALLBACK) return "cancelled";
+    if (call->res == CURLE_OPERATION_TIMEDOUT) return "deadline exceeded";
+    // Refused locally, without a transfer of its own
+    if (call->res == CURLE_COULDNT_CONNECT && call->end_ms == call->start_ms) return "no endpoint available (backing off)";
+    return curl_easy_strerror(call->res);
+}
+
+double mcp_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// To the call's on_token, which sees the chunks delivered before this one,
+// or to stdout
+static void stream_output(Stream *stream, const char *text, size_t len) {
+    if (stream->call) {
+        stream->call->first_token_ms = stream->first_token_ms;
+        stream->call->tokens = stream->tokens;
+        stream->call->on_token(stream->call, text, len);
+    } else {
+        if (!stream->shown) printf("Result: ");
+        fwrite(text, 1, len, stdout);
+        fflush(stdout);
+    }
+    stream->shown = 1;
+}
+
+static void stream_emit(Stream *stream, const char *text, size_t len) {
+    if (len == 0) return;
+    if (stream->tokens == 0) stream->first_token_ms = mcp_now_ms();
+    stream_output(stream, text, len);
+    stream->tokens++;
+}
+
+typedef void (*ErrorOut)(void *userdata, const char *text, size_t len);
+
+// "Error N: message" in one chunk, or only its head when out of memory
+static void emit_error(long code, const char *message, size_t message_len, ErrorOut out, void *userdata) {
+    char head[48];
+    int n = snprintf(head, sizeof(head), "Error %ld: ", code);
+    char *text = malloc((size_t)n + message_len);
+    
+    if (!text) {
+        out(userdata, head, (size_t)n);
+        return;
+    }
+    memcpy(text, head, (size_t)n);
+    memcpy(text + n, message, message_len);
+    out(userdata, text, (size_t)n + message_len);
+    free(text);
+}
+
+static void stream_error_out(void *userdata, const char *text, size_t len) {
+    stream_output(userdata, text, len);
+}
+
+// The error goes out as one chunk with reply.is_error set during on_token,
+// and counts toward neither the tokens nor the time to the first one
+static void stream_emit_error(Stream *stream, const JsonScanReply *reply) {
+    if (stream->call) stream->call->reply.is_error = 1;
+    emit_error(reply->error_code, reply->message, reply->message_len, stream_error_out, stream);
+    if (stream->call) stream->call->reply.is_error = 0;
+}
+
+static void stream_text(void *userdata, const char *text, size_t len) {
+    stream_emit(userdata, text, len);
+}
+
+// Plain JSON body: the text went out through stream_text as it was decoded
+static void stream_reply(void *userdata, const JsonScanReply *reply) {
+    Stream *stream = userdata;
+    
+    if (reply->has_error) stream_emit_error(stream, reply);
+    stream->rpc_error = reply->has_error;
+    stream->done = 1;
+}
+
+// Frames are either {"delta": "..."} token chunks or, on the final "done"
+// event, the full JSON-RPC response. The latter's text is only printed when
+// the server did not stream any deltas before it.
+static void stream_dispatch(Stream *stream) {
+    const JsonScanReply *frame = &stream->scan.reply;
+    
+    if (stream->data.size == 0) {
+        stream->event[0] = 0;
+        return;
+    }
+    
+    if (stream->on_event) {
+        const char *event = stream->event[0] ? stream->event : "message";
+        if (stream->on_event(stream->userdata, event, stream->data.data, stream->data.size)) stream->stop = 1;
+        response_reset(&stream->data);
+        stream->event[0] = 0;
+        return;
+    }
+    
+    double parse_start = mcp_now_ms();
+    json_scan_init(&stream->scan);
+    int ok = json_scan_feed(&stream->scan, stream->data.data, stream->data.size) == 0 && stream->scan.complete;
+    stream->parse_ms += mcp_now_ms() - parse_start;
+    if (!ok) {
+        stream_emit(stream, stream->data.data, stream->data.size);
+    } else if (strcmp(stream->event, "done") == 0 || frame->has_id) {
+        if (frame->has_error) stream_emit_error(stream, frame);
+        else if (stream->tokens == 0) stream_emit(stream, frame->text, frame->text_len);
+        stream->rpc_error = frame->has_error;
+        stream->done = 1;
+    } else {
+        stream_emit(stream, frame->text, frame->text_len);
+    }
+    
+    response_reset(&stream->data);
+    stream->event[0] = 0;
+}
+
+static void stream_line(Stream *stream, char *line, size_t len) {
+    if (len > 0 && line[len - 1] == '\r') line[--len] = 0;
+    
+    if (len == 0) {
+        stream_dispatch(stream);
+    } else if (strncmp(line, "data:", 5) == 0) {
+        size_t skip = (len > 5 && line[5] == ' ') ? 6 : 5;
+        if (stream->data.size > 0) response_append(&stream->data, "\n", 1);
+        response_append(&stream->data, line + skip, len - skip);
+    } else if (strncmp(line, "event:", 6) == 0) {
+        const char *name = line + 6;
+        while (*name == ' ') name++;
+        snprintf(stream->event, sizeof(stream->event), "%s", name);
+    }
+    // Comments (":") and id/retry fields carry nothing we need
+}
+
+static size_t StreamCallback(void *contents, size_t size, size_t nmemb, void *userdata) {
+    Stream *stream = userdata;
+    size_t realsize = size * nmemb;
+    const char *bytes = contents;
+    
+    stream->received += realsize;
+    if (stream->sse < 0) {
+        char *type = NULL;
+        curl_easy_getinfo(stream->curl, CURLINFO_CONTENT_TYPE, &type);
+        stream->sse = (type && strstr(type, "text/event-stream")) ? 1 : 0;
+        // A watch needs the event stream; anything else is an error page
+        if (!stream->sse && stream->on_event) return 0;
+        if (!stream->sse) {
+            json_scan_init(&stream->scan);
+            stream->scan.on_text = stream_text;
+            stream->scan.on_reply = stream_reply;
+            stream->scan.userdata = stream;
+        }
+    }
+    
+    // Server without streaming support: print the text as it is decoded from
+    // the plain reply, or the body itself if it turns out not to be JSON
+    if (!stream->sse) {
+        if (!stream->raw) {
+            double parse_start = mcp_now_ms();
+            stream->raw = json_scan_feed(&stream->scan, bytes, realsize) != 0;
+            stream->parse_ms += mcp_now_ms() - parse_start;
+        }
+        if (stream->raw) stream_emit(stream, bytes, realsize);
+        return realsize;
+    }
+    
+    for (size_t i = 0; i < realsize; i++) {
+        if (bytes[i] == '\n') {
+            if (stream->line.size == 0) {
+                char empty = 0;
+                stream_line(stream, &empty, 0);
+            } else {
+                stream_line(stream, stream->line.data, stream->line.size);
+            }
+            response_reset(&stream->line);
+            if (stream->stop) return 0;
+        } else if (response_append(&stream->line, &bytes[i], 1) != 0) {
+            return 0;
+        }
+    }
+    return realsize;
+}
+
+// Options that do not change between calls are set once per handle
+static void setup_handle(McpClient *client, CURL *curl) {
+    curl_easy_setopt(curl, CURLOPT_URL, client->url);
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, client->unix_path);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, client->http_version);
+    // Over HTTP/2 a parallel call waits for the connection being set up and
+    // multiplexes on it instead of opening its own
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, client->http_version != CURL_HTTP_VERSION_1_1 ? 1L : 0L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)MCP_CONNECT_TIMEOUT_MS);
+    // Offer every encoding this libcurl can decode (gzip, and zstd/br when
+    // built in); the write callbacks only ever see the decoded body
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+}
+
+static size_t DiscardCallback(void *contents, size_t size, size_t nmemb, void *userdata) {
+    (void)contents;
+    (void)userdata;
+    return size * nmemb;
+}
+
+// Health probes only look at the status code
+static void setup_probe(McpClient *client, size_t index) {
+    CURL *probe = client->probes[index];
+    
+    setup_handle(client, probe);
+    curl_easy_setopt(probe, CURLOPT_URL, client->balancer.endpoints[index].health_url);
+    curl_easy_setopt(probe, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(probe, CURLOPT_WRITEFUNCTION, DiscardCallback);
+    curl_easy_setopt(probe, CURLOPT_TIMEOUT_MS, (long)MCP_HEALTH_TIMEOUT_MS);
+}
+
+// Generation can legitimately run long; everything else is a quick lookup
+// or an admin action that should not outlive the proxy's own call timeout
+static const struct { const char *tool; double deadline_ms; } deadline_policy[] = {
+    { "generate", 120000 },
+    { "get_status", 5000 },
+    { "db_status", 5000 },
+    { "get_agent_config", 5000 },
+    { "get_settings", 5000 },
+    { "db_query", 30000 },
+};
+
+double mcp_tool_deadline_ms(const McpClient *client, const char *tool) {
+    if (client->deadline_ms > 0) return client->deadline_ms;
+    for (size_t i = 0; i < sizeof(deadline_policy) / sizeof(deadline_policy[0]); i++) {
+        if (strcmp(deadline_policy[i].tool, tool) == 0) return deadline_policy[i].deadline_ms;
+    }
+    return MCP_DEADLINE_MS;
+}
+
+static struct curl_slist *framing_headers(McpFraming framing) {
+    if (framing == MCP_FRAMING_JSON) return curl_slist_append(NULL, "Content-Type: application/json");
+    
+    struct curl_slist *headers = curl_slist_append(NULL, "Content-Type: application/cbor");
+    if (headers && !curl_slist_append(headers, "Accept: application/cbor")) {
+        curl_slist_free_all(headers);
+        headers = NULL;
+    }
+    return headers;
+}
+
+static int curl_ready;
+
+void mcp_global_cleanup(void) {
+    if (curl_ready) curl_global_cleanup();
+    curl_ready = 0;
+}
+
+// Runs before the first handle is created, when the endpoints are known
+static int global_ready(McpClient *client) {
+    if (curl_ready) return 0;
+    
+    double start = mcp_now_ms();
+    long flags = CURL_GLOBAL_NOTHING;
+    for (size_t i = 0; i < client->balancer.count; i++) {
+        if (strncasecmp(client->balancer.endpoints[i].url, "https:", 6) == 0) flags = CURL_GLOBAL_DEFAULT;
+    }
+    if (curl_global_init(flags) != CURLE_OK) return -1;
+    curl_ready = 1;
+    client->curl_init_ms = mcp_now_ms() - start;
+    return 0;
+}
+
+static CURL *new_handle(McpClient *client) {
+    return global_ready(client) == 0 ? curl_easy_init() : NULL;
+}
+
+static CURL *main_handle(McpClient *client) {
+    if (!client->curl && (client->curl = new_handle(client))) setup_handle(client, client->curl);
+    return client->curl;
+}
+
+int mcp_client_prepare(McpClient *client) {
+    return main_handle(client) ? 0 : -1;
+}
+
+int mcp_client_init(McpClient *client, const char *url) {
+    memset(client, 0, sizeof(*client));
+    
+    client->url = strdup(url);
+    client->http_version = CURL_HTTP_VERSION_1_1;
+    client->stats = calloc(1, sizeof(StatsTable));
+    if (!client->url || !client->stats || balancer_add(&client->balancer, url) != 0) {
+        mcp_client_cleanup(client);
+        return -1;
+    }
+    
+    client->headers = framing_headers(MCP_FRAMING_JSON);
+    client->stream_headers = curl_slist_append(NULL, "Content-Type: application/json");
+    if (client->stream_headers) {
+        struct curl_slist *tail = curl_slist_append(client->stream_headers, "Accept: text/event-stream");
+        if (!tail) {
+            curl_slist_free_all(client->stream_headers);
+            client->stream_headers = NULL;
+        }
+    }
+    if (!client->headers || !client->stream_headers) {
+        mcp_client_cleanup(client);
+        return -1;
+    }
+    return 0;
+}
+
+void mcp_client_cleanup(McpClient *client) {
+    for (int i = 0; i < MCP_MAX_ENDPOINTS; i++) {
+        if (client->probe_busy[i]) curl_multi_remove_handle(client->multi, client->probes[i]);
+        if (client->probes[i]) curl_easy_cleanup(client->probes[i]);
+        client->probes[i] = NULL;
+        client->probe_busy[i] = 0;
+    }
+    client->probing = 0;
+    transport_close(&client->link.transport);
+    balancer_free(&client->balancer);
+    for (int i = 0; i < MCP_MAX_PARALLEL; i++) {
+        if (client->pool[i]) curl_easy_cleanup(client->pool[i]);
+        client->pool[i] = NULL;
+        reply_free(&client->pool_response[i]);
+        response_free(&client->pool_request[i]);
+        arena_free(&client->pool_arena[i]);
+    }
+    reply_free(&client->response);
+    response_free(&client->request);
+    arena_free(&client->arena);
+    if (client->multi) curl_multi_cleanup(client->multi);
+    if (client->headers) curl_slist_free_all(client->headers);
+    if (client->stream_headers) curl_slist_free_all(client->stream_headers);
+    if (client->curl) curl_easy_cleanup(client->curl);
+    free(client->url);
+    free(client->unix_path);
+    free(client->stats);
+    cache_clear(&client->cache);
+    client->stats = NULL;
+    client->multi = NULL;
+    client->headers = NULL;
+    client->stream_headers = NULL;
+    client->curl = NULL;
+    client->url = NULL;
+    client->unix_path = NULL;
+}
+
+// Apply a changed URL, socket path or HTTP version to every handle made so
+// far. curl keys cached connections on the socket path too, so a TCP
+// connection is never reused for a socket call or the other way round.
+static void reconfigure_handles(McpClient *client) {
+    if (client->curl) setup_handle(client, client->curl);
+    for (int i = 0; i < MCP_MAX_PARALLEL; i++) {
+        if (client->pool[i]) setup_handle(client, client->pool[i]);
+    }
+    for (size_t i = 0; i < client->balancer.count; i++) {
+        if (client->probes[i]) setup_probe(client, i);
+    }
+}
+
+int mcp_client_set_unix_socket(McpClient *client, const char *path) {
+    char *copy = NULL;
+    
+    if (path && !(copy = strdup(path))) return -1;
+    free(client->unix_path);
+    client->unix_path = copy;
+    reconfigure_handles(client);
+    return 0;
+}
+
+// Each starts from HTTP/1.1 over TCP with no link open
+static int open_http(McpClient *client, const char *target) {
+    (void)client;
+    (void)target;
+    return 0;
+}
+
+static int open_http2(McpClient *client, const char *target) {
+    (void)target;
+    client->http_version = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+    reconfigure_handles(client);
+    return 0;
+}
+
+static int open_unix(McpClient *client, const char *target) {
+    return mcp_client_set_unix_socket(client, target ? target : MCP_SOCKET);
+}
+
+static int open_shm(McpClient *client, const char *target) {
+    return transport_open_shm(&client->link.transport, target ? target : SHM_RING_NAME);
+}
+
+static int open_stdio(McpClient *client, const char *target) {
+    return target ? transport_open_stdio(&client->link.transport, target) : -1;
+}
+
+static int open_mock(McpClient *client, const char *target) {
+    (void)target;
+    return transport_open_mock(&client->link.transport);
+}
+
+static const struct { const char *kind; int (*open)(McpClient *client, const char *target); } transport_kinds[] = {
+    { "http", open_http },
+    { "http2", open_http2 },
+    { "unix", open_unix },
+    { "shm", open_shm },
+    { "stdio", open_stdio },
+    { "mock", open_mock },
+};
+
+int mcp_client_set_transport(McpClient *client, const char *spec) {
+    const char *colon = strchr(spec, ':');
+    size_t kind_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    const char *target = colon && colon[1] ? colon + 1 : NULL;
+    
+    if (client->link.pending > 0) return -1;
+    for (size_t i = 0; i < sizeof(transport_kinds) / sizeof(transport_kinds[0]); i++) {
+        if (strlen(transport_kinds[i].kind) != kind_len || strncmp(spec, transport_kinds[i].kind, kind_len) != 0) {
+            continue;
+        }
+        // Back to plain HTTP/1.1 over TCP first, which is also where a
+        // transport that fails to open leaves the client
+        long http_version = client->http_version;
+        transport_close(&client->link.transport);
+        memset(&client->link, 0, sizeof(client->link));
+        client->http_version = CURL_HTTP_VERSION_1_1;
+        if ((client->unix_path || http_version != CURL_HTTP_VERSION_1_1) &&
+            mcp_client_set_unix_socket(client, NULL) != 0) {
+            return -1;
+        }
+        if (transport_kinds[i].open(client, target) == 0) return 0;
+        transport_close(&client->link.transport);
+        return -1;
+    }
+    return -1;
+}
+
+void mcp_client_describe_transport(const McpClient *client, char *out, size_t size) {
+    const McpTransport *transport = &client->link.transport;
+    
+    if (transport->ops) {
+        snprintf(out, size, "%s %s%s", transport->ops->name, transport->target,
+                 transport->ops->streams ? " (HTTP for watch)" : " (HTTP for streams and watch)");
+    } else if (client->unix_path) {
+        snprintf(out, size, "unix socket %s", client->unix_path);
+    } else {
+        snprintf(out, size, "%s %s", client->http_version == CURL_HTTP_VERSION_1_1 ? "tcp" : "tcp, HTTP/2",
+                 client->url);
+    }
+}
+
+int mcp_client_add_endpoint(McpClient *client, const char *url) {
+    return balancer_add(&client->balancer, url);
+}
+
+int mcp_client_set_framing(McpClient *client, McpFraming framing) {
+    struct curl_slist *headers = framing_headers(framing);
+    
+    if (!headers) return -1;
+    if (client->headers) curl_slist_free_all(client->headers);
+    client->headers = headers;
+    client->framing = framing;
+    if (client->curl) curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->headers);
+    for (int i = 0; i < MCP_MAX_PARALLEL; i++) {
+        if (client->pool[i]) curl_easy_setopt(client->pool[i], CURLOPT_HTTPHEADER, client->headers);
+    }
+    return 0;
+}
+
+size_t mcp_client_arena_peak(const McpClient *client, long *spills) {
+    size_t peak = client->arena.peak;
+    
+    *spills = client->arena.spills;
+    for (int i = 0; i < MCP_MAX_PARALLEL; i++) {
+        if (client->pool_arena[i].peak > peak) peak = client->pool_arena[i].peak;
+        *spills += client->pool_arena[i].spills;
+    }
+    return peak;
+}
+
+// Admin tools act on, or describe, one node
+static int pinned_tool(const char *tool) {
+    return cache_ttl_ms(tool) > 0 || cache_invalidates(tool);
+}
+
+// Point curl at the endpoint the balancer picks and count the call against
+// it; NULL when every endpoint is backing off
+static McpEndpoint *pick_endpoint(McpClient *client, CURL *curl, int pinned, uint64_t affinity) {
+    McpEndpoint *endpoint = balancer_pick(&client->balancer, pinned, affinity, mcp_now_ms());
+    
+    if (!endpoint) return NULL;
+    STAT_ADD(endpoint->outstanding, 1);
+    curl_easy_setopt(curl, CURLOPT_URL, endpoint->url);
+    return endpoint;
+}
+
+// First pass over caller-supplied arguments: a single JSON object with
+// matching brackets at most 64 deep, terminated strings with known escapes,
+// and nothing after it
+static int args_balanced(const char *args, size_t len) {
+    uint64_t stack = 0;     // one bit per open bracket: 1 for '{', 0 for '['
+    int depth = 0, in_string = 0;
+    size_t i = 0;
+    
+    while (i < len && isspace((unsigned char)args[i])) i++;
+    if (i == len || args[i] != '{') return 0;
+    
+    for (; i < len; i++) {
+        unsigned char c = (unsigned char)args[i];
+        if (in_string) {
+            if (c == '\\') {
+                if (++i == len || !strchr("\"\\/bfnrtu", args[i])) return 0;
+            } else if (c == '"') {
+                in_string = 0;
+            }
+            else if (c < 0x20) return 0;
+            continue;
+        }
+        if (c == '"') {
+            in_string = 1;
+        } else if (c == '{' || c == '[') {
+            if (depth == 64) return 0;
+            stack = (stack << 1) | (c == '{');
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0 || (int)(stack & 1) != (c == '}')) return 0;
+            stack >>= 1;
+            if (--depth == 0) break;
+        }
+    }
+    if (depth != 0 || i == len) return 0;
+    
+    for (i++; i < len; i++) {
+        if (!isspace((unsigned char)args[i])) return 0;
+    }
+    return 1;
+}
+
+// true, false, null or a number as JSON spells it
+static int scalar_valid(const char *value, size_t len) {
+    size_t i = 0, digits;
+    
+    if ((len == 4 && memcmp(value, "true", 4) == 0) || (len == 5 && memcmp(value, "false", 5) == 0) ||
+        (len == 4 && memcmp(value, "null", 4) == 0)) {
+        return 1;
+    }
+    if (i < len && value[i] == '-') i++;
+    for (digits = i; i < len && isdigit((unsigned char)value[i]); i++) {}
+    if (i == digits || (value[digits] == '0' && i > digits + 1)) return 0;
+    if (i < len && value[i] == '.') {
+        for (digits = ++i; i < len && isdigit((unsigned char)value[i]); i++) {}
+        if (i == digits) return 0;
+    }
+    if (i < len && (value[i] == 'e' || value[i] == 'E')) {
+        if (++i < len && (value[i] == '+' || value[i] == '-')) i++;
+        for (digits = i; i < len && isdigit((unsigned char)value[i]); i++) {}
+        if (i == digits) return 0;
+    }
+    return i == len;
+}
+
+static void check_value(void *userdata, const char *value, size_t len);
+
+static void check_member(void *userdata, const char *key, size_t key_len, const char *value, size_t value_len) {
+    (void)key;
+    (void)key_len;
+    check_value(userdata, value, value_len);
+}
+
+// Clear *valid unless value, and everything inside it, is well-formed; the
+// first pass already bounded the depth and checked the strings
+static void check_value(void *userdata, const char *value, size_t len) {
+    int *valid = userdata;
+    
+    if (!*valid) return;
+    if (value[0] == '{') {
+        if (json_each_member(value, len, check_member, valid) != 0) *valid = 0;
+    } else if (value[0] == '[') {
+        if (json_each_element(value, len, check_value, valid) != 0) *valid = 0;
+    } else if (value[0] != '"' && !scalar_valid(value, len)) {
+        *valid = 0;
+    }
+}
+
+// Caller-supplied arguments must be one well-formed JSON object, since they
+// are spliced into the envelope as they are
+static int args_valid(const char *args, size_t len) {
+    size_t start = 0;
+    int valid = 1;
+    
+    if (!args_balanced(args, len)) return 0;
+    while (isspace((unsigned char)args[start])) start++;
+    check_value(&valid, args + start, len - start);
+    return valid;
+}
+
+// Write ch as it goes inside a JSON string; out has room for 6 bytes
+static size_t json_escape(unsigned char ch, char *out) {
+    static const char hex[] = "0123456789abcdef";
+    
+    if (ch == '"' || ch == '\\') {
+        out[0] = '\\';
+        out[1] = (char)ch;
+        return 2;
+    }
+    if (ch < 0x20) {
+        memcpy(out, "\\u00", 4);
+        out[4] = hex[ch >> 4];
+        out[5] = hex[ch & 15];
+        return 6;
+    }
+    out[0] = (char)ch;
+    return 1;
+}
+
+static int append_json_string(Response *out, const char *str) {
+    char escape[6];
+    
+    if (response_append(out, "\"", 1) != 0) return -1;
+    for (const char *c = str; *c; c++) {
+        size_t n = json_escape((unsigned char)*c, escape);
+        if (response_append(out, escape, n) != 0) return -1;
+    }
+    return response_append(out, "\"", 1);
+}
+
+// Append one tools/call request to out. The fixed envelope is a constant
+// prefix; the arguments are spliced in verbatim after args_valid, so no
+// JSON object tree is built or re-serialized.
+static int append_request_json(Response *out, const char *tool, const char *args, int request_id) {
+    static const char prefix[] = "{\"jsonrpc\":\"2.0\",\"method\":\"tools/call\",\"params\":{\"name\":";
+    char id[32];
+    size_t args_len = strlen(args);
+    
+    if (!args_valid(args, args_len)) return -1;
+    int id_len = snprintf(id, sizeof(id), "},\"id\":%d}", request_id);
+    
+    if (response_append(out, prefix, sizeof(prefix) - 1) != 0) return -1;
+    if (append_json_string(out, tool) != 0) return -1;
+    if (response_append(out, ",\"arguments\":", 13) != 0) return -1;
+    if (response_append(out, args, args_len) != 0) return -1;
+    return response_append(out, id, (size_t)id_len);
+}
+
+static int response_write(void *out, const void *bytes, size_t len) {
+    return response_append(out, bytes, len);
+}
+
+static int append_cbor_text(Response *out, const char *text) {
+    return cbor_write_text(response_write, out, text, strlen(text));
+}
+
+// The same envelope as a CBOR map. Transcoding the arguments checks them as
+// it goes, in place of args_valid.
+static int append_request_cbor(Response *out, const char *tool, const char *args, int request_id) {
+    const char *start = args;
+    
+    while (isspace((unsigned char)*start)) start++;
+    if (*start != '{') return -1;
+    if (cbor_write_head(response_write, out, CBOR_MAP, 4) != 0 ||
+        append_cbor_text(out, "jsonrpc") != 0 || append_cbor_text(out, "2.0") != 0 ||
+        append_cbor_text(out, "method") != 0 || append_cbor_text(out, "tools/call") != 0 ||
+        append_cbor_text(out, "params") != 0 || cbor_write_head(response_write, out, CBOR_MAP, 2) != 0 ||
+        append_cbor_text(out, "name") != 0 || append_cbor_text(out, tool) != 0 ||
+        append_cbor_text(out, "arguments") != 0 || cbor_from_json(response_write, out, args, strlen(args)) != 0) {
+        return -1;
+    }
+    if (append_cbor_text(out, "id") != 0) return -1;
+    return cbor_write_head(response_write, out, CBOR_UINT, (uint64_t)request_id);
+}
+
+static int append_request(Response *out, McpFraming framing, const char *tool, const char *args, int request_id) {
+    if (framing == MCP_FRAMING_CBOR) return append_request_cbor(out, tool, args, request_id);
+    return append_request_json(out, tool, args, request_id);
+}
+
+static int next_request_id(McpClient *client) {
+    if (client->next_id <= 0) client->next_id = 1;
+    return client->next_id++;
+}
+
+// NUM_CONNECTS is the number of new connections this transfer needed;
+// zero means it went out over a cached keep-alive connection.
+static void record_connection(McpClient *client, CURL *curl, CURLcode res) {
+    long new_connects = 0;
+    
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connects);
+    STAT_ADD(client->calls, 1);
+    client->last_reused = (res == CURLE_OK && new_connects == 0);
+    if (new_connects > 0) STAT_ADD(client->reconnects, 1);
+}
+
+static double info_ms(CURL *curl, CURLINFO info) {
+    curl_off_t us = 0;
+    curl_easy_getinfo(curl, info, &us);
+    return us / 1000.0;
+}
+
+// What a finished transfer says about its endpoint. One that failed before
+// it ever had a connection (pretransfer still zero) is a failed connect;
+// a reused connection that times out is the server's fault, not the connect's.
+static CallOutcome call_outcome(CURL *curl, CURLcode res) {
+    long http_status = 0;
+    
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status);
+        return http_status >= 500 ? OUTCOME_FAILED : OUTCOME_OK;
+    }
+    if (res == CURLE_ABORTED_BY_CALLBACK) return OUTCOME_CANCELLED;
+    if ((res == CURLE_COULDNT_CONNECT || res == CURLE_COULDNT_RESOLVE_HOST || res == CURLE_OPERATION_TIMEDOUT) &&
+        info_ms(curl, CURLINFO_PRETRANSFER_TIME_T) <= 0) {
+        return OUTCOME_CONNECT_FAILED;
+    }
+    return OUTCOME_FAILED;
+}
+
+// Fill in curl's phase timers and the wire size; serialize/parse and the
+// decoded size are measured by the caller.
+// offset_ms is how long the call had been running before this transfer
+// began (a hedged second request), so the timers stay relative to the call.
+static void collect_timing(CURL *curl, McpTiming *timing, double offset_ms) {
+    timing->connect_ms = offset_ms + info_ms(curl, CURLINFO_CONNECT_TIME_T);
+    timing->pretransfer_ms = offset_ms + info_ms(curl, CURLINFO_PRETRANSFER_TIME_T);
+    timing->starttransfer_ms = offset_ms + info_ms(curl, CURLINFO_STARTTRANSFER_TIME_T);
+    timing->total_ms = offset_ms + info_ms(curl, CURLINFO_TOTAL_TIME_T);
+    
+    curl_off_t wire = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+    timing->wire_bytes = (uint64_t)wire;
+}
+
+// A call that can be sent again on replay: args is NULL for the ones that
+// cannot, a batched POST or a prompt streamed from a file
+static void record_traffic(McpClient *client, const char *tool, const char *args, const McpTiming *timing,
+                           long http_status, int failed) {
+    double now = mcp_now_ms();
+    
+    if (!client->recorder || !args) return;
+    record_write(client->recorder, tool, args, now - timing->total_ms, timing->total_ms, http_status, failed,
+                 timing->body_bytes);
+}
+
+// What the sampler read over the call's own span, if it samples at all
+static void read_device(McpClient *client, McpTiming *timing) {
+    double now = mcp_now_ms();
+    
+    if (client->telemetry) telemetry_window(client->telemetry, now - timing->total_ms, now, &timing->device);
+}
+
+// Account one finished transfer: connection reuse, the endpoint's health,
+// phase timers and the per-tool histograms.
+static void record_call(McpClient *client, CURL *curl, McpEndpoint *endpoint, const char *tool, const char *args,
+                        CURLcode res, McpTiming *timing, double offset_ms, int rpc_error) {
+    long http_status = 0;
+    
+    record_connection(client, curl, res);
+    collect_timing(curl, timing, offset_ms);
+    if (endpoint) balancer_done(endpoint, call_outcome(curl, res), timing->total_ms, mcp_now_ms());
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status);
+    int failed = res != CURLE_OK || http_status >= 400 || rpc_error;
+    read_device(client, timing);
+    stats_record(client->stats, tool, timing, failed);
+    client->last_timing = *timing;
+    record_traffic(client, tool, args, timing, http_status, failed);
+}
+
+// Transports other than HTTP (transport.h). A frame's tag is the transport
+// session in its top byte, the low 16 bits of the request id, and the pool
+// slot of the call in its low byte; LINK_WAIT_SLOT marks the blocking call.
+#define LINK_WAIT_SLOT 0xff
+
+static uint32_t link_tag(const McpLink *link, int request_id, int slot) {
+    return (link->transport.session & 0xff) << 24 | ((uint32_t)request_id & 0xffff) << 8 | (uint32_t)slot;
+}
+
+static void link_wait(McpLink *link, long timeout_us) {
+    link->transport.ops->wait(&link->transport, timeout_us);
+}
+
+// Whether call goes over the link rather than HTTP
+static int link_carries(const McpClient *client, const McpCall *call) {
+    const McpTransportOps *ops = client->link.transport.ops;
+    return ops && (!call || !call->on_token || ops->streams);
+}
+
+// Streamed calls are always JSON, and CBOR only goes over a link that takes it
+static McpFraming call_framing(const McpClient *client, const McpCall *call) {
+    if (client->framing == MCP_FRAMING_JSON || (call && call->on_token)) return MCP_FRAMING_JSON;
+    if (link_carries(client, call) && !client->link.transport.ops->cbor) return MCP_FRAMING_JSON;
+    return MCP_FRAMING_CBOR;
+}
+
+// Feed a reply frame through the same path as a body received over HTTP
+static void link_deliver(Reply *reply, const McpFrame *frame) {
+    if (!(frame->flags & TRANSPORT_FRAME_CBOR)) {
+        for (int i = 0; i < 2; i++) {
+            if (frame->len[i] > 0) WriteCallback((void *)frame->part[i], 1, frame->len[i], reply);
+        }
+        return;
+    }
+    if (response_append(&reply->body, (const char *)frame->part[0], frame->len[0]) == 0 &&
+        response_append(&reply->body, (const char *)frame->part[1], frame->len[1]) == 0) {
+        reply_decode_cbor(reply);
+    }
+}
+
+// Hand every reply frame that has arrived to the call waiting on it. A
+// frame nobody waits on anymore (its call timed out or was cancelled) is
+// dropped.
+static void link_collect(McpClient *client) {
+    McpLink *link = &client->link;
+    McpFrame frame;
+    
+    while (link->transport.ops->peek(&link->transport, &frame) == 1) {
+        int slot = (int)(frame.tag & 0xff);
+        if (slot == LINK_WAIT_SLOT && link->wait_reply && frame.tag == link->wait_tag && !link->wait_done) {
+            link_deliver(link->wait_reply, &frame);
+            link->wait_done = 1;
+        } else if (slot < MCP_MAX_PARALLEL && link->calls[slot] && frame.tag == link->tags[slot] &&
+                   !link->ready[slot]) {
+            link_deliver(&client->pool_response[slot], &frame);
+            link->ready[slot] = 1;
+        }
+        link->transport.ops->pop(&link->transport, &frame);
+    }
+}
+
+// Stats for a call that went over the link: there is no connect or
+// transfer phase, only the round trip
+static void link_record(McpClient *client, const char *tool, const char *args, CURLcode res, const Reply *reply,
+                        McpTiming *timing, double start_ms, int rpc_error) {
+    timing->total_ms = timing->starttransfer_ms = mcp_now_ms() - start_ms;
+    timing->wire_bytes = timing->body_bytes = res == CURLE_OK ? reply->body.size : 0;
+    timing->parse_ms = reply->parse_ms;
+    STAT_ADD(client->calls, 1);
+    client->last_reused = res == CURLE_OK;
+    read_device(client, timing);
+    stats_record(client->stats, tool, timing, res != CURLE_OK || rpc_error);
+    client->last_timing = *timing;
+    record_traffic(client, tool, args, timing, res == CURLE_OK ? 200 : 0, res != CURLE_OK || rpc_error);
+}
+
+// Post a request frame. A full transport drains as fast as the server
+// reads it, so that is waited out up to give_up_ms; -1 for a frame that can
+// never be sent, 1 when time ran out.
+static int link_send(McpLink *link, uint32_t tag, int cbor, const Response *request, double give_up_ms) {
+    McpTransport *transport = &link->transport;
+    int sent;
+    
+    while ((sent = transport->ops->send(transport, tag, cbor ? TRANSPORT_FRAME_CBOR : 0, request->data,
+                                        request->size)) == 1 && mcp_now_ms() < give_up_ms) {
+        link_wait(link, MCP_LINK_POLL_US);
+    }
+    return sent;
+}
+
+// Blocking round trip of one request frame; the reply lands in reply
+static CURLcode link_exchange(McpClient *client, const Response *request, Reply *reply, int request_id,
+                              int cbor, double deadline_ms) {
+    McpLink *link = &client->link;
+    uint32_t tag = link_tag(link, request_id, LINK_WAIT_SLOT);
+    double give_up_ms = mcp_now_ms() + deadline_ms;
+    
+    if (!link->transport.ops->alive(&link->transport)) return CURLE_COULDNT_CONNECT;
+    int sent = link_send(link, tag, cbor, request, give_up_ms);
+    if (sent != 0) return sent < 0 ? CURLE_SEND_ERROR : CURLE_OPERATION_TIMEDOUT;
+    
+    link->wait_tag = tag;
+    link->wait_reply = reply;
+    link->wait_done = 0;
+    for (;;) {
+        link_collect(client);
+        if (link->wait_done || mcp_now_ms() >= give_up_ms) break;
+        if (!link->transport.ops->alive(&link->transport)) break;
+        double left_ms = give_up_ms - mcp_now_ms();
+        link_wait(link, (long)((left_ms < MCP_LINK_CHECK_MS ? left_ms : MCP_LINK_CHECK_MS) * 1000) + 1);
+    }
+    link->wait_reply = NULL;
+    if (link->wait_done) return CURLE_OK;
+    return mcp_now_ms() >= give_up_ms ? CURLE_OPERATION_TIMEDOUT : CURLE_COULDNT_CONNECT;
+}
+
+static int link_call_tool(McpClient *client, const char *tool, const char *args, McpReply *reply) {
+    McpTiming timing = {0};
+    
+    begin_call(&client->arena, &client->request, &client->response);
+    if (cache_hit(client, tool, args, &client->response)) {
+        reply_view(&client->response, reply);
+        reply->cached = 1;
+        return 0;
+    }
+    
+    double start = mcp_now_ms();
+    int id = next_request_id(client);
+    McpFraming framing = call_framing(client, NULL);
+    response_reset(&client->request);
+    if (append_request(&client->request, framing, tool, args, id) != 0) return -1;
+    timing.serialize_ms = mcp_now_ms() - start;
+    
+    reply_reset(&client->response);
+    double sent_ms = mcp_now_ms();
+    CURLcode res = link_exchange(client, &client->request, &client->response, id,
+                                 framing == MCP_FRAMING_CBOR, mcp_tool_deadline_ms(client, tool));
+    cache_settle(client, tool, args, &client->response, res, res == CURLE_OK ? 200 : 0);
+    timing.arena_bytes = client->arena.used;
+    int rpc_error = res == CURLE_OK && reply_failed(&client->response);
+    link_record(client, tool, args, res, &client->response, &timing, sent_ms, rpc_error);
+    
+    reply_view(&client->response, reply);
+    return res == CURLE_OK ? 0 : -1;
+}
+
+int call_mcp_tool(McpClient *client, const char *tool, const char *args, McpReply *reply) {
+    CURLcode res;
+    McpTiming timing = {0};
+    int rpc_error = 0;
+    
+    if (client->link.transport.ops) return link_call_tool(client, tool, args, reply);
+    if (!main_handle(client)) return -1;
+    begin_call(&client->arena, &client->request, &client->response);
+    
+    if (cache_hit(client, tool, args, &client->response)) {
+        reply_view(&client->response, reply);
+        reply->cached = 1;
+        return 0;
+    }
+    
+    double serialize_start = mcp_now_ms();
+    response_reset(&client->request);
+    if (append_request(&client->request, client->framing, tool, args, next_request_id(client)) != 0) return -1;
+    timing.serialize_ms = mcp_now_ms() - serialize_start;
+    
+    McpEndpoint *endpoint = pick_endpoint(client, client->curl, pinned_tool(tool), 0);
+    if (!endpoint) return -1;
+    reply_reset(&client->response);
+    curl_easy_setopt(client->curl, CURLOPT_TIMEOUT_MS, (long)mcp_tool_deadline_ms(client, tool));
+    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDS, client->request.data);
+    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDSIZE, (long)client->request.size);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEDATA, &client->response);
+    cache_prepare(client, client->curl, tool, args, &client->response);
+    
+    res = curl_easy_perform(client->curl);
+    reply_arrived(&client->response, client->curl, res);
+    int cached = cache_complete(client, client->curl, tool, args, &client->response, res);
+    if (res == CURLE_OK) {
+        rpc_error = reply_failed(&client->response);
+        timing.parse_ms = client->response.parse_ms;
+        // A 304 reply was refilled from the cache; none of it was received
+        if (!cached) timing.body_bytes = client->response.body.size;
+    }
+    timing.arena_bytes = client->arena.used;
+    record_call(client, client->curl, endpoint, tool, args, res, &timing, 0, rpc_error);
+    
+    reply_view(&client->response, reply);
+    reply->cached = cached;
+    
+    return (res == CURLE_OK) ? 0 : -1;
+}
+
+// Flush an event the server terminated without a trailing blank line, and
+// treat a plain body that never completed as an error
+static void stream_finish(Stream *stream, CURLcode res) {
+    if (res == CURLE_OK && stream->sse == 1) {
+        if (stream->line.size > 0) stream_line(stream, stream->line.data, stream->line.size);
+        stream_dispatch(stream);
+    } else if (res == CURLE_OK && (stream->raw || !stream->scan.complete)) {
+        stream->rpc_error = 1;
+    }
+}
+
+static void stream_free(Stream *stream) {
+    response_free(&stream->line);
+    response_free(&stream->data);
+    json_scan_free(&stream->scan);
+}
+
+static void stream_use_arena(Stream *stream, Arena *arena) {
+    response_use_arena(&stream->line, arena);
+    response_use_arena(&stream->data, arena);
+    json_scan_use_arena(&stream->scan, arena);
+}
+
+static void stream_report(const Stream *stream) {
+    if (stream->tokens > 0) {
+        printf("\nFirst frame: %.1f ms, total: %.1f ms (%zu chunks)\n",
+               stream->first_token_ms - stream->start_ms, mcp_now_ms() - stream->start_ms, stream->tokens);
+    } else if (stream->shown) {
+        printf("\n");
+    }
+}
+
+int call_mcp_tool_stream(McpClient *client, const char *tool, const char *args) {
+    CURLcode res;
+    Stream stream = {0};
+    McpTiming timing = {0};
+    
+    if (!main_handle(client)) return -1;
+    begin_call(&client->arena, &client->request, &client->response);
+    stream_use_arena(&stream, &client->arena);
+    
+    double serialize_start = mcp_now_ms();
+    response_reset(&client->request);
+    if (append_request(&client->request, MCP_FRAMING_JSON, tool, args, next_request_id(client)) != 0) return -1;
+    timing.serialize_ms = mcp_now_ms() - serialize_start;
+    
+    McpEndpoint *endpoint = pick_endpoint(client, client->curl, pinned_tool(tool), 0);
+    if (!endpoint) return -1;
+    
+    stream.curl = client->curl;
+    stream.sse = -1;
+    
+    curl_easy_setopt(client->curl, CURLOPT_TIMEOUT_MS, (long)mcp_tool_deadline_ms(client, tool));
+    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDS, client->request.data);
+    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDSIZE, (long)client->request.size);
+    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->stream_headers);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEDATA, &stream);
+    
+    stream.start_ms = mcp_now_ms();
+    res = curl_easy_perform(client->curl);
+    stream_finish(&stream, res);
+    timing.parse_ms = stream.parse_ms;
+    timing.body_bytes = stream.received;
+    timing.arena_bytes = client->arena.used;
+    record_call(client, client->curl, endpoint, tool, args, res, &timing, 0, stream.rpc_error);
+    
+    stream_report(&stream);
+    
+    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->headers);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    stream_free(&stream);
+    
+    return (res == CURLE_OK) ? 0 : -1;
+}
+
+// Body of call_mcp_generate_from: the request envelope around the prompt,
+// which is read and escaped one window at a time as curl asks for more
+typedef struct {
+    FILE *in;
+    unsigned char *raw;
+    char *out;
+    size_t chunk;           // prompt bytes per refill; escaped, they fit in the window
+    size_t len, pos;        // of out
+    int part;               // 0 envelope head, 1 prompt, 2 envelope tail, 3 all sent
+    char tail[32];
+} PromptBody;
+
+static const char prompt_head[] =
+    "{\"jsonrpc\":\"2.0\",\"method\":\"tools/call\",\"params\":{\"name\":\"generate\",\"arguments\":{\"prompt\":\"";
+    
+static int prompt_refill(PromptBody *body) {
+    body->pos = body->len = 0;
+    if (body->part == 0) {
+        memcpy(body->out, prompt_head, sizeof(prompt_head) - 1);
+        body->len = sizeof(prompt_head) - 1;
+        body->part = 1;
+        return 0;
+    }
+    if (body->part == 1) {
+        size_t n = fread(body->raw, 1, body->chunk, body->in);
+        for (size_t i = 0; i < n; i++) body->len += json_escape(body->raw[i], body->out + body->len);
+        if (n > 0) return 0;
+        if (ferror(body->in)) return -1;
+        body->part = 2;
+    }
+    body->len = strlen(body->tail);
+    memcpy(body->out, body->tail, body->len);
+    body->part = 3;
+    return 0;
+}
+
+static size_t PromptReadCallback(char *dest, size_t size, size_t nitems, void *userdata) {
+    PromptBody *body = userdata;
+    size_t max = size * nitems, copied = 0;
+    
+    while (copied < max) {
+        if (body->pos == body->len) {
+            if (body->part == 3) break;
+            if (prompt_refill(body) != 0) return CURL_READFUNC_ABORT;
+            continue;
+        }
+        size_t n = body->len - body->pos;
+        if (n > max - copied) n = max - copied;
+        memcpy(dest + copied, body->out + body->pos, n);
+        body->pos += n;
+        copied += n;
+    }
+    return copied;
+}
+
+// Length of the whole body when the prompt is a regular file, found by
+// reading it through once; -1 for a pipe, which goes out chunked
+static int prompt_body_size(PromptBody *body, curl_off_t *size) {
+    struct stat st;
+    char escape[6];
+    off_t start = ftello(body->in);
+    size_t n;
+    
+    *size = -1;
+    if (start < 0 || fstat(fileno(body->in), &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+    curl_off_t total = (curl_off_t)(sizeof(prompt_head) - 1 + strlen(body->tail));
+    while ((n = fread(body->raw, 1, body->chunk, body->in)) > 0) {
+        for (size_t i = 0; i < n; i++) total += (curl_off_t)json_escape(body->raw[i], escape);
+    }
+    if (ferror(body->in) || fseeko(body->in, start, SEEK_SET) != 0) return -1;
+    *size = total;
+    return 0;
+}
+
+static struct curl_slist *upload_headers(void) {
+    static const char *const lines[] = {
+        "Content-Type: application/json", "Accept: text/event-stream",
+        // No 100-continue round trip before a body of unknown length
+        "Expect:",
+    };
+    struct curl_slist *headers = NULL;
+    
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        struct curl_slist *next = curl_slist_append(headers, lines[i]);
+        if (!next) {
+            curl_slist_free_all(headers);
+            return NULL;
+        }
+        headers = next;
+    }
+    return headers;
+}
+
+static int generate_upload(McpClient *client, PromptBody *body, struct curl_slist *headers, curl_off_t size) {
+    CURLcode res;
+    Stream stream = {0};
+    McpTiming timing = {0};
+    
+    begin_call(&client->arena, &client->request, &client->response);
+    stream_use_arena(&stream, &client->arena);
+    McpEndpoint *endpoint = pick_endpoint(client, client->curl, pinned_tool("generate"), 0);
+    if (!endpoint) return -1;
+    
+    stream.curl = client->curl;
+    stream.sse = -1;
+    
+    curl_easy_setopt(client->curl, CURLOPT_TIMEOUT_MS, (long)mcp_tool_deadline_ms(client, "generate"));
+    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDS, NULL);
+    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDSIZE_LARGE, size);
+    curl_easy_setopt(client->curl, CURLOPT_READFUNCTION, PromptReadCallback);
+    curl_easy_setopt(client->curl, CURLOPT_READDATA, body);
+    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEDATA, &stream);
+    
+    stream.start_ms = mcp_now_ms();
+    res = curl_easy_perform(client->curl);
+    stream_finish(&stream, res);
+    timing.parse_ms = stream.parse_ms;
+    timing.body_bytes = stream.received;
+    timing.arena_bytes = client->arena.used;
+    record_call(client, client->curl, endpoint, "generate", NULL, res, &timing, 0, stream.rpc_error);
+    stream_report(&stream);
+    if (res != CURLE_OK) printf("\nError: %s\n", curl_easy_strerror(res));
+    
+    // Later calls post from memory again
+    curl_easy_setopt(client->curl, CURLOPT_READFUNCTION, NULL);
+    curl_easy_setopt(client->curl, CURLOPT_READDATA, stdin);
+    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->headers);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    stream_free(&stream);
+    
+    return (res == CURLE_OK && !stream.rpc_error) ? 0 : -1;
+}
+
+int call_mcp_generate_from(McpClient *client, FILE *in, size_t window) {
+    PromptBody body = {0};
+    curl_off_t size;
+    int status = -1;
+    
+    if (!main_handle(client)) return -1;
+    if (window < MCP_IO_WINDOW_MIN) window = MCP_IO_WINDOW_MIN;
+    body.in = in;
+    body.chunk = window / 6;
+    body.raw = malloc(body.chunk);
+    body.out = malloc(window);
+    snprintf(body.tail, sizeof(body.tail), "\"}},\"id\":%d}", next_request_id(client));
+    
+    struct curl_slist *headers = upload_headers();
+    if (body.raw && body.out && headers && prompt_body_size(&body, &size) == 0) {
+        status = generate_upload(client, &body, headers, size);
+    }
+    curl_slist_free_all(headers);
+    free(body.raw);
+    free(body.out);
+    return status;
+}
+
+static int WatchProgress(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    Stream *stream = clientp;
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+    return (stream->idle && stream->idle(stream->userdata)) ? 1 : 0;
+}
+
+int mcp_watch(McpClient *client, const char *tool, double interval_s,
+              McpWatchEvent on_event, McpWatchIdle idle, void *userdata) {
+    Stream stream = {0};
+    CURLcode res;
+    char url[512];
+    
+    CURL *curl = new_handle(client);
+    if (!curl) return -1;
+    char *name = curl_easy_escape(curl, tool, 0);
+    if (!name) {
+        curl_easy_cleanup(curl);
+        return -1;
+    }
+    McpEndpoint *endpoint = balancer_pick(&client->balancer, 1, 0, mcp_now_ms());
+    snprintf(url, sizeof(url), "%s/watch?tool=%s&interval=%g", endpoint ? endpoint->url : client->url,
+             name, interval_s);
+    curl_free(name);
+    
+    stream.curl = curl;
+    stream.sse = -1;
+    stream.on_event = on_event;
+    stream.idle = idle;
+    stream.userdata = userdata;
+    
+    setup_handle(client, curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->stream_headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, WatchProgress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &stream);
+    
+    res = curl_easy_perform(curl);
+    if (res == CURLE_OK && stream.line.size > 0) stream_line(&stream, stream.line.data, stream.line.size);
+    if (res == CURLE_OK) stream_dispatch(&stream);
+    
+    // Stopping from either callback aborts the transfer; that is not a failure
+    int status = (res == CURLE_OK || res == CURLE_ABORTED_BY_CALLBACK ||
+                  (res == CURLE_WRITE_ERROR && stream.stop)) ? 0 : -1;
+                  
+    curl_easy_cleanup(curl);
+    stream_free(&stream);
+    return status;
+}
+
+// Progress ticks come at least once a second, so a cancel takes effect
+// promptly even while the server is silent
+static int CallProgress(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    const McpCall *call = clientp;
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+    return call->cancel ? 1 : 0;
+}
+
+// Calls over a link only need the slot's buffers, not its handle
+static int acquire_slot(McpClient *client, int with_handle) {
+    for (int i = 0; i < MCP_MAX_PARALLEL; i++) {
+        if (client->pool_busy[i]) continue;
+        if (with_handle && !client->pool[i]) {
+            client->pool[i] = new_handle(client);
+            if (!client->pool[i]) return -1;
+            setup_handle(client, client->pool[i]);
+        }
+        client->pool_busy[i] = 1;
+        return i;
+    }
+    return -1;
+}
+
+// Tear down a streamed call's state and put the handle back to plain calls.
+// Returns whether the stream ended in a JSON-RPC error.
+static int finish_stream(McpClient *client, CURL *curl, McpCall *call, CURLcode res) {
+    Stream *stream = call->stream;
+    
+    if (!stream) return 0;
+    stream_finish(stream, res);
+    int rpc_error = stream->rpc_error;
+    call->timing.parse_ms = stream->parse_ms;
+    call->timing.body_bytes = stream->received;
+    call->first_token_ms = stream->first_token_ms;
+    call->tokens = stream->tokens;
+    stream_free(stream);
+    call->stream = NULL;
+    
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    return rpc_error;
+}
+
+static double call_deadline_ms(const McpClient *client, const McpCall *call) {
+    return call->deadline_ms > 0 ? call->deadline_ms : mcp_tool_deadline_ms(client, call->tool);
+}
+
+// The cacheable tools are exactly the read-only ones, so they are the ones
+// safe to send twice. Returns 0 when the call is not hedged.
+static double hedge_threshold_ms(McpClient *client, const McpCall *call) {
+    if (client->hedge_percentile <= 0 || call->on_token || cache_ttl_ms(call->tool) <= 0) return 0;
+    
+    const Histogram *total = &stats_tool(client->stats, call->tool)->phase[STAT_TOTAL];
+    if (total->count < MCP_HEDGE_MIN_SAMPLES) return 0;
+    double threshold_ms = hist_percentile(total, client->hedge_percentile) / 1000.0;
+    return threshold_ms < call_deadline_ms(client, call) ? threshold_ms : 0;
+}
+
+// Post the request frame of a parallel call; link_finish reports it
+static int start_link_call(McpClient *client, McpCall *call, int slot, int request_id, int cbor) {
+    McpLink *link = &client->link;
+    const Response *request = &client->pool_request[slot];
+    uint32_t tag = link_tag(link, request_id, slot);
+    
+    memset(&call->reply, 0, sizeof(call->reply));
+    reply_reset(&client->pool_response[slot]);
+    call->first_token_ms = 0;
+    call->tokens = 0;
+    call->stream = NULL;
+    call->start_ms = mcp_now_ms();
+    int sent = link->transport.ops->alive(&link->transport) ?
+               link_send(link, tag, cbor, request, call->start_ms + call_deadline_ms(client, call)) : 1;
+    if (sent != 0) {
+        client->pool_busy[slot] = 0;
+        return sent < 0 ? -4 : -3;
+    }
+    link->calls[slot] = call;
+    link->tags[slot] = tag;
+    link->ready[slot] = 0;
+    link->pending++;
+    return 0;
+}
+
+// Returns 0 once the transfer is running, 1 if a fresh cache entry answered
+// the call already, -2 for invalid arguments, -3 while connects are backing
+// off (or the link's server is gone or stays full), -4 for a request the
+// link can never carry and -1 for other failures
+static int start_call(McpClient *client, McpCall *call) {
+    int linked = link_carries(client, call);
+    int slot = acquire_slot(client, !linked);
+    if (slot < 0) return -1;
+    
+    CURL *curl = client->pool[slot];
+    begin_call(&client->pool_arena[slot], &client->pool_request[slot], &client->pool_response[slot]);
+    call->slot = slot;
+    call->endpoint = NULL;
+    call->hedge_slot = -1;
+    call->hedge_endpoint = NULL;
+    call->hedge_at_ms = 0;
+    call->hedged = 0;
+    memset(&call->timing, 0, sizeof(call->timing));
+    
+    if (cache_hit(client, call->tool, call->args, &client->pool_response[slot])) return 1;
+    
+    double serialize_start = mcp_now_ms();
+    Response *request = &client->pool_request[slot];
+    response_reset(request);
+    McpFraming framing = call_framing(client, call);
+    int request_id = next_request_id(client);
+    if (append_request(request, framing, call->tool, call->args, request_id) != 0) {
+        client->pool_busy[slot] = 0;
+        return -2;
+    }
+    call->timing.serialize_ms = mcp_now_ms() - serialize_start;
+    if (linked) return start_link_call(client, call, slot, request_id, framing == MCP_FRAMING_CBOR);
+    
+    call->endpoint = pick_endpoint(client, curl, pinned_tool(call->tool), call->affinity);
+    if (!call->endpoint) {
+        client->pool_busy[slot] = 0;
+        return -3;
+    }
+    memset(&call->reply, 0, sizeof(call->reply));
+    reply_reset(&client->pool_response[slot]);
+    call->first_token_ms = 0;
+    call->tokens = 0;
+    call->stream = NULL;
+    
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)call_deadline_ms(client, call));
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->data);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)request->size);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &client->pool_response[slot]);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, call);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CallProgress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, call);
+    cache_prepare(client, curl, call->tool, call->args, &client->pool_response[slot]);
+    
+    if (call->on_token) {
+        Stream *stream = arena_alloc(&client->pool_arena[slot], sizeof(Stream));
+        if (!stream) {
+            balancer_done(call->endpoint, OUTCOME_CANCELLED, 0, 0);
+            client->pool_busy[slot] = 0;
+            return -1;
+        }
+        memset(stream, 0, sizeof(*stream));
+        stream_use_arena(stream, &client->pool_arena[slot]);
+        stream->curl = curl;
+        stream->sse = -1;
+        stream->call = call;
+        call->stream = stream;
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->stream_headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, stream);
+    }
+    
+    call->start_ms = mcp_now_ms();
+    if (curl_multi_add_handle(client->multi, curl) != CURLM_OK) {
+        finish_stream(client, curl, call, CURLE_FAILED_INIT);
+        balancer_done(call->endpoint, OUTCOME_CANCELLED, 0, 0);
+        client->pool_busy[slot] = 0;
+        return -1;
+    }
+    double threshold_ms = hedge_threshold_ms(client, call);
+    if (threshold_ms > 0) call->hedge_at_ms = call->start_ms + threshold_ms;
+    return 0;
+}
+
+// Put a pool handle that will not be reported back to plain-call state
+static void drop_copy(McpClient *client, int slot) {
+    CURL *curl = client->pool[slot];
+    Reply *reply = &client->pool_response[slot];
+    
+    curl_multi_remove_handle(client->multi, curl);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+    if (reply->headers) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->headers);
+        reply->headers = NULL;
+    }
+    client->pool_busy[slot] = 0;
+}
+
+// Send the same request again on another handle, with what is left of the
+// call's deadline. Each call is hedged at most once.
+static void start_hedge(McpClient *client, McpCall *call) {
+    call->hedge_at_ms = 0;
+    int slot = acquire_slot(client, 1);
+    if (slot < 0) return;
+    
+    CURL *curl = client->pool[slot];
+    Response *request = &client->pool_request[slot];
+    const Response *original = &client->pool_request[call->slot];
+    long remaining_ms = (long)(call->start_ms + call_deadline_ms(client, call) - mcp_now_ms());
+    begin_call(&client->pool_arena[slot], request, &client->pool_response[slot]);
+    if (remaining_ms <= 0 || response_append(request, original->data, original->size) != 0) {
+        client->pool_busy[slot] = 0;
+        return;
+    }
+    McpEndpoint *endpoint = pick_endpoint(client, curl, pinned_tool(call->tool), 0);
+    if (!endpoint) {
+        client->pool_busy[slot] = 0;
+        return;
+    }
+    
+    reply_reset(&client->pool_response[slot]);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, remaining_ms);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->data);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)request->size);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &client->pool_response[slot]);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, call);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CallProgress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, call);
+    cache_prepare(client, curl, call->tool, call->args, &client->pool_response[slot]);
+    
+    if (curl_multi_add_handle(client->multi, curl) != CURLM_OK) {
+        drop_copy(client, slot);
+        balancer_done(endpoint, OUTCOME_CANCELLED, 0, 0);
+        return;
+    }
+    call->hedge_slot = slot;
+    call->hedge_endpoint = endpoint;
+    call->hedge_start_ms = mcp_now_ms();
+    call->hedged = 1;
+    STAT_ADD(client->hedges, 1);
+}
+
+// Start the hedges that are due. Returns how long to wait for the next one,
+// at most timeout_ms.
+static int schedule_hedges(McpClient *client, int timeout_ms) {
+    double now = mcp_now_ms();
+    
+    if (client->hedge_percentile <= 0) return timeout_ms;
+    for (int i = 0; i < MCP_MAX_PARALLEL; i++) {
+        McpCall *call = NULL;
+        if (!client->pool_busy[i] || client->link.calls[i]) continue;
+        curl_easy_getinfo(client->pool[i], CURLINFO_PRIVATE, (char **)&call);
+        if (!call || call->slot != i || call->hedge_at_ms <= 0) continue;
+        if (call->hedge_at_ms <= now) {
+            start_hedge(client, call);
+        } else if (call->hedge_at_ms - now < timeout_ms) {
+            timeout_ms = (int)(call->hedge_at_ms - now) + 1;
+        }
+    }
+    return timeout_ms;
+}
+
+// Settle which copy of a hedged call answers it. A copy that failed on its
+// own leaves the other running (returns 1); the first good answer, or a
+// cancel, takes over the call and drops the other copy.
+static int settle_hedge(McpClient *client, McpCall *call, int slot, CURLcode res, double *offset_ms) {
+    int primary = slot == call->slot;
+    int other = primary ? call->hedge_slot : call->slot;
+    McpEndpoint *endpoint = primary ? call->endpoint : call->hedge_endpoint;
+    McpEndpoint *other_endpoint = primary ? call->hedge_endpoint : call->endpoint;
+    
+    call->hedge_slot = -1;
+    call->hedge_endpoint = NULL;
+    if (res != CURLE_OK && res != CURLE_ABORTED_BY_CALLBACK) {
+        CURL *curl = client->pool[slot];
+        balancer_done(endpoint, call_outcome(curl, res), info_ms(curl, CURLINFO_TOTAL_TIME_T), mcp_now_ms());
+        drop_copy(client, slot);
+        call->slot = other;
+        call->endpoint = other_endpoint;
+        return 1;
+    }
+    drop_copy(client, other);
+    balancer_done(other_endpoint, OUTCOME_CANCELLED, 0, 0);
+    if (!primary) {
+        STAT_ADD(client->hedge_wins, 1);
+        *offset_ms = call->hedge_start_ms - call->start_ms;
+    }
+    call->slot = slot;
+    call->endpoint = endpoint;
+    return 0;
+}
+
+// Returns 1 while the other copy of a hedged call is still running
+static int finish_call(McpClient *client, CURL *curl, CURLcode res, McpCallDone on_done, void *userdata) {
+    McpCall *call = NULL;
+    double offset_ms = 0;
+    int slot = 0;
+    
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&call);
+    while (client->pool[slot] != curl) slot++;
+    if (call->hedge_slot >= 0) {
+        if (settle_hedge(client, call, slot, res, &offset_ms)) return 1;
+    }
+    curl_multi_remove_handle(client->multi, curl);
+    
+    STAT_SUB(client->inflight, 1);
+    if (res != CURLE_OK) STAT_ADD(client->failures, 1);
+    Reply *reply = &client->pool_response[call->slot];
+    if (!call->stream) reply_arrived(reply, curl, res);
+    int cached = cache_complete(client, curl, call->tool, call->args, reply, res);
+    int rpc_error = 0;
+    int streamed = call->stream != NULL;
+    if (streamed) {
+        rpc_error = finish_stream(client, curl, call, res);
+    } else if (res == CURLE_OK) {
+        rpc_error = reply_failed(reply);
+        call->timing.parse_ms = reply->parse_ms;
+        if (!cached) call->timing.body_bytes = reply->body.size;
+    }
+    call->timing.arena_bytes = client->pool_arena[call->slot].used;
+    record_call(client, curl, call->endpoint, call->tool, call->args, res, &call->timing, offset_ms, rpc_error);
+    
+    call->res = res;
+    call->end_ms = mcp_now_ms();
+    call->http_status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &call->http_status);
+    call->reused = client->last_reused;
+    reply_view(reply, &call->reply);
+    call->reply.cached = cached;
+    if (streamed) call->reply.is_error = rpc_error;
+    if (on_done) on_done(call, userdata);
+    
+    memset(&call->reply, 0, sizeof(call->reply));
+    client->pool_busy[call->slot] = 0;
+    return 0;
+}
+
+static void finish_cached_call(McpClient *client, McpCall *call, McpCallDone on_done, void *userdata) {
+    call->res = CURLE_OK;
+    call->http_status = 200;
+    call->reused = 0;
+    call->start_ms = call->end_ms = mcp_now_ms();
+    reply_view(&client->pool_response[call->slot], &call->reply);
+    call->reply.cached = 1;
+    if (on_done) on_done(call, userdata);
+    
+    memset(&call->reply, 0, sizeof(call->reply));
+    client->pool_busy[call->slot] = 0;
+}
+
+static void fail_call(McpCall *call, CURLcode res, McpCallDone on_done, void *userdata) {
+    call->res = res;
+    call->http_status = 0;
+    call->reused = 0;
+    memset(&call->reply, 0, sizeof(call->reply));
+    call->start_ms = call->end_ms = mcp_now_ms();
+    if (on_done) on_done(call, userdata);
+}
+
+// A link answers a streamed call in one piece; its text goes to on_token
+// word by word, the way a server streaming tokens would send it, and the
+// reply text is left empty as over HTTP
+static void link_stream_text(McpCall *call) {
+    const char *text = call->reply.text.data;
+    size_t len = call->reply.text.size;
+    
+    for (size_t at = 0; at < len;) {
+        size_t end = at;
+        while (end < len && text[end] == ' ') end++;
+        while (end < len && text[end] != ' ') end++;
+        if (call->tokens == 0 && !call->first_token_ms) call->first_token_ms = mcp_now_ms();
+        call->on_token(call, text + at, end - at);
+        call->tokens++;
+        at = end;
+    }
+    call->reply.text.data = "";
+    call->reply.text.size = 0;
+}
+
+static void link_error_out(void *userdata, const char *text, size_t len) {
+    McpCall *call = userdata;
+    call->on_token(call, text, len);
+}
+
+// An error reply goes to on_token as stream_emit_error sends it over HTTP:
+// one chunk, reply.is_error set, not counted as a token
+static void link_stream_error(McpCall *call) {
+    emit_error(call->reply.error_code, call->reply.message.data, call->reply.message.size, link_error_out, call);
+}
+
+// Report the link calls that got their reply, ran out of time, were
+// cancelled or lost their server
+static void link_finish(McpClient *client, McpCallDone on_done, void *userdata) {
+    McpLink *link = &client->link;
+    double now = mcp_now_ms();
+    int server_alive = -1;
+    
+    for (int slot = 0; slot < MCP_MAX_PARALLEL && link->pending > 0; slot++) {
+        McpCall *call = link->calls[slot];
+        if (!call) continue;
+        CURLcode res = CURLE_OK;
+        if (!link->ready[slot]) {
+            if (call->cancel) {
+                res = CURLE_ABORTED_BY_CALLBACK;
+            } else if (now - call->start_ms >= call_deadline_ms(client, call)) {
+                res = CURLE_OPERATION_TIMEDOUT;
+            } else {
+                if (server_alive < 0) server_alive = link->transport.ops->alive(&link->transport);
+                if (server_alive) continue;
+                res = CURLE_COULDNT_CONNECT;
+            }
+        }
+        link->calls[slot] = NULL;
+        link->tags[slot] = 0;
+        link->ready[slot] = 0;
+        link->pending--;
+        STAT_SUB(client->inflight, 1);
+        if (res != CURLE_OK) STAT_ADD(client->failures, 1);
+        
+        Reply *reply = &client->pool_response[slot];
+        int rpc_error = res == CURLE_OK && reply_failed(reply);
+        int cached = cache_settle(client, call->tool, call->args, reply, res, res == CURLE_OK ? 200 : 0);
+        call->timing.arena_bytes = client->pool_arena[slot].used;
+        link_record(client, call->tool, call->args, res, reply, &call->timing, call->start_ms, rpc_error);
+        
+        call->res = res;
+        call->end_ms = mcp_now_ms();
+        call->http_status = res == CURLE_OK ? 200 : 0;
+        call->reused = res == CURLE_OK;
+        reply_view(reply, &call->reply);
+        call->reply.cached = cached;
+        if (call->on_token && res == CURLE_OK) {
+            if (call->reply.is_error) link_stream_error(call);
+            else link_stream_text(call);
+        }
+        if (on_done) on_done(call, userdata);
+        
+        memset(&call->reply, 0, sizeof(call->reply));
+        client->pool_busy[slot] = 0;
+    }
+}
+
+static int ensure_multi(McpClient *client) {
+    if (!client->multi && global_ready(client) == 0) client->multi = curl_multi_init();
+    return client->multi ? 0 : -1;
+}
+
+int mcp_call_start(McpClient *client, McpCall *call, McpCallDone on_done, void *userdata) {
+    int started = link_carries(client, call) || ensure_multi(client) == 0 ? start_call(client, call) : -1;
+    
+    if (started == 1) {
+        finish_cached_call(client, call, on_done, userdata);
+        return 0;
+    }
+    if (started != 0) {
+        CURLcode res = started == -2 ? CURLE_BAD_FUNCTION_ARGUMENT :
+                       started == -3 ? CURLE_COULDNT_CONNECT :
+                       started == -4 ? CURLE_SEND_ERROR : CURLE_FAILED_INIT;
+        fail_call(call, res, on_done, userdata);
+        STAT_ADD(client->failures, 1);
+        return -1;
+    }
+    STAT_ADD(client->inflight, 1);
+    return 0;
+}
+
+// With more than one endpoint, each gets a GET /health every
+// MCP_HEALTH_INTERVAL_MS, run on the multi handle alongside the calls
+static void schedule_probes(McpClient *client) {
+    double now = mcp_now_ms();
+    
+    if (client->balancer.count < 2 || now < client->next_probe_ms) return;
+    client->next_probe_ms = now + MCP_HEALTH_INTERVAL_MS;
+    for (size_t i = 0; i < client->balancer.count; i++) {
+        if (client->probe_busy[i]) continue;
+        if (!client->probes[i]) {
+            if (!(client->probes[i] = new_handle(client))) continue;
+            setup_probe(client, i);
+        }
+        if (curl_multi_add_handle(client->multi, client->probes[i]) == CURLM_OK) {
+            client->probe_busy[i] = 1;
+            client->probing++;
+        }
+    }
+}
+
+// Returns 0 if curl is not a probe
+static int finish_probe(McpClient *client, CURL *curl, CURLcode res) {
+    long http_status = 0;
+    
+    for (size_t i = 0; i < client->balancer.count; i++) {
+        if (client->probes[i] != curl || !client->probe_busy[i]) continue;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status);
+        curl_multi_remove_handle(client->multi, curl);
+        client->probe_busy[i] = 0;
+        client->probing--;
+        balancer_probe_done(&client->balancer.endpoints[i], res == CURLE_OK && http_status == 200, mcp_now_ms());
+        return 1;
+    }
+    return 0;
+}
+
+static int drive_calls(McpClient *client, McpCallDone on_done, void *userdata) {
+    CURLMsg *msg;
+    int running = 0, queued;
+    
+    if (curl_multi_perform(client->multi, &running) != CURLM_OK) return -1;
+    while ((msg = curl_multi_info_read(client->multi, &queued))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        if (finish_probe(client, msg->easy_handle, msg->data.result)) continue;
+        finish_call(client, msg->easy_handle, msg->data.result, on_done, userdata);
+    }
+    return 0;
+}
+
+// Descriptors mcp_call_poll can wait on without libcurl: the caller's and
+// the link's
+#define POLL_FDS 5
+
+// Before the first parallel call there is nothing for libcurl to do, so the
+// caller's descriptors are waited on directly and libcurl stays untouched
+static int wait_extra(struct curl_waitfd *extra, unsigned nextra, int timeout_ms) {
+    struct pollfd fds[POLL_FDS];
+    
+    for (unsigned i = 0; i < nextra; i++) {
+        fds[i].fd = extra[i].fd;
+        fds[i].events = (extra[i].events & CURL_WAIT_POLLIN ? POLLIN : 0) |
+                        (extra[i].events & CURL_WAIT_POLLPRI ? POLLPRI : 0) |
+                        (extra[i].events & CURL_WAIT_POLLOUT ? POLLOUT : 0);
+    }
+    if (poll(fds, nextra, timeout_ms) < 0) return -1;
+    for (unsigned i = 0; i < nextra; i++) {
+        extra[i].revents = (fds[i].revents & (POLLIN | POLLHUP | POLLERR) ? CURL_WAIT_POLLIN : 0) |
+                           (fds[i].revents & POLLPRI ? CURL_WAIT_POLLPRI : 0) |
+                           (fds[i].revents & POLLOUT ? CURL_WAIT_POLLOUT : 0);
+    }
+    return 0;
+}
+
+// The link's descriptor after the caller's in fds, and how long the wait may
+// last: until the nearest link deadline, looking at the server at least
+// every MCP_LINK_CHECK_MS. Without a descriptor, peek is tried again at once.
+static unsigned link_wait_fds(McpClient *client, struct curl_waitfd *extra, unsigned nextra,
+                              struct curl_waitfd *fds, int *timeout_ms) {
+    McpTransport *transport = &client->link.transport;
+    short events = 0;
+    int fd = transport->ops->wait_fd(transport, &events);
+    double now = mcp_now_ms();
+    
+    if (fd < 0 || nextra >= POLL_FDS) {
+        *timeout_ms = 0;
+        return 0;
+    }
+    if (nextra > 0) memcpy(fds, extra, nextra * sizeof(*extra));
+    fds[nextra].fd = fd;
+    fds[nextra].events = (events & POLLIN ? CURL_WAIT_POLLIN : 0) | (events & POLLOUT ? CURL_WAIT_POLLOUT : 0);
+    fds[nextra].revents = 0;
+    
+    if (*timeout_ms > MCP_LINK_CHECK_MS) *timeout_ms = MCP_LINK_CHECK_MS;
+    for (int slot = 0; slot < MCP_MAX_PARALLEL; slot++) {
+        const McpCall *call = client->link.calls[slot];
+        if (!call) continue;
+        double left_ms = call->start_ms + call_deadline_ms(client, call) - now;
+        if (left_ms < *timeout_ms) *timeout_ms = left_ms > 0 ? (int)left_ms + 1 : 0;
+    }
+    return nextra + 1;
+}
+
+int mcp_call_poll(McpClient *client, struct curl_waitfd *extra, unsigned nextra, int timeout_ms,
+                  McpCallDone on_done, void *userdata) {
+    struct curl_waitfd fds[POLL_FDS];
+    struct curl_waitfd *wait = extra;
+    unsigned nwait = nextra;
+    
+    if (client->link.pending > 0) {
+        size_t pending = client->link.pending;
+        link_collect(client);
+        link_finish(client, on_done, userdata);
+        // Calls that finished just now free slots for the caller at once
+        if (client->link.pending < pending) timeout_ms = 0;
+    }
+    if (client->link.pending > 0) {
+        unsigned n = link_wait_fds(client, extra, nextra, fds, &timeout_ms);
+        if (n > 0) {
+            wait = fds;
+            nwait = n;
+        }
+    }
+    int http_inflight = client->inflight > client->link.pending;
+    
+    if (!client->multi && client->balancer.count < 2 && nwait <= POLL_FDS) {
+        if (wait_extra(wait, nwait, timeout_ms) != 0) return -1;
+    } else {
+        if (ensure_multi(client) != 0) return -1;
+        schedule_probes(client);
+        int busy = http_inflight || client->probing > 0;
+        if (busy && drive_calls(client, on_done, userdata) != 0) return -1;
+        if (client->inflight > client->link.pending) timeout_ms = schedule_hedges(client, timeout_ms);
+        if (client->inflight > 0 || client->probing > 0 || nwait > 0) {
+            curl_multi_poll(client->multi, wait, nwait, timeout_ms, NULL);
+        }
+        busy = client->inflight > client->link.pending || client->probing > 0;
+        if (busy && drive_calls(client, on_done, userdata) != 0) return -1;
+    }
+    if (wait != extra) {
+        for (unsigned i = 0; i < nextra; i++) extra[i].revents = fds[i].revents;
+    }
+    return (int)client->inflight;
+}
+
+int run_mcp_calls(McpClient *client, McpCallNext next_call, void *source, size_t max_inflight,
+                  McpCallDone on_done, void *userdata) {
+    long failures = client->failures;
+    int exhausted = 0;
+    
+    if (max_inflight == 0 || max_inflight > MCP_MAX_PARALLEL) max_inflight = MCP_MAX_PARALLEL;
+    
+    while (!exhausted || client->inflight > 0) {
+        while (!exhausted && client->inflight < max_inflight) {
+            McpCall *call = next_call(source);
+            if (!call) exhausted = 1;
+            else mcp_call_start(client, call, on_done, userdata);
+        }
+        if (client->inflight == 0) continue;
+        if (mcp_call_poll(client, NULL, 0, 1000, on_done, userdata) < 0) break;
+    }
+    
+    return (int)(client->failures - failures);
+}
+
+typedef struct {
+    McpCall *calls;
+    size_t count;
+    size_t next;
+} CallArray;
+
+static McpCall *next_array_call(void *source) {
+    CallArray *array = source;
+    return (array->next < array->count) ? &array->calls[array->next++] : NULL;
+}
+
+int call_mcp_tools_parallel(McpClient *client, McpCall *calls, size_t count, size_t max_inflight,
+                            McpCallDone on_done, void *userdata) {
+    CallArray array = { calls, count, 0 };
+    return run_mcp_calls(client, next_array_call, &array, max_inflight, on_done, userdata);
+}
+
+typedef struct {
+    McpBatchItem *items;
+    size_t count;
+} BatchRoute;
+
+// Called as each reply object in the batch array closes
+static void route_batch_reply(void *userdata, const JsonScanReply *reply) {
+    BatchRoute *route = userdata;
+    
+    if (!reply->has_id) return;
+    for (size_t i = 0; i < route->count; i++) {
+        McpBatchItem *item = &route->items[i];
+        if (item->id != reply->id || item->answered) continue;
+        
+        const char *src = reply->has_error ? reply->message : reply->text;
+        size_t len = reply->has_error ? reply->message_len : reply->text_len;
+        item->answered = 1;
+        item->is_error = reply->has_error;
+        item->error_code = reply->error_code;
+        item->text = malloc(len + 1);
+        if (item->text) {
+            memcpy(item->text, src, len);
+            item->text[len] = 0;
+        }
+        return;
+    }
+}
+
+int call_mcp_batch(McpClient *client, McpBatchItem *items, size_t count) {
+    CURLcode res;
+    McpTiming timing = {0};
+    BatchRoute route = { items, count };
+    int status = -1;
+    
+    int linked = link_carries(client, NULL);
+    if (count == 0 || (!linked && !main_handle(client))) return -1;
+    
+    // One transfer carries every item, so it gets the longest of their budgets
+    double deadline_ms = 0;
+    double serialize_start = mcp_now_ms();
+    Response *request = &client->request;
+    begin_call(&client->arena, request, &client->response);
+    response_reset(request);
+    McpFraming framing = call_framing(client, NULL);
+    int cbor = framing == MCP_FRAMING_CBOR;
+    if (cbor ? cbor_write_head(response_write, request, CBOR_ARRAY, count) != 0 : response_append(request, "[", 1) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        items[i].id = next_request_id(client);
+        items[i].answered = 0;
+        items[i].is_error = 0;
+        items[i].error_code = 0;
+        items[i].text = NULL;
+        if (!cbor && i > 0 && response_append(request, ",", 1) != 0) return -1;
+        if (append_request(request, framing, items[i].tool, items[i].args, items[i].id) != 0) return -1;
+        double item_deadline_ms = mcp_tool_deadline_ms(client, items[i].tool);
+        if (item_deadline_ms > deadline_ms) deadline_ms = item_deadline_ms;
+    }
+    if (!cbor && response_append(request, "]", 1) != 0) return -1;
+    timing.serialize_ms = mcp_now_ms() - serialize_start;
+    
+    // The batch is the dashboard, so it goes where admin tools go
+    McpEndpoint *endpoint = linked ? NULL : pick_endpoint(client, client->curl, 1, 0);
+    if (!linked && !endpoint) return -1;
+    Reply *reply = &client->response;
+    reply_reset(reply);
+    reply->scan.on_reply = route_batch_reply;
+    reply->scan.userdata = &route;
+    double sent_ms = mcp_now_ms();
+    if (linked) {
+        res = link_exchange(client, request, reply, items[0].id, cbor, deadline_ms);
+    } else {
+        curl_easy_setopt(client->curl, CURLOPT_TIMEOUT_MS, (long)deadline_ms);
+        curl_easy_setopt(client->curl, CURLOPT_POSTFIELDS, request->data);
+        curl_easy_setopt(client->curl, CURLOPT_POSTFIELDSIZE, (long)request->size);
+        curl_easy_setopt(client->curl, CURLOPT_WRITEDATA, reply);
+        res = curl_easy_perform(client->curl);
+        reply_arrived(reply, client->curl, res);
+    }
+    
+    // Replies were routed to their items by the scanner as they arrived (or
+    // as the CBOR body was walked). A server may answer a batch with a single
+    // error object instead of an array.
+    if (res == CURLE_OK && reply->scan.complete && !reply->scan.failed) {
+        const char *body = reply->body.data;
+        while (!reply->cbor && isspace((unsigned char)*body)) body++;
+        if (reply->cbor ? (unsigned char)*body >> 5 == CBOR_ARRAY : *body == '[') status = 0;
+    }
+    timing.parse_ms = reply->parse_ms;
+    timing.body_bytes = reply->body.size;
+    timing.arena_bytes = client->arena.used;
+    
+    // The whole batch is one transfer, so it is timed as a single "batch" call
+    if (linked) link_record(client, "batch", NULL, res, reply, &timing, sent_ms, status != 0);
+    else record_call(client, client->curl, endpoint, "batch", NULL, res, &timing, 0, status != 0);
+    return status;
+}
+
+void mcp_batch_release(McpBatchItem *items, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(items[i].text);
+        items[i].text = NULL;
+    }
+}
+
+void mcp_write_json_string(FILE *out, const char *str, size_t len) {
+    fputc('"', out);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        switch (c) {
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if (c < 0x20) fprintf(out, "\\u%04x", c);
+                else fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
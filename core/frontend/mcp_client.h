@@ -0,0 +1,330 @@
+#ifndef PHASE3_MCP_CLIENT_H
+#define PHASE3_MCP_CLIENT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <curl/curl.h>
+#include "arena.h"
+#include "balance.h"
+#include "cache.h"
+#include "json_scan.h"
+#include "record.h"
+#include "shm_ring.h"
+#include "stats.h"
+
+#define MCP_URL "http://localhost:8080/mcp"
+#define MCP_MAX_PARALLEL 64
+// Bytes of a streamed prompt held at once (call_mcp_generate_from)
+#define MCP_IO_WINDOW (64 * 1024)
+#define MCP_IO_WINDOW_MIN 256
+
+// Same-host deployments: HTTP over this socket file skips the loopback TCP
+// stack. The URL then only supplies the request path and Host header.
+#define MCP_SOCKET "/tmp/phase3_mcp.sock"
+
+// Transports that are not HTTP (see transport.h) wake a waiting caller when
+// a reply arrives. One too full to take a request is tried again every
+// MCP_LINK_POLL_US, and while calls are waiting on it the client looks at
+// least every MCP_LINK_CHECK_MS whether its server is still there.
+#define MCP_LINK_POLL_US 20
+#define MCP_LINK_CHECK_MS 100
+
+// Every call has a deadline covering the whole transfer; tools without an
+// entry in the client's policy table get MCP_DEADLINE_MS. Connects give up
+// sooner, and a connect that fails puts the endpoint into backoff (see
+// balance.h), during which new calls fail at once instead of each waiting
+// out the connect timeout.
+#define MCP_DEADLINE_MS 15000
+#define MCP_CONNECT_TIMEOUT_MS 2000
+
+// Encoding of the tools/call envelope and its reply. CBOR is offered with
+// Content-Type and Accept: application/cbor; the Content-Type of each reply
+// says what actually came back, so a JSON-only server keeps working.
+// Streamed calls always use JSON and SSE.
+typedef enum {
+    MCP_FRAMING_JSON,
+    MCP_FRAMING_CBOR,
+} McpFraming;
+
+// With several endpoints each one is probed at GET /health this often
+#define MCP_HEALTH_INTERVAL_MS 2000
+#define MCP_HEALTH_TIMEOUT_MS 1000
+
+// A read-only call still running past the chosen percentile of its tool's
+// latency gets a second, identical request; the first good answer wins.
+// Needs this many recorded calls before the percentile is trusted.
+#define MCP_HEDGE_MIN_SAMPLES 20
+
+// Buffer that grows geometrically. Buffers of a call live in that call's
+// arena and go with it when the arena is reset for the next call; without
+// an arena the buffer is on the heap and is reset, not freed, between uses.
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+    Arena *arena;
+} Response;
+
+// Receive side of a call: the body as received plus the fields the scanner
+// pulled out of it while it arrived, so nothing is parsed a second time.
+typedef struct {
+    Response body;
+    JsonScan scan;
+    double parse_ms;        // time spent scanning, summed over all chunks
+    int cbor;               // body is CBOR, decoded into scan once complete
+    char etag[80];
+    struct curl_slist *headers;     // per-call request headers, if any
+} Reply;
+
+// Borrowed view into a Response; valid until the next call that reuses it
+typedef struct {
+    const char *data;
+    size_t size;
+} McpView;
+
+// Borrowed view of a received reply. text is result.content[0].text (or the
+// streamed deltas), message is error.message; both are unescaped.
+typedef struct {
+    McpView body;
+    McpView text;
+    McpView message;
+    int has_id;
+    long id;
+    int is_error;           // JSON-RPC error, or a body that is not a complete reply
+    long error_code;
+    int cached;             // served from the reply cache, fresh or revalidated
+    int cbor;               // body is CBOR rather than JSON; see cbor_write_json
+} McpReply;
+
+// A transport other than HTTP and the calls waiting on its reply frames:
+// parallel calls by pool slot (the tag of a frame carries the slot and the
+// request id), a blocking call in wait_*
+typedef struct McpCall McpCall;
+
+typedef struct {
+    McpTransport transport;     // transport.ops is NULL while calls go over HTTP
+    McpCall *calls[MCP_MAX_PARALLEL];
+    uint32_t tags[MCP_MAX_PARALLEL];
+    int ready[MCP_MAX_PARALLEL];    // reply delivered, call not reported yet
+    size_t pending;
+    uint32_t wait_tag;
+    Reply *wait_reply;
+    int wait_done;
+} McpLink;
+
+// Long-lived client state: the easy handle keeps its connection cache, so
+// consecutive calls reuse the same HTTP/1.1 keep-alive connection. Parallel
+// calls run on a multi handle with its own pool of easy handles. Every
+// handle, like libcurl itself, is created on first use and kept for the
+// same reason.
+typedef struct {
+    CURL *curl;             // NULL until the first blocking call
+    CURLM *multi;
+    CURL *pool[MCP_MAX_PARALLEL];
+    Response pool_request[MCP_MAX_PARALLEL];
+    Reply pool_response[MCP_MAX_PARALLEL];
+    Arena pool_arena[MCP_MAX_PARALLEL];     // per-call memory of each pool handle
+    int pool_busy[MCP_MAX_PARALLEL];
+    char *url;              // first endpoint; also the base of watch URLs
+    char *unix_path;        // NULL for TCP
+    long http_version;      // CURL_HTTP_VERSION_1_1 unless the http2 transport is chosen
+    struct curl_slist *headers;
+    struct curl_slist *stream_headers;
+    McpFraming framing;
+    McpLink link;
+    Response request;       // same growable buffer, holding the outgoing body
+    Reply response;
+    Arena arena;            // per-call memory of the blocking calls on curl
+    StatsTable *stats;
+    McpCache cache;         // off unless cache.enabled is set
+    McpRecorder *recorder;  // NULL unless traffic is recorded for replay
+    McpTelemetry *telemetry;    // NULL unless device state is sampled; shared by batch workers
+    McpTiming last_timing;
+    size_t inflight;        // calls running on the multi handle
+    long failures;          // parallel calls that did not complete
+    double deadline_ms;     // overrides the per-tool deadlines when nonzero
+    double hedge_percentile;    // as a fraction, e.g. 0.95; 0 turns hedged reads off
+    long hedges;            // second requests sent
+    long hedge_wins;        // ... that answered first
+    Balancer balancer;      // endpoints calls are spread over, url first
+    CURL *probes[MCP_MAX_ENDPOINTS];
+    int probe_busy[MCP_MAX_ENDPOINTS];
+    size_t probing;
+    double next_probe_ms;
+    double curl_init_ms;    // libcurl global setup, if this client did it
+    int next_id;
+    long calls;
+    long reconnects;
+    int last_reused;
+} McpClient;
+
+typedef void (*McpCallToken)(McpCall *call, const char *text, size_t len);
+
+// One tool call in a parallel batch. The reply view is only valid inside the
+// completion callback. Setting on_token streams the call: it asks for
+// text/event-stream and hands text to on_token as it arrives, leaving the
+// reply text empty; a JSON-RPC error arrives as one last chunk with
+// reply.is_error set. Setting cancel while it runs aborts the transfer.
+struct McpCall {
+    const char *tool;
+    const char *args;
+    const char *label;
+    void *context;          // caller data, untouched by the client
+    McpCallToken on_token;
+    int cancel;
+    double deadline_ms;     // 0 for the tool's default
+    uint64_t affinity;      // nonzero: calls with the same key share an endpoint (see balance.h)
+    int hedged;             // a second request was sent for this call
+    McpReply reply;
+    CURLcode res;
+    long http_status;
+    int reused;
+    int slot;
+    McpTiming timing;
+    double start_ms;
+    double end_ms;
+    double first_token_ms;  // 0 until a streamed call receives text
+    size_t tokens;          // chunks so far; inside on_token, the ones before this one
+    void *stream;           // client-internal state of a streamed call
+    McpEndpoint *endpoint;  // client-internal from here on: where the call went,
+    int hedge_slot;         // the pool slot and endpoint of the second request,
+    McpEndpoint *hedge_endpoint;
+    double hedge_at_ms;     // when to send it and when it was sent
+    double hedge_start_ms;
+};
+
+typedef void (*McpCallDone)(McpCall *call, void *userdata);
+typedef McpCall *(*McpCallNext)(void *source);
+
+// One entry of a JSON-RPC batch, filled from the reply matched by id. text
+// holds the result text, or the error message when is_error is set; release
+// with mcp_batch_release.
+typedef struct {
+    const char *tool;
+    const char *args;
+    int id;
+    int answered;
+    int is_error;
+    long error_code;
+    char *text;
+} McpBatchItem;
+
+// Only copies configuration: libcurl is initialized by the first call, so a
+// run that never reaches the network (usage errors, an empty batch) costs
+// no more than process startup. TLS setup is only requested when an
+// endpoint is https, which matters for libcurl before 7.57; newer versions
+// set up their TLS backend either way.
+int mcp_client_init(McpClient *client, const char *url);
+void mcp_client_cleanup(McpClient *client);
+
+// Set up libcurl and the handle of blocking calls now rather than on the
+// first call. libcurl's global setup is not thread-safe, so clients driven
+// by threads of their own are prepared on one thread before those start.
+int mcp_client_prepare(McpClient *client);
+
+// Undo the libcurl setup of the first call, if there was one. Call once no
+// client is left.
+void mcp_global_cleanup(void);
+
+// Send all further calls over the Unix domain socket at path, or back over
+// TCP when path is NULL. Existing connections are dropped.
+int mcp_client_set_unix_socket(McpClient *client, const char *path);
+
+// Choose how further calls travel, by a spec of the form KIND[:TARGET]:
+//   http            HTTP/1.1 to the endpoint URLs (the default)
+//   http2           the same over HTTP/2, multiplexing parallel calls on one
+//                   connection (prior knowledge for http:// URLs)
+//   unix[:PATH]     HTTP/1.1 over a Unix domain socket (default MCP_SOCKET)
+//   shm[:NAME]      the shared memory rings of a same-host server
+//                   (default SHM_RING_NAME)
+//   stdio:COMMAND   an MCP server spawned with sh -c COMMAND, spoken to
+//                   over its stdin and stdout
+//   mock            canned replies from inside the process, for measuring
+//                   the client alone
+// The last three carry whole calls (see transport.h). Calls they cannot
+// carry still go over HTTP, CBOR framing falls back to JSON where they do
+// not take it, and call_mcp_tool_stream and watches always use HTTP. Fails
+// while calls are waiting on a transport, or when the new one cannot be set
+// up; calls then go over HTTP.
+int mcp_client_set_transport(McpClient *client, const char *spec);
+
+// Name and target of the transport in use, for the stats
+void mcp_client_describe_transport(const McpClient *client, char *out, size_t size);
+
+// Spread calls over another MCP server as well. Admin tools (the cached
+// views and the calls that invalidate them) stay on the first endpoint that
+// is up; the rest, generate above all, go by client->balancer.policy.
+int mcp_client_add_endpoint(McpClient *client, const char *url);
+
+// Encoding for all further calls; set before any are in flight
+int mcp_client_set_framing(McpClient *client, McpFraming framing);
+
+// Largest per-call arena any handle has needed so far, and how many calls
+// had to spill past their handle's block
+size_t mcp_client_arena_peak(const McpClient *client, long *spills);
+
+// Deadline a call to tool gets unless it sets its own
+double mcp_tool_deadline_ms(const McpClient *client, const char *tool);
+
+// On success reply points into the client's response buffer; it stays valid
+// until the next call on this client.
+int call_mcp_tool(McpClient *client, const char *tool, const char *args, McpReply *reply);
+
+// Streamed variant of call_mcp_tool: asks for text/event-stream and prints
+// tokens to stdout as frames arrive, with no cap on the response size.
+int call_mcp_tool_stream(McpClient *client, const char *tool, const char *args);
+
+// Streamed generate with the prompt read from in, a file or a pipe of any
+// size, while the request is sent. The body is written through
+// CURLOPT_READFUNCTION, the prompt JSON-escaped window bytes at a time, and
+// the reply is printed as by call_mcp_tool_stream, so memory stays at the
+// window plus one SSE event however long prompt and reply get. A regular
+// file is read twice so the body length is known; a pipe goes out chunked.
+// Always uses HTTP.
+int call_mcp_generate_from(McpClient *client, FILE *in, size_t window);
+
+// Event loop behind the parallel APIs. Calls are pulled from next_call
+// whenever fewer than max_inflight are outstanding, so a long input stream
+// keeps the pipe full without being read ahead. on_done fires as each call
+// completes, in completion order. Returns the number of transfers that failed.
+int run_mcp_calls(McpClient *client, McpCallNext next_call, void *source, size_t max_inflight,
+                  McpCallDone on_done, void *userdata);
+
+// Server-pushed updates from GET <url>/watch: on_event receives each SSE
+// event ("snapshot" with every field, then "delta" with only what changed).
+// idle is polled about once a second while the connection is quiet. Either
+// returning nonzero ends the watch. Runs on its own connection.
+typedef int (*McpWatchEvent)(void *userdata, const char *event, const char *data, size_t len);
+typedef int (*McpWatchIdle)(void *userdata);
+int mcp_watch(McpClient *client, const char *tool, double interval_s,
+              McpWatchEvent on_event, McpWatchIdle idle, void *userdata);
+
+// Building blocks of run_mcp_calls for callers with their own event loop.
+// mcp_call_start begins one call on the multi handle; a call that can be
+// answered at once (cache hit, invalid arguments) completes through on_done
+// before it returns, and -1 means it failed. mcp_call_poll drives the
+// transfers in flight, waiting up to timeout_ms for network activity or for
+// one of the extra descriptors (e.g. stdin), reports completions to on_done
+// and returns the number of calls still in flight.
+int mcp_call_start(McpClient *client, McpCall *call, McpCallDone on_done, void *userdata);
+int mcp_call_poll(McpClient *client, struct curl_waitfd *extra, unsigned nextra, int timeout_ms,
+                  McpCallDone on_done, void *userdata);
+
+// Run a fixed set of tool calls at once on one event loop
+int call_mcp_tools_parallel(McpClient *client, McpCall *calls, size_t count, size_t max_inflight,
+                            McpCallDone on_done, void *userdata);
+
+// Send all items as one JSON-RPC 2.0 batch array in a single POST and match
+// the replies back to their items by id. Returns 0 when the transfer and the
+// batch reply were well formed; individual items may still carry errors.
+int call_mcp_batch(McpClient *client, McpBatchItem *items, size_t count);
+void mcp_batch_release(McpBatchItem *items, size_t count);
+
+// Transport or local failure of a parallel call, for display. A call that
+// ran out of time reports "deadline exceeded".
+const char *mcp_call_error(const McpCall *call);
+
+double mcp_now_ms(void);
+void mcp_write_json_string(FILE *out, const char *str, size_t len);
+
+#endif
@@ -0,0 +1,239 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "metrics.h"
+
+#define METRICS_REQUEST_MAX 4096
+// How often the thread looks at the stop flag between connections
+#define METRICS_POLL_MS 200
+
+static void write_label(FILE *out, const char *value) {
+    for (; *value; value++) {
+        if (*value == '\\' || *value == '"') fputc('\\', out);
+        if (*value == '\n') fputs("\\n", out);
+        else fputc(*value, out);
+    }
+}
+
+static void write_counter(FILE *out, const char *name, const char *type, const char *help, double value) {
+    fprintf(out, "# HELP %s_%s %s\n# TYPE %s_%s %s\n%s_%s %.17g\n", METRICS_PREFIX, name, help, METRICS_PREFIX,
+            name, type, METRICS_PREFIX, name, value);
+}
+
+typedef struct {
+    double inflight, transfers, reconnects, failures, hedges;
+    double hits, misses, revalidated, invalidations;
+} ClientTotals;
+
+static void add_totals(ClientTotals *totals, const McpClient *client) {
+    totals->inflight += (double)STAT_LOAD(client->inflight);
+    totals->transfers += (double)STAT_LOAD(client->calls);
+    totals->reconnects += (double)STAT_LOAD(client->reconnects);
+    totals->failures += (double)STAT_LOAD(client->failures);
+    totals->hedges += (double)STAT_LOAD(client->hedges);
+    totals->hits += (double)STAT_LOAD(client->cache.hits);
+    totals->misses += (double)STAT_LOAD(client->cache.misses);
+    totals->revalidated += (double)STAT_LOAD(client->cache.revalidated);
+    totals->invalidations += (double)STAT_LOAD(client->cache.invalidations);
+}
+
+static void write_tools(const McpClient *const *clients, size_t count, FILE *out) {
+    if (count == 1) {
+        stats_write_prometheus(clients[0]->stats, METRICS_PREFIX, out);
+        return;
+    }
+    StatsTable *sum = calloc(1, sizeof(StatsTable));
+    if (!sum) return;
+    for (size_t i = 0; i < count; i++) stats_merge(sum, clients[i]->stats);
+    stats_write_prometheus(sum, METRICS_PREFIX, out);
+    free(sum);
+}
+
+void metrics_write(const McpClient *const *clients, size_t count, FILE *out) {
+    const Balancer *balancer = &clients[0]->balancer;
+    ClientTotals totals = {0};
+    
+    for (size_t i = 0; i < count; i++) add_totals(&totals, clients[i]);
+    write_tools(clients, count, out);
+    write_counter(out, "inflight_calls", "gauge", "Parallel calls started and not finished yet", totals.inflight);
+    write_counter(out, "transfers_total", "counter", "Blocking and parallel calls that reached a server",
+                  totals.transfers);
+    write_counter(out, "reconnects_total", "counter", "Transfers that had to open a new connection",
+                  totals.reconnects);
+    write_counter(out, "failures_total", "counter", "Parallel calls that ended in a transport error",
+                  totals.failures);
+    write_counter(out, "hedges_total", "counter", "Second requests sent for slow read-only calls", totals.hedges);
+    write_counter(out, "cache_hits_total", "counter", "Calls answered by a fresh cache entry", totals.hits);
+    write_counter(out, "cache_misses_total", "counter", "Cacheable calls the server had to answer", totals.misses);
+    write_counter(out, "cache_revalidated_total", "counter", "Stale entries the server confirmed with 304",
+                  totals.revalidated);
+    write_counter(out, "cache_invalidations_total", "counter", "Calls that dropped every cached reply",
+                  totals.invalidations);
+                  
+    // The endpoint list is fixed before the first call, and the same in
+    // every client exported
+    fprintf(out, "# HELP %s_endpoint_outstanding_calls Calls picked from each endpoint and not finished yet\n"
+            "# TYPE %s_endpoint_outstanding_calls gauge\n", METRICS_PREFIX, METRICS_PREFIX);
+    for (size_t i = 0; i < balancer->count; i++) {
+        size_t outstanding = 0;
+        for (size_t k = 0; k < count; k++) outstanding += STAT_LOAD(clients[k]->balancer.endpoints[i].outstanding);
+        fprintf(out, "%s_endpoint_outstanding_calls{endpoint=\"", METRICS_PREFIX);
+        write_label(out, balancer->endpoints[i].url);
+        fprintf(out, "\"} %zu\n", outstanding);
+    }
+    fprintf(out, "# HELP %s_endpoint_failures_total Calls to each endpoint that failed\n"
+            "# TYPE %s_endpoint_failures_total counter\n", METRICS_PREFIX, METRICS_PREFIX);
+    for (size_t i = 0; i < balancer->count; i++) {
+        long failures = 0;
+        for (size_t k = 0; k < count; k++) failures += STAT_LOAD(clients[k]->balancer.endpoints[i].failures);
+        fprintf(out, "%s_endpoint_failures_total{endpoint=\"", METRICS_PREFIX);
+        write_label(out, balancer->endpoints[i].url);
+        fprintf(out, "\"} %ld\n", failures);
+    }
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void answer(McpMetrics *metrics, int fd) {
+    char request[METRICS_REQUEST_MAX + 1];
+    size_t len = 0;
+    
+    // A scraper that stalls only holds up the next scrape, not any call
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    while (len < METRICS_REQUEST_MAX) {
+        ssize_t n = recv(fd, request + len, METRICS_REQUEST_MAX - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        len += (size_t)n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n")) break;
+    }
+    
+    int found = strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0;
+    char *body = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&body, &size);
+    if (!out) return;
+    if (found) {
+        size_t ntracked = __atomic_load_n(&metrics->ntracked, __ATOMIC_ACQUIRE);
+        const McpClient **clients = malloc((ntracked + 1) * sizeof(*clients));
+        if (clients) {
+            clients[0] = metrics->client;
+            for (size_t i = 0; i < ntracked; i++) clients[i + 1] = metrics->tracked[i];
+            metrics_write(clients, ntracked + 1, out);
+            free(clients);
+        }
+    }
+    else fprintf(out, "Not found; metrics are at /metrics\n");
+    if (fclose(out) != 0) {
+        free(body);
+        return;
+    }
+    
+    char head[160];
+    int n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n", found ? "200 OK" : "404 Not Found", size);
+    if (send_all(fd, head, (size_t)n) == 0) send_all(fd, body, size);
+    free(body);
+}
+
+static void *serve(void *arg) {
+    McpMetrics *metrics = arg;
+    struct pollfd pfd = { metrics->fd, POLLIN, 0 };
+    
+    while (!__atomic_load_n(&metrics->stop, __ATOMIC_ACQUIRE)) {
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) continue;
+        int fd = accept(metrics->fd, NULL, NULL);
+        if (fd < 0) continue;
+        answer(metrics, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static int listen_on(McpMetrics *metrics, const char *spec) {
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        const char *path = spec + 5;
+        
+        if (strlen(path) >= sizeof(addr.sun_path) || strlen(path) >= sizeof(metrics->unix_path)) return -1;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        // A socket file left by an earlier run that exited without stopping
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+            close(fd);
+            return -1;
+        }
+        strcpy(metrics->unix_path, path);
+        return fd;
+    }
+    
+    char *end;
+    long port = strtol(spec, &end, 10);
+    if (*spec == '\0' || *end != '\0' || port <= 0 || port > 65535) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    if (fd < 0) return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int metrics_start(McpMetrics *metrics, const McpClient *client, const char *spec) {
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->client = client;
+    metrics->fd = listen_on(metrics, spec);
+    if (metrics->fd < 0) return -1;
+    if (pthread_create(&metrics->thread, NULL, serve, metrics) != 0) {
+        close(metrics->fd);
+        if (metrics->unix_path[0]) unlink(metrics->unix_path);
+        metrics->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_track(McpMetrics *metrics, const McpClient *const *clients, size_t count) {
+    metrics->tracked = clients;
+    __atomic_store_n(&metrics->ntracked, count, __ATOMIC_RELEASE);
+}
+
+void metrics_stop(McpMetrics *metrics) {
+    if (metrics->fd < 0 || !metrics->client) return;
+    __atomic_store_n(&metrics->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(metrics->thread, NULL);
+    close(metrics->fd);
+    if (metrics->unix_path[0]) unlink(metrics->unix_path);
+    metrics->fd = -1;
+}
@@ -0,0 +1,38 @@
+#ifndef PHASE3_METRICS_H
+#define PHASE3_METRICS_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include "mcp_client.h"
+
+// Prometheus text-format export of a client's stats, served by a thread of
+// its own so a scrape never waits for a call and a call never waits for a
+// scrape. The thread only reads, and every value it exports is one the
+// calling thread updates with STAT_ADD (stats.h), so the call path takes no
+// lock either.
+#define METRICS_PREFIX "phase3_frontend"
+
+typedef struct {
+    int fd;                 // listening socket
+    pthread_t thread;
+    const McpClient *client;
+    int stop;
+    char unix_path[108];    // removed again on stop; empty for TCP
+    const McpClient *const *tracked;
+    size_t ntracked;        // published with a release store after tracked
+} McpMetrics;
+
+// Answer GET /metrics on 127.0.0.1:PORT, or on the Unix socket PATH for a
+// spec of unix:PATH
+int metrics_start(McpMetrics *metrics, const McpClient *client, const char *spec);
+void metrics_stop(McpMetrics *metrics);
+
+// Export the stats of count more clients summed with the first one's, for
+// batch workers driving clients of their own. Set once, before they make
+// calls; the clients must outlive metrics_stop.
+void metrics_track(McpMetrics *metrics, const McpClient *const *clients, size_t count);
+
+// clients[0] gives the endpoint list, the same in every one of them
+void metrics_write(const McpClient *const *clients, size_t count, FILE *out);
+
+#endif
@@ -0,0 +1,251 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "pool.h"
+
+#define POOL_MASK (POOL_QUEUE_SIZE - 1)
+// How long a worker with calls in flight waits for them before looking at
+// the queue again, when no new work wakes it first
+#define POOL_POLL_MS 1000
+
+static void queue_init(PoolQueue *queue) {
+    for (size_t i = 0; i < POOL_QUEUE_SIZE; i++) queue->cells[i].seq = i;
+    queue->head = queue->tail = 0;
+}
+
+static int queue_push(PoolQueue *queue, size_t value) {
+    size_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    
+    for (;;) {
+        PoolCell *cell = &queue->cells[pos & POOL_MASK];
+        intptr_t diff = (intptr_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+        if (diff == 0) {
+            // On failure pos is reloaded with the head another push moved on
+            if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->value = value;
+                __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int queue_pop(PoolQueue *queue, size_t *value) {
+    size_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    
+    for (;;) {
+        PoolCell *cell = &queue->cells[pos & POOL_MASK];
+        intptr_t diff = (intptr_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *value = cell->value;
+                // Free for the push one lap later
+                __atomic_store_n(&cell->seq, pos + POOL_QUEUE_SIZE, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void wake(int fd, uint64_t count) {
+    while (write(fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+}
+
+// Non-blocking: takes one wakeup from work_fd, every one from done_fd
+static void take_wakeup(int fd) {
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+}
+
+// The client still touches a call after on_done returns, so it is only
+// marked done for the collector once control is back with the worker
+static void worker_done(McpCall *call, void *userdata) {
+    PoolWorker *worker = userdata;
+    McpPool *pool = worker->pool;
+    
+    pool->on_done(call, pool->userdata);
+    for (size_t i = 0; i < worker->nrunning; i++) {
+        if (pool->calls[worker->running[i] & POOL_MASK] != call) continue;
+        worker->finished[worker->nfinished++] = worker->running[i];
+        worker->running[i] = worker->running[--worker->nrunning];
+        return;
+    }
+}
+
+static void publish_done(PoolWorker *worker) {
+    McpPool *pool = worker->pool;
+    
+    if (worker->nfinished == 0) return;
+    // Paired with the collector's store to collector_waiting and load of
+    // done, so one of the two always sees the other
+    for (size_t i = 0; i < worker->nfinished; i++) {
+        __atomic_store_n(&pool->done[worker->finished[i] & POOL_MASK], 1, __ATOMIC_SEQ_CST);
+    }
+    worker->nfinished = 0;
+    if (__atomic_load_n(&pool->collector_waiting, __ATOMIC_SEQ_CST)) wake(pool->done_fd, 1);
+}
+
+static void worker_start(PoolWorker *worker, size_t pos) {
+    McpCall *call = worker->pool->calls[pos & POOL_MASK];
+    
+    // Recorded first: a call answered at once completes inside mcp_call_start
+    worker->running[worker->nrunning++] = pos;
+    mcp_call_start(&worker->client, call, worker_done, worker);
+    publish_done(worker);
+}
+
+static void worker_poll(PoolWorker *worker, struct curl_waitfd *extra, unsigned nextra) {
+    mcp_call_poll(&worker->client, extra, nextra, POOL_POLL_MS, worker_done, worker);
+    publish_done(worker);
+}
+
+static void *worker_main(void *arg) {
+    PoolWorker *worker = arg;
+    McpPool *pool = worker->pool;
+    McpClient *client = &worker->client;
+    size_t pos;
+    
+    for (;;) {
+        while (client->inflight < pool->inflight && queue_pop(&pool->queue, &pos) == 0) worker_start(worker, pos);
+        if (client->inflight >= pool->inflight) {
+            worker_poll(worker, NULL, 0);
+            continue;
+        }
+        
+        // Out of work. Register as idle, so the next submit wakes this
+        // worker, then look once more for a call pushed in between.
+        __atomic_add_fetch(&pool->idle_workers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int found = queue_pop(&pool->queue, &pos) == 0;
+        int closing = __atomic_load_n(&pool->closing, __ATOMIC_SEQ_CST);
+        if (!found && !(closing && client->inflight == 0)) {
+            if (client->inflight > 0) {
+                struct curl_waitfd work = { .fd = pool->work_fd, .events = CURL_WAIT_POLLIN, .revents = 0 };
+                worker_poll(worker, &work, 1);
+            } else {
+                struct pollfd work = { .fd = pool->work_fd, .events = POLLIN, .revents = 0 };
+                poll(&work, 1, -1);
+            }
+            take_wakeup(pool->work_fd);
+        }
+        __atomic_sub_fetch(&pool->idle_workers, 1, __ATOMIC_SEQ_CST);
+        if (found) worker_start(worker, pos);
+        // Every call was pushed before closing was set, so none can follow
+        else if (closing && client->inflight == 0) break;
+    }
+    return NULL;
+}
+
+static int start_worker(McpPool *pool, PoolWorker *worker, PoolSetup setup, void *config) {
+    worker->pool = pool;
+    if (setup(&worker->client, config) != 0) return -1;
+    // libcurl's global setup is not thread-safe, so it happens here, once
+    if (mcp_client_prepare(&worker->client) != 0 ||
+        pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+        mcp_client_cleanup(&worker->client);
+        return -1;
+    }
+    return 0;
+}
+
+int pool_start(McpPool *pool, size_t nworkers, size_t inflight, PoolSetup setup, void *config,
+               McpCallDone on_done, void *userdata) {
+    memset(pool, 0, sizeof(*pool));
+    queue_init(&pool->queue);
+    pool->inflight = (inflight == 0 || inflight > MCP_MAX_PARALLEL) ? MCP_MAX_PARALLEL : inflight;
+    pool->on_done = on_done;
+    pool->userdata = userdata;
+    pool->work_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+    pool->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool->work_fd < 0 || pool->done_fd < 0) {
+        pool_stop(pool, NULL);
+        return -1;
+    }
+    
+    if (nworkers > POOL_MAX_WORKERS) nworkers = POOL_MAX_WORKERS;
+    for (size_t i = 0; i < nworkers; i++) {
+        if (start_worker(pool, &pool->workers[i], setup, config) != 0) {
+            pool_stop(pool, NULL);
+            return -1;
+        }
+        pool->clients[i] = &pool->workers[i].client;
+        pool->nworkers++;
+    }
+    return 0;
+}
+
+int pool_submit(McpPool *pool, McpCall *call) {
+    size_t slot = pool->submitted & POOL_MASK;
+    
+    if (pool->submitted - pool->collected == POOL_QUEUE_SIZE) return -1;
+    pool->calls[slot] = call;
+    __atomic_store_n(&pool->done[slot], 0, __ATOMIC_RELAXED);
+    // Never full: a cell is free again once its call has been collected
+    if (queue_push(&pool->queue, pool->submitted) != 0) return -1;
+    pool->submitted++;
+    
+    // Paired with the fence a worker makes after registering as idle
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->idle_workers, __ATOMIC_RELAXED) > 0) wake(pool->work_fd, 1);
+    return 0;
+}
+
+McpCall *pool_collect(McpPool *pool) {
+    size_t slot = pool->collected & POOL_MASK;
+    
+    if (pool->collected == pool->submitted) return NULL;
+    while (!__atomic_load_n(&pool->done[slot], __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&pool->collector_waiting, 1, __ATOMIC_SEQ_CST);
+        if (!__atomic_load_n(&pool->done[slot], __ATOMIC_SEQ_CST)) {
+            struct pollfd done = { .fd = pool->done_fd, .events = POLLIN, .revents = 0 };
+            poll(&done, 1, -1);
+        }
+        __atomic_store_n(&pool->collector_waiting, 0, __ATOMIC_SEQ_CST);
+        take_wakeup(pool->done_fd);
+    }
+    pool->collected++;
+    return pool->calls[slot];
+}
+
+static void fold_client(McpClient *into, const McpClient *from) {
+    stats_merge(into->stats, from->stats);
+    STAT_ADD(into->calls, from->calls);
+    STAT_ADD(into->reconnects, from->reconnects);
+    STAT_ADD(into->failures, from->failures);
+    STAT_ADD(into->hedges, from->hedges);
+    STAT_ADD(into->hedge_wins, from->hedge_wins);
+    // Workers are set up like the client, so the endpoints line up
+    for (size_t i = 0; i < into->balancer.count && i < from->balancer.count; i++) {
+        STAT_ADD(into->balancer.endpoints[i].calls, from->balancer.endpoints[i].calls);
+        STAT_ADD(into->balancer.endpoints[i].failures, from->balancer.endpoints[i].failures);
+    }
+}
+
+void pool_stop(McpPool *pool, McpClient *client) {
+    __atomic_store_n(&pool->closing, 1, __ATOMIC_SEQ_CST);
+    if (pool->work_fd >= 0 && pool->nworkers > 0) wake(pool->work_fd, pool->nworkers);
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        PoolWorker *worker = &pool->workers[i];
+        pthread_join(worker->thread, NULL);
+        if (client) fold_client(client, &worker->client);
+        mcp_client_cleanup(&worker->client);
+        pool->clients[i] = NULL;
+    }
+    pool->nworkers = 0;
+    if (pool->work_fd >= 0) close(pool->work_fd);
+    if (pool->done_fd >= 0) close(pool->done_fd);
+    pool->work_fd = pool->done_fd = -1;
+}
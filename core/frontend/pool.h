@@ -0,0 +1,87 @@
+#ifndef PHASE3_POOL_H
+#define PHASE3_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include "mcp_client.h"
+
+// Calls spread over a fixed pool of worker threads, for batches busier than
+// one event loop keeps up with. Each worker drives an McpClient of its own,
+// so handles, connection cache, arenas and stats are never shared, and
+// takes calls off one bounded lock-free queue. Building requests, scanning
+// replies and curl's own work then run on as many cores as there are
+// workers, and results are collected in the order the calls were submitted.
+#define POOL_MAX_WORKERS 16
+#define POOL_QUEUE_SIZE 1024    // calls submitted and not collected yet; a power of two
+
+// Bounded MPMC queue after Vyukov: the sequence number of a cell says
+// whether it is free for the push at its position or holds the value for
+// the pop there. head and tail sit on cache lines of their own.
+typedef struct {
+    size_t seq;
+    size_t value;
+} PoolCell;
+
+typedef struct {
+    PoolCell cells[POOL_QUEUE_SIZE];
+    char pad0[64];
+    size_t head;            // next push
+    char pad1[64];
+    size_t tail;            // next pop
+    char pad2[64];
+} PoolQueue;
+
+typedef struct McpPool McpPool;
+
+typedef struct {
+    McpPool *pool;
+    McpClient client;
+    pthread_t thread;
+    size_t running[MCP_MAX_PARALLEL];   // submission positions of the calls in flight
+    size_t nrunning;
+    size_t finished[MCP_MAX_PARALLEL];  // completed, not yet handed to the collector
+    size_t nfinished;
+} PoolWorker;
+
+// Configures a worker's client like the caller's own; runs on the thread
+// calling pool_start, before any worker starts
+typedef int (*PoolSetup)(McpClient *client, void *config);
+
+struct McpPool {
+    PoolWorker workers[POOL_MAX_WORKERS];
+    const McpClient *clients[POOL_MAX_WORKERS];     // the workers' clients, for metrics_track
+    size_t nworkers;
+    size_t inflight;        // calls each worker runs at once
+    PoolQueue queue;
+    McpCall *calls[POOL_QUEUE_SIZE];    // by submission position
+    int done[POOL_QUEUE_SIZE];
+    size_t submitted, collected;
+    McpCallDone on_done;
+    void *userdata;
+    // Eventfds to sleep on: workers for work, the collector for results.
+    // Each is only written while someone is registered as waiting on it.
+    int work_fd, done_fd;
+    int idle_workers;
+    int collector_waiting;
+    int closing;
+};
+
+// Set up nworkers clients with setup and start their threads. on_done runs
+// on the worker that made the call, as it completes, while the reply view
+// is valid; the call is handed to pool_collect after that.
+int pool_start(McpPool *pool, size_t nworkers, size_t inflight, PoolSetup setup, void *config,
+               McpCallDone on_done, void *userdata);
+
+// Queue a call; -1 while POOL_QUEUE_SIZE calls are waiting to be collected.
+// Only one thread submits and collects.
+int pool_submit(McpPool *pool, McpCall *call);
+
+// The oldest call not collected yet, once it has completed, waiting for it
+// if need be; NULL when every submitted call has been collected
+McpCall *pool_collect(McpPool *pool);
+
+// Let the workers finish, then fold their stats and counters into client
+// and release them
+void pool_stop(McpPool *pool, McpClient *client);
+
+#endif
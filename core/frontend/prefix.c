@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json_scan.h"
+#include "prefix.h"
+
+typedef struct {
+    const char *prompt;
+    size_t len;
+    int found;
+} PromptField;
+
+static void find_prompt(void *userdata, const char *key, size_t key_len, const char *value, size_t value_len) {
+    PromptField *field = userdata;
+    
+    if (field->found || key_len != 6 || memcmp(key, "prompt", 6) != 0) return;
+    if (value_len < 2 || value[0] != '"') return;
+    field->prompt = value + 1;
+    field->len = value_len - 2;
+    field->found = 1;
+}
+
+int prefix_prompt(const char *args, size_t len, const char **prompt, size_t *prompt_len) {
+    PromptField field = { NULL, 0, 0 };
+    
+    if (json_each_member(args, len, find_prompt, &field) != 0 || !field.found) return -1;
+    *prompt = field.prompt;
+    *prompt_len = field.len;
+    return 0;
+}
+
+// Calls without a prompt sort first; ties keep arrival order
+static int compare_items(const void *a, const void *b) {
+    const PrefixItem *x = a, *y = b;
+    
+    if (!x->prompt || !y->prompt) {
+        if (x->prompt || y->prompt) return x->prompt ? 1 : -1;
+    } else {
+        size_t len = x->prompt_len < y->prompt_len ? x->prompt_len : y->prompt_len;
+        int order = memcmp(x->prompt, y->prompt, len);
+        if (order != 0) return order;
+        if (x->prompt_len != y->prompt_len) return x->prompt_len < y->prompt_len ? -1 : 1;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static size_t common_prefix(const PrefixItem *a, const PrefixItem *b) {
+    size_t len = a->prompt_len < b->prompt_len ? a->prompt_len : b->prompt_len;
+    size_t i = 0;
+    
+    while (i < len && a->prompt[i] == b->prompt[i]) i++;
+    return i;
+}
+
+// FNV-1a; never 0, which means no affinity
+static uint64_t prefix_key(const char *prefix, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    
+    if (len > PREFIX_KEY_MAX) len = PREFIX_KEY_MAX;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)prefix[i]) * 0x100000001b3ULL;
+    return h ? h : 1;
+}
+
+void prefix_plan(PrefixItem *items, size_t count, PrefixStats *stats) {
+    qsort(items, count, sizeof(PrefixItem), compare_items);
+    stats->windows++;
+    
+    size_t i = 0;
+    while (i < count && !items[i].prompt) {
+        items[i].group = 0;
+        items[i].shared = 0;
+        items[i].affinity = 0;
+        i++;
+    }
+    // In sorted order the prefix a run shares is the smallest of the ones
+    // its neighbours share, so groups form in one pass
+    while (i < count) {
+        size_t start = i, shared = items[i].prompt_len;
+        items[i].shared = 0;
+        stats->prompts++;
+        stats->prompt_bytes += items[i].prompt_len;
+        for (i++; i < count; i++) {
+            size_t common = common_prefix(&items[i - 1], &items[i]);
+            if (common < PREFIX_MIN_SHARED) break;
+            if (common < shared) shared = common;
+            items[i].shared = common;
+            stats->prompts++;
+            stats->prompt_bytes += items[i].prompt_len;
+            stats->shared_bytes += common;
+        }
+        
+        long group = i - start > 1 ? ++stats->groups : 0;
+        uint64_t affinity = group ? prefix_key(items[start].prompt, shared) : 0;
+        if (group) stats->grouped += (long)(i - start);
+        for (size_t k = start; k < i; k++) {
+            items[k].group = group;
+            items[k].affinity = affinity;
+        }
+    }
+}
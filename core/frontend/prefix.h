@@ -0,0 +1,45 @@
+#ifndef PHASE3_PREFIX_H
+#define PHASE3_PREFIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Prompt-prefix scheduling for batches of generate calls. A window of queued
+// calls is put in dispatch order with prompts sorted, so those sharing a
+// prefix (a system prompt, a few-shot preamble) go out back to back, and
+// each group of them carries one affinity key so the balancer sends it to
+// one endpoint, where the server's prefix cache can reuse the shared part.
+// Prompts are compared as written in the arguments, escapes included.
+#define PREFIX_MIN_SHARED 32    // bytes two prompts must share to be grouped
+#define PREFIX_KEY_MAX 1024     // bytes of a group's shared prefix hashed into its key
+#define PREFIX_WINDOW_MAX 4096
+
+typedef struct {
+    const char *prompt;     // contents of the "prompt" string; NULL for other calls
+    size_t prompt_len;
+    size_t index;           // position in arrival order, set by the caller
+    long group;             // from prefix_plan: 0 outside any group
+    size_t shared;          // bytes in common with the previous prompt of its group
+    uint64_t affinity;      // 0 outside any group
+} PrefixItem;
+
+typedef struct {
+    long windows;
+    long prompts;
+    long groups;            // groups of two or more prompts
+    long grouped;           // prompts in those groups
+    unsigned long long prompt_bytes;
+    unsigned long long shared_bytes;    // sum of every prompt's shared
+} PrefixStats;
+
+// Find the string member "prompt" of a JSON object of arguments; -1 when
+// there is none
+int prefix_prompt(const char *args, size_t len, const char **prompt, size_t *prompt_len);
+
+// Reorder items for dispatch: calls without a prompt first, in arrival
+// order, then the prompts sorted, those sharing at least PREFIX_MIN_SHARED
+// bytes with their neighbour grouped. Group numbers continue from earlier
+// windows counted in stats.
+void prefix_plan(PrefixItem *items, size_t count, PrefixStats *stats);
+
+#endif
@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mcp_client.h"
+#include "record.h"
+
+int record_open(McpRecorder *recorder, const char *path) {
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->out = fopen(path, "a");
+    if (!recorder->out) return -1;
+    if (pthread_mutex_init(&recorder->lock, NULL) != 0) {
+        fclose(recorder->out);
+        recorder->out = NULL;
+        return -1;
+    }
+    recorder->start_ms = mcp_now_ms();
+    fprintf(recorder->out, "%s\t%ld\n", RECORD_SESSION, (long)time(NULL));
+    return 0;
+}
+
+// Arguments are JSON, where tabs and line breaks can only be whitespace
+// between tokens, so they are written as spaces and keep a call on its line
+static void write_args(FILE *out, const char *args) {
+    for (; *args; args++) {
+        char c = *args;
+        fputc(c == '\t' || c == '\n' || c == '\r' ? ' ' : c, out);
+    }
+}
+
+void record_write(McpRecorder *recorder, const char *tool, const char *args, double start_ms, double latency_ms,
+                  long http_status, int failed, uint64_t reply_bytes) {
+    pthread_mutex_lock(&recorder->lock);
+    fprintf(recorder->out, "%.3f\t%.3f\t%ld\t%d\t%llu\t%s\t", start_ms - recorder->start_ms, latency_ms,
+            http_status, failed ? 1 : 0, (unsigned long long)reply_bytes, tool);
+    write_args(recorder->out, args && *args ? args : "{}");
+    fputc('\n', recorder->out);
+    recorder->records++;
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+int record_close(McpRecorder *recorder) {
+    if (!recorder->out) return 0;
+    int failed = ferror(recorder->out);
+    failed |= fclose(recorder->out) != 0;
+    recorder->out = NULL;
+    pthread_mutex_destroy(&recorder->lock);
+    return failed ? -1 : 0;
+}
+
+// Cuts the field at *cursor off at its tab; NULL if there is none
+static char *next_field(char **cursor) {
+    char *field = *cursor;
+    char *tab = strchr(field, '\t');
+    
+    if (!tab) return NULL;
+    *tab = 0;
+    *cursor = tab + 1;
+    return field;
+}
+
+static int parse_entry(char *line, RecordEntry *entry) {
+    char *cursor = line, *end;
+    char *fields[6];
+    
+    memset(entry, 0, sizeof(*entry));
+    line[strcspn(line, "\r\n")] = 0;
+    if (strncmp(line, RECORD_SESSION "\t", sizeof(RECORD_SESSION)) == 0) {
+        entry->session = 1;
+        entry->session_epoch = strtol(line + sizeof(RECORD_SESSION), NULL, 10);
+        return 0;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (!(fields[i] = next_field(&cursor))) return -1;
+    }
+    entry->offset_ms = strtod(fields[0], &end);
+    if (end == fields[0] || *end) return -1;
+    entry->latency_ms = strtod(fields[1], &end);
+    if (end == fields[1] || *end) return -1;
+    entry->http_status = strtol(fields[2], NULL, 10);
+    entry->failed = strcmp(fields[3], "0") != 0;
+    entry->reply_bytes = strtoull(fields[4], NULL, 10);
+    if (!*fields[5]) return -1;
+    entry->tool = fields[5];
+    entry->args = *cursor ? cursor : "{}";
+    return 0;
+}
+
+int record_read(FILE *in, RecordEntry *entry, char **line, size_t *cap) {
+    while (getline(line, cap, in) >= 0) {
+        if (parse_entry(*line, entry) == 0) return 0;
+    }
+    return -1;
+}
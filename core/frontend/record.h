@@ -0,0 +1,46 @@
+#ifndef PHASE3_RECORD_H
+#define PHASE3_RECORD_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Traffic capture for replay. Every call that reached a server appends one
+// tab-separated line: its start in ms since the recording began, latency in
+// ms, HTTP status, 1 if it failed, reply body bytes, tool and arguments. A
+// "#session" line with the wall-clock start opens each run, so one file can
+// collect several. Replay re-sends the calls on the recorded schedule and
+// compares latency with what was recorded.
+#define RECORD_SESSION "#session"
+
+typedef struct {
+    FILE *out;
+    double start_ms;        // mcp_now_ms() when the session began
+    pthread_mutex_t lock;   // batch workers share one recording
+    long records;
+} McpRecorder;
+
+// Open path for appending and start a session
+int record_open(McpRecorder *recorder, const char *path);
+void record_write(McpRecorder *recorder, const char *tool, const char *args, double start_ms, double latency_ms,
+                  long http_status, int failed, uint64_t reply_bytes);
+// -1 if anything recorded failed to reach the file
+int record_close(McpRecorder *recorder);
+
+typedef struct {
+    int session;            // a session line; only session_epoch is set
+    long session_epoch;
+    double offset_ms;
+    double latency_ms;
+    long http_status;
+    int failed;
+    uint64_t reply_bytes;
+    const char *tool;       // into the line buffer
+    const char *args;
+} RecordEntry;
+
+// Next entry of a recording into entry, split in place in the getline
+// buffer *line; -1 at the end. Lines that do not parse are skipped.
+int record_read(FILE *in, RecordEntry *entry, char **line, size_t *cap);
+
+#endif
@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "shm_ring.h"
+
+enum { FIELD_MAGIC, FIELD_VERSION, FIELD_CAPACITY, FIELD_SERVER_PID, FIELD_CLIENT_PID, FIELD_ATTACHES };
+
+#define REQUEST_HEAD 64
+#define REQUEST_TAIL 128
+#define REPLY_HEAD 192
+#define REPLY_TAIL 256
+
+static uint32_t *field(const ShmRing *ring, int index) {
+    return (uint32_t *)ring->base + index;
+}
+
+static uint64_t *ring_index(const ShmRing *ring, size_t offset) {
+    return (uint64_t *)(ring->base + offset);
+}
+
+static unsigned char *ring_data(const ShmRing *ring, int reply) {
+    return ring->base + SHM_RING_DATA + (reply ? ring->capacity : 0);
+}
+
+static size_t frame_size(size_t len) {
+    return SHM_FRAME_HEADER + ((len + 7) & ~(size_t)7);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Standard CRC-32, the same as zlib.crc32 on the Python side. The table is
+// filled by the first attach, before any frame is checked.
+static uint32_t crc_table[256];
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *bytes, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// The doorbell FIFO for one ring. Both ends are opened read-write, so a
+// write never fails for want of a reader and a read never sees EOF.
+static int open_bell(const char *name, const char *ring) {
+    char path[256];
+    
+    if (name[0] == '/') name++;
+    if (snprintf(path, sizeof(path), "/dev/shm/%s.%s", name, ring) >= (int)sizeof(path)) return -1;
+    return open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+}
+
+// A full FIFO already has the other side's attention
+static void ring_bell(int bell) {
+    char byte = 0;
+    ssize_t n = write(bell, &byte, 1);
+    (void)n;
+}
+
+static void drain_bell(int bell) {
+    char bytes[256];
+    while (read(bell, bytes, sizeof(bytes)) > 0) {}
+}
+
+static int pid_alive(uint32_t pid) {
+    return pid != 0 && (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+}
+
+int shm_ring_attach(ShmRing *ring, const char *name) {
+    struct stat st;
+    
+    memset(ring, 0, sizeof(*ring));
+    if (!crc_table[1]) crc_init();
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || st.st_size < SHM_RING_DATA) {
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    ring->base = base;
+    ring->size = (size_t)st.st_size;
+    ring->request_bell = ring->reply_bell = -1;
+    
+    ring->capacity = __atomic_load_n(field(ring, FIELD_CAPACITY), __ATOMIC_ACQUIRE);
+    int valid = __atomic_load_n(field(ring, FIELD_MAGIC), __ATOMIC_ACQUIRE) == SHM_RING_MAGIC &&
+                *field(ring, FIELD_VERSION) == SHM_RING_VERSION && ring->capacity >= 4096 &&
+                (ring->capacity & (ring->capacity - 1)) == 0 &&
+                SHM_RING_DATA + 2 * ring->capacity <= ring->size && shm_ring_server_alive(ring);
+                
+    // One frontend at a time; a holder that exited without detaching is
+    // taken over
+    uint32_t holder = __atomic_load_n(field(ring, FIELD_CLIENT_PID), __ATOMIC_ACQUIRE);
+    uint32_t self = (uint32_t)getpid();
+    if (!valid || (holder != self && pid_alive(holder)) ||
+        !__atomic_compare_exchange_n(field(ring, FIELD_CLIENT_PID), &holder, self, 0, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE)) {
+        munmap(ring->base, ring->size);
+        memset(ring, 0, sizeof(*ring));
+        return -1;
+    }
+    
+    ring->request_bell = open_bell(name, "requests");
+    ring->reply_bell = open_bell(name, "replies");
+    if (ring->request_bell < 0 || ring->reply_bell < 0) {
+        shm_ring_detach(ring);
+        return -1;
+    }
+    
+    ring->session = __atomic_fetch_add(field(ring, FIELD_ATTACHES), 1, __ATOMIC_ACQ_REL);
+    drain_bell(ring->reply_bell);
+    uint64_t head = __atomic_load_n(ring_index(ring, REPLY_HEAD), __ATOMIC_ACQUIRE);
+    __atomic_store_n(ring_index(ring, REPLY_TAIL), head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void shm_ring_detach(ShmRing *ring) {
+    if (!ring->base) return;
+    if (ring->request_bell >= 0) close(ring->request_bell);
+    if (ring->reply_bell >= 0) close(ring->reply_bell);
+    uint32_t self = (uint32_t)getpid();
+    __atomic_compare_exchange_n(field(ring, FIELD_CLIENT_PID), &self, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    munmap(ring->base, ring->size);
+    memset(ring, 0, sizeof(*ring));
+}
+
+int shm_ring_server_alive(const ShmRing *ring) {
+    return ring->base && pid_alive(__atomic_load_n(field(ring, FIELD_SERVER_PID), __ATOMIC_ACQUIRE));
+}
+
+static void ring_write(unsigned char *data, size_t capacity, uint64_t at, const void *src, size_t len) {
+    size_t offset = (size_t)(at & (capacity - 1));
+    size_t first = len < capacity - offset ? len : capacity - offset;
+    
+    memcpy(data + offset, src, first);
+    memcpy(data, (const unsigned char *)src + first, len - first);
+}
+
+int shm_ring_send(ShmRing *ring, uint32_t tag, uint32_t flags, const void *body, size_t len) {
+    size_t size = frame_size(len);
+    
+    if (!ring->base || len > UINT32_MAX || size > ring->capacity) return -1;
+    uint64_t head = __atomic_load_n(ring_index(ring, REQUEST_HEAD), __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(ring_index(ring, REQUEST_TAIL), __ATOMIC_ACQUIRE);
+    if (head - tail + size > ring->capacity) return 1;
+    
+    uint32_t header[4] = { (uint32_t)len, tag, crc32_update(0, body, len), flags };
+    unsigned char *data = ring_data(ring, 0);
+    ring_write(data, ring->capacity, head, header, sizeof(header));
+    ring_write(data, ring->capacity, head + SHM_FRAME_HEADER, body, len);
+    __atomic_store_n(ring_index(ring, REQUEST_HEAD), head + size, __ATOMIC_RELEASE);
+    ring_bell(ring->request_bell);
+    return 0;
+}
+
+// Skip what cannot be read: the frame at tail when its size is plausible,
+// otherwise everything written so far
+static void drop_torn(ShmRing *ring, uint64_t tail, uint64_t head, size_t size) {
+    uint64_t next = size <= head - tail ? tail + size : head;
+    __atomic_store_n(ring_index(ring, REPLY_TAIL), next, __ATOMIC_RELEASE);
+    ring->torn_since_ms = 0;
+}
+
+int shm_ring_peek(ShmRing *ring, McpFrame *frame) {
+    if (!ring->base) return 0;
+    
+    uint64_t tail = __atomic_load_n(ring_index(ring, REPLY_TAIL), __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(ring_index(ring, REPLY_HEAD), __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        // A frame published after the drain rings the bell again
+        drain_bell(ring->reply_bell);
+        head = __atomic_load_n(ring_index(ring, REPLY_HEAD), __ATOMIC_ACQUIRE);
+        if (head == tail) return 0;
+    }
+    
+    const unsigned char *data = ring_data(ring, 1);
+    size_t offset = (size_t)(tail & (ring->capacity - 1));
+    uint32_t header[4];
+    size_t first = sizeof(header) < ring->capacity - offset ? sizeof(header) : ring->capacity - offset;
+    memcpy(header, data + offset, first);
+    memcpy((unsigned char *)header + first, data, sizeof(header) - first);
+    
+    size_t size = frame_size(header[0]);
+    if (head - tail < SHM_FRAME_HEADER || size > ring->capacity) {
+        drop_torn(ring, tail, head, size);
+        return 0;
+    }
+    int complete = size <= head - tail;
+    if (complete) {
+        size_t body = (offset + SHM_FRAME_HEADER) & (ring->capacity - 1);
+        frame->tag = header[1];
+        frame->flags = header[3];
+        frame->size = size;
+        frame->part[0] = data + body;
+        frame->len[0] = header[0] < ring->capacity - body ? header[0] : ring->capacity - body;
+        frame->part[1] = data;
+        frame->len[1] = header[0] - frame->len[0];
+        uint32_t crc = crc32_update(0, frame->part[0], frame->len[0]);
+        complete = crc32_update(crc, frame->part[1], frame->len[1]) == header[2];
+    }
+    if (!complete) {
+        double now = now_ms();
+        if (ring->torn_since_ms == 0) ring->torn_since_ms = now;
+        else if (now - ring->torn_since_ms > SHM_TORN_MS) drop_torn(ring, tail, head, size);
+        return 0;
+    }
+    ring->torn_since_ms = 0;
+    return 1;
+}
+
+void shm_ring_pop(ShmRing *ring, const McpFrame *frame) {
+    uint64_t tail = __atomic_load_n(ring_index(ring, REPLY_TAIL), __ATOMIC_RELAXED);
+    __atomic_store_n(ring_index(ring, REPLY_TAIL), tail + frame->size, __ATOMIC_RELEASE);
+}
+
+int shm_ring_fd(const ShmRing *ring) {
+    return ring->base ? ring->reply_bell : -1;
+}
+
+// poll counts in milliseconds, so a shorter wait is a nap unless the bell
+// has already rung
+void shm_ring_wait(ShmRing *ring, long timeout_us) {
+    struct pollfd bell = { shm_ring_fd(ring), POLLIN, 0 };
+    
+    if (bell.fd < 0) return;
+    if (timeout_us >= 1000) {
+        poll(&bell, 1, (int)(timeout_us / 1000));
+    } else if (poll(&bell, 1, 0) == 0) {
+        struct timespec ts = { 0, timeout_us * 1000 };
+        nanosleep(&ts, NULL);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef PHASE3_SHM_RING_H
+#define PHASE3_SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "transport.h"
+
+// Same-host transport without HTTP: a POSIX shared memory segment, created
+// by the server's adapter (core/shm_adapter.py), holding two single-producer
+// single-consumer byte rings, requests from the frontend and replies back.
+// The layout is fixed so the Python side can map it too:
+//   0     uint32 magic, version, capacity, server pid, client pid, attaches
+//   64    request ring head, 128 its tail (uint64 bytes ever written / read)
+//   192   reply ring head, 256 its tail
+//   4096  request ring data, then reply ring data, capacity bytes each
+// A frame is a 16-byte header (body length, tag, CRC-32 of the body, flags,
+// TRANSPORT_FRAME_CBOR for a CBOR body) and the body, padded to 8 bytes; it
+// may wrap around the end of the ring.
+// Indices are published with release stores and read with acquire loads.
+// Python has no fences, so a consumer also checks the CRC and treats a
+// mismatch as a frame that is not complete yet.
+// Next to the segment the adapter makes two FIFOs, /dev/shm/NAME.requests
+// and /dev/shm/NAME.replies, as doorbells: a producer writes a byte to the
+// ring's FIFO after publishing a frame, and a consumer that finds the ring
+// empty drains the FIFO and looks once more before sleeping on it, so no
+// frame goes unnoticed and neither side polls an idle ring.
+#define SHM_RING_NAME "/phase3_mcp"
+#define SHM_RING_MAGIC 0x524d3350u     // "P3MR"
+#define SHM_RING_VERSION 2
+#define SHM_RING_DATA 4096
+#define SHM_FRAME_HEADER 16
+
+// A frame that still fails its CRC after this long is dropped
+#define SHM_TORN_MS 100
+
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t capacity;
+    uint32_t session;       // attaches before this one, to tell frontends apart
+    double torn_since_ms;   // first CRC mismatch at the current read position
+    int request_bell;       // FIFO rung after each request frame
+    int reply_bell;         // FIFO the adapter rings after each reply frame
+} ShmRing;
+
+// Map the segment and claim the client side. Fails when no live adapter
+// serves it or another live frontend holds it. Replies left over from an
+// earlier frontend are dropped; tags carrying the session keep ones that
+// are still on their way from matching this frontend's calls.
+int shm_ring_attach(ShmRing *ring, const char *name);
+void shm_ring_detach(ShmRing *ring);
+int shm_ring_server_alive(const ShmRing *ring);
+
+// Append a request frame. Returns 0, 1 while the ring is too full to take
+// it and -1 for a frame that can never fit.
+int shm_ring_send(ShmRing *ring, uint32_t tag, uint32_t flags, const void *body, size_t len);
+
+// The next reply frame, left in place: 1 with frame filled in, 0 while none
+// is complete. Its body stays valid until shm_ring_pop releases it.
+int shm_ring_peek(ShmRing *ring, McpFrame *frame);
+void shm_ring_pop(ShmRing *ring, const McpFrame *frame);
+
+// Readable once a reply frame may have arrived since peek last found none
+int shm_ring_fd(const ShmRing *ring);
+
+// Sleep until then, at most timeout_us
+void shm_ring_wait(ShmRing *ring, long timeout_us);
+
+#endif
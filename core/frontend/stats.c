@@ -0,0 +1,286 @@
+#include <string.h>
+#include "stats.h"
+
+#define HIST_LINEAR (1u << (HIST_SUB_BITS + 1))
+#define HIST_MAX_VALUE 0xffffffffull
+
+const char *const stat_phase_names[STAT_COUNT] = {
+    "connect", "pretransfer", "starttransfer", "total", "serialize", "parse"
+};
+
+static int bucket_index(uint64_t v) {
+    if (v < HIST_LINEAR) return (int)v;
+    if (v > HIST_MAX_VALUE) v = HIST_MAX_VALUE;
+    
+    int mag = 63 - __builtin_clzll(v);
+    int shift = mag - HIST_SUB_BITS;
+    int sub = (int)((v >> shift) & ((1u << HIST_SUB_BITS) - 1));
+    return (mag - HIST_SUB_BITS + 1) * (1 << HIST_SUB_BITS) + sub;
+}
+
+// Highest value that lands in bucket idx
+static uint64_t bucket_upper(int idx) {
+    if (idx < (int)HIST_LINEAR) return (uint64_t)idx;
+    
+    int mag = idx / (1 << HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(idx % (1 << HIST_SUB_BITS) + (1 << HIST_SUB_BITS));
+    int shift = mag - HIST_SUB_BITS;
+    return (sub << shift) + ((1ull << shift) - 1);
+}
+
+void hist_record(Histogram *h, uint64_t value_us) {
+    double sum_us = h->sum_us + (double)value_us;
+    
+    STAT_ADD(h->counts[bucket_index(value_us)], 1);
+    if (h->count == 0 || value_us < h->min_us) STAT_SET(h->min_us, value_us);
+    if (value_us > h->max_us) STAT_SET(h->max_us, value_us);
+    STAT_ADD(h->count, 1);
+    __atomic_store(&h->sum_us, &sum_us, __ATOMIC_RELAXED);
+}
+
+// Reads from as the metrics thread does, so from may still be recording
+void hist_merge(Histogram *into, const Histogram *from) {
+    uint64_t count = STAT_LOAD(from->count);
+    uint64_t min_us = STAT_LOAD(from->min_us), max_us = STAT_LOAD(from->max_us);
+    double sum_us;
+    
+    if (count == 0) return;
+    __atomic_load(&from->sum_us, &sum_us, __ATOMIC_RELAXED);
+    sum_us += into->sum_us;
+    for (int i = 0; i < HIST_BUCKETS; i++) STAT_ADD(into->counts[i], STAT_LOAD(from->counts[i]));
+    if (into->count == 0 || min_us < into->min_us) STAT_SET(into->min_us, min_us);
+    if (max_us > into->max_us) STAT_SET(into->max_us, max_us);
+    STAT_ADD(into->count, count);
+    __atomic_store(&into->sum_us, &sum_us, __ATOMIC_RELAXED);
+}
+
+uint64_t hist_percentile(const Histogram *h, double p) {
+    if (h->count == 0) return 0;
+    
+    uint64_t target = (uint64_t)(p * h->count + 0.999999);
+    if (target < 1) target = 1;
+    
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t value = bucket_upper(i);
+            return value > h->max_us ? h->max_us : value;
+        }
+    }
+    return h->max_us;
+}
+
+double hist_mean(const Histogram *h) {
+    return h->count ? h->sum_us / h->count : 0.0;
+}
+
+// Summary percentiles plus the non-empty buckets as [upper_us, count] pairs
+void hist_write_json(const Histogram *h, FILE *out) {
+    fprintf(out, "{\"count\":%llu,\"min_us\":%llu,\"mean_us\":%.1f,\"p50_us\":%llu,\"p90_us\":%llu,"
+            "\"p99_us\":%llu,\"p999_us\":%llu,\"max_us\":%llu,\"buckets\":[",
+            (unsigned long long)h->count, (unsigned long long)h->min_us, hist_mean(h),
+            (unsigned long long)hist_percentile(h, 0.50), (unsigned long long)hist_percentile(h, 0.90),
+            (unsigned long long)hist_percentile(h, 0.99), (unsigned long long)hist_percentile(h, 0.999),
+            (unsigned long long)h->max_us);
+            
+    int first = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (!h->counts[i]) continue;
+        fprintf(out, "%s[%llu,%llu]", first ? "" : ",",
+                (unsigned long long)bucket_upper(i), (unsigned long long)h->counts[i]);
+        first = 0;
+    }
+    fprintf(out, "]}");
+}
+
+ToolStats *stats_tool(StatsTable *table, const char *tool) {
+    for (size_t i = 0; i < table->ntools; i++) {
+        if (strcmp(table->tools[i].tool, tool) == 0) return &table->tools[i];
+    }
+    
+    if (table->ntools == MAX_TOOL_STATS) return &table->tools[MAX_TOOL_STATS - 1];
+    
+    // Names never change once published, so the metrics thread can read
+    // every entry below ntools
+    ToolStats *entry = &table->tools[table->ntools];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->tool, sizeof(entry->tool), "%s", table->ntools == MAX_TOOL_STATS - 1 ? "other" : tool);
+    // Names are written into JSON and metric labels unescaped
+    for (char *c = entry->tool; *c; c++) {
+        if (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20) *c = '_';
+    }
+    __atomic_store_n(&table->ntools, table->ntools + 1, __ATOMIC_RELEASE);
+    return entry;
+}
+
+void stats_merge(StatsTable *into, const StatsTable *from) {
+    size_t ntools = __atomic_load_n(&from->ntools, __ATOMIC_ACQUIRE);
+    
+    for (size_t i = 0; i < ntools; i++) {
+        const ToolStats *src = &from->tools[i];
+        ToolStats *entry = stats_tool(into, src->tool);
+        uint64_t arena_peak = STAT_LOAD(src->arena_peak);
+        STAT_ADD(entry->calls, STAT_LOAD(src->calls));
+        STAT_ADD(entry->errors, STAT_LOAD(src->errors));
+        STAT_ADD(entry->wire_bytes, STAT_LOAD(src->wire_bytes));
+        STAT_ADD(entry->body_bytes, STAT_LOAD(src->body_bytes));
+        if (arena_peak > entry->arena_peak) STAT_SET(entry->arena_peak, arena_peak);
+        device_fold(&entry->device, &src->device);
+        for (int p = 0; p < STAT_COUNT; p++) hist_merge(&entry->phase[p], &src->phase[p]);
+    }
+}
+
+static uint64_t ms_to_us(double ms) {
+    return ms > 0 ? (uint64_t)(ms * 1000.0 + 0.5) : 0;
+}
+
+void stats_record(StatsTable *table, const char *tool, const McpTiming *timing, int error) {
+    ToolStats *entry = stats_tool(table, tool);
+    
+    STAT_ADD(entry->calls, 1);
+    if (error) STAT_ADD(entry->errors, 1);
+    STAT_ADD(entry->wire_bytes, timing->wire_bytes);
+    STAT_ADD(entry->body_bytes, timing->body_bytes);
+    if (timing->arena_bytes > entry->arena_peak) STAT_SET(entry->arena_peak, timing->arena_bytes);
+    device_fold(&entry->device, &timing->device);
+    hist_record(&entry->phase[STAT_CONNECT], ms_to_us(timing->connect_ms));
+    hist_record(&entry->phase[STAT_PRETRANSFER], ms_to_us(timing->pretransfer_ms));
+    hist_record(&entry->phase[STAT_STARTTRANSFER], ms_to_us(timing->starttransfer_ms));
+    hist_record(&entry->phase[STAT_TOTAL], ms_to_us(timing->total_ms));
+    hist_record(&entry->phase[STAT_SERIALIZE], ms_to_us(timing->serialize_ms));
+    hist_record(&entry->phase[STAT_PARSE], ms_to_us(timing->parse_ms));
+}
+
+void stats_print(const StatsTable *table, FILE *out) {
+    if (table->ntools == 0) {
+        fprintf(out, "No calls recorded\n");
+        return;
+    }
+    
+    fprintf(out, "%-18s %6s %6s  %-13s %9s %9s %9s %9s\n",
+            "Tool", "Calls", "Errors", "Phase (ms)", "p50", "p90", "p99", "max");
+    for (size_t i = 0; i < table->ntools; i++) {
+        const ToolStats *entry = &table->tools[i];
+        for (int p = 0; p < STAT_COUNT; p++) {
+            const Histogram *h = &entry->phase[p];
+            if (p == 0) {
+                fprintf(out, "%-18s %6ld %6ld  ", entry->tool, entry->calls, entry->errors);
+            } else {
+                fprintf(out, "%-18s %6s %6s  ", "", "", "");
+            }
+            fprintf(out, "%-13s %9.3f %9.3f %9.3f %9.3f\n", stat_phase_names[p],
+                    hist_percentile(h, 0.50) / 1000.0, hist_percentile(h, 0.90) / 1000.0,
+                    hist_percentile(h, 0.99) / 1000.0, h->max_us / 1000.0);
+        }
+        if (entry->body_bytes > 0) {
+            fprintf(out, "%-18s %6s %6s  %-13s %llu wire, %llu decoded (%.1fx)\n", "", "", "", "bytes",
+                    (unsigned long long)entry->wire_bytes, (unsigned long long)entry->body_bytes,
+                    entry->wire_bytes ? (double)entry->body_bytes / entry->wire_bytes : 0.0);
+        }
+        if (entry->arena_peak > 0) {
+            fprintf(out, "%-18s %6s %6s  %-13s %llu bytes peak per call\n", "", "", "", "arena",
+                    (unsigned long long)entry->arena_peak);
+        }
+        if (entry->device.samples > 0) {
+            fprintf(out, "%-18s %6s %6s  %-13s ", "", "", "", "device");
+            device_print(&entry->device, out);
+            fputc('\n', out);
+        }
+    }
+}
+
+void stats_write_json(const StatsTable *table, FILE *out) {
+    fprintf(out, "{\"tools\":{");
+    for (size_t i = 0; i < table->ntools; i++) {
+        const ToolStats *entry = &table->tools[i];
+        fprintf(out, "%s\"%s\":{\"calls\":%ld,\"errors\":%ld,\"wire_bytes\":%llu,\"body_bytes\":%llu,"
+                "\"arena_peak_bytes\":%llu", i ? "," : "", entry->tool, entry->calls, entry->errors,
+                (unsigned long long)entry->wire_bytes, (unsigned long long)entry->body_bytes,
+                (unsigned long long)entry->arena_peak);
+        for (int p = 0; p < STAT_COUNT; p++) {
+            fprintf(out, ",\"%s\":", stat_phase_names[p]);
+            hist_write_json(&entry->phase[p], out);
+        }
+        if (entry->device.samples > 0) {
+            fprintf(out, ",\"device\":");
+            device_write_json(&entry->device, out);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}}\n");
+}
+
+int stats_dump_json(const StatsTable *table, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+    stats_write_json(table, out);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Coarse bounds for Prometheus: each counts the fine buckets whose values
+// all lie at or below it, so it may miss part of one fine bucket (about 6%)
+static const double prometheus_bounds_s[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 120
+};
+
+static void hist_write_prometheus(const Histogram *h, const char *name, const char *labels, FILE *out) {
+    size_t nbounds = sizeof(prometheus_bounds_s) / sizeof(prometheus_bounds_s[0]);
+    uint64_t seen = 0;
+    size_t b = 0;
+    double sum_us;
+    
+    // Buckets are counted before count itself, so sum them for a total
+    // that matches the last bucket
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        uint64_t upper = bucket_upper(i);
+        for (; b < nbounds && (double)upper > prometheus_bounds_s[b] * 1e6; b++) {
+            fprintf(out, "%s_bucket{%s,le=\"%g\"} %llu\n", name, labels, prometheus_bounds_s[b],
+                    (unsigned long long)seen);
+        }
+        seen += STAT_LOAD(h->counts[i]);
+    }
+    for (; b < nbounds; b++) {
+        fprintf(out, "%s_bucket{%s,le=\"%g\"} %llu\n", name, labels, prometheus_bounds_s[b], (unsigned long long)seen);
+    }
+    __atomic_load(&h->sum_us, &sum_us, __ATOMIC_RELAXED);
+    fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels, (unsigned long long)seen);
+    fprintf(out, "%s_sum{%s} %.6f\n", name, labels, sum_us / 1e6);
+    fprintf(out, "%s_count{%s} %llu\n", name, labels, (unsigned long long)seen);
+}
+
+void stats_write_prometheus(const StatsTable *table, const char *prefix, FILE *out) {
+    static const struct { const char *name; const char *help; } counters[] = {
+        { "calls_total", "Tool calls finished" },
+        { "call_errors_total", "Tool calls that failed or returned a JSON-RPC error" },
+        { "wire_bytes_total", "Reply bytes received, before Content-Encoding is undone" },
+        { "body_bytes_total", "Reply bytes after decoding" },
+    };
+    size_t ntools = __atomic_load_n(&table->ntools, __ATOMIC_ACQUIRE);
+    char name[128], labels[96];
+    
+    for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+        fprintf(out, "# HELP %s_%s %s, by tool\n# TYPE %s_%s counter\n", prefix, counters[c].name,
+                counters[c].help, prefix, counters[c].name);
+        for (size_t i = 0; i < ntools; i++) {
+            const ToolStats *entry = &table->tools[i];
+            unsigned long long value = c == 0 ? (unsigned long long)STAT_LOAD(entry->calls) :
+                                       c == 1 ? (unsigned long long)STAT_LOAD(entry->errors) :
+                                       c == 2 ? (unsigned long long)STAT_LOAD(entry->wire_bytes) :
+                                       (unsigned long long)STAT_LOAD(entry->body_bytes);
+            fprintf(out, "%s_%s{tool=\"%s\"} %llu\n", prefix, counters[c].name, entry->tool, value);
+        }
+    }
+    
+    snprintf(name, sizeof(name), "%s_call_seconds", prefix);
+    fprintf(out, "# HELP %s Call phases by tool: connect, pretransfer and starttransfer as time into the "
+            "transfer, serialize and parse as their own duration, total for the whole call\n"
+            "# TYPE %s histogram\n", name, name);
+    for (size_t i = 0; i < ntools; i++) {
+        const ToolStats *entry = &table->tools[i];
+        for (int p = 0; p < STAT_COUNT; p++) {
+            snprintf(labels, sizeof(labels), "tool=\"%s\",phase=\"%s\"", entry->tool, stat_phase_names[p]);
+            hist_write_prometheus(&entry->phase[p], name, labels, out);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef PHASE3_STATS_H
+#define PHASE3_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "telemetry.h"
+
+// Log-linear histogram in the style of HdrHistogram: values below 32 us get
+// exact buckets, above that each power of two is split into 16 sub-buckets
+// (about 6% relative precision) up to 2^32 us.
+#define HIST_SUB_BITS 4
+#define HIST_BUCKETS 464
+#define MAX_TOOL_STATS 32
+
+// Counters the metrics thread (metrics.h) reads while the thread making
+// calls updates them. That thread is their only writer, so it stores each
+// new value with a relaxed atomic store: an ordinary load and store on the
+// call path, with no lock or locked instruction, and the reader never sees
+// a torn value.
+#define STAT_ADD(counter, n) __atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+#define STAT_SUB(counter, n) __atomic_store_n(&(counter), (counter) - (n), __ATOMIC_RELAXED)
+#define STAT_SET(counter, value) __atomic_store_n(&(counter), (value), __ATOMIC_RELAXED)
+#define STAT_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t min_us;
+    uint64_t max_us;
+    double sum_us;
+} Histogram;
+
+// Per-call timing and size. The curl values are cumulative from the start of
+// the transfer, as reported by CURLINFO_*_TIME_T. wire_bytes is the body as
+// received, before any Content-Encoding is undone; body_bytes is after.
+// arena_bytes is the per-call arena in use when the call finished. device
+// is what the telemetry sampler read while the call ran.
+typedef struct {
+    double connect_ms;
+    double pretransfer_ms;
+    double starttransfer_ms;
+    double total_ms;
+    double serialize_ms;
+    double parse_ms;
+    uint64_t wire_bytes;
+    uint64_t body_bytes;
+    uint64_t arena_bytes;
+    DeviceState device;
+} McpTiming;
+
+enum {
+    STAT_CONNECT,
+    STAT_PRETRANSFER,
+    STAT_STARTTRANSFER,
+    STAT_TOTAL,
+    STAT_SERIALIZE,
+    STAT_PARSE,
+    STAT_COUNT
+};
+
+typedef struct {
+    char tool[32];
+    long calls;
+    long errors;
+    uint64_t wire_bytes;
+    uint64_t body_bytes;
+    uint64_t arena_peak;    // largest arena_bytes of any call
+    DeviceState device;     // worst over every call with readings
+    Histogram phase[STAT_COUNT];
+} ToolStats;
+
+typedef struct {
+    ToolStats tools[MAX_TOOL_STATS];
+    size_t ntools;          // published with a release store once an entry is set up
+} StatsTable;
+
+void hist_record(Histogram *h, uint64_t value_us);
+void hist_merge(Histogram *into, const Histogram *from);
+uint64_t hist_percentile(const Histogram *h, double p);
+double hist_mean(const Histogram *h);
+void hist_write_json(const Histogram *h, FILE *out);
+
+// Returns the entry for tool, creating it on first use. The last entry is
+// "other", shared by every tool that finds the rest of the table taken.
+ToolStats *stats_tool(StatsTable *table, const char *tool);
+void stats_record(StatsTable *table, const char *tool, const McpTiming *timing, int error);
+// Add every tool of from to into; from may still be recording, as for
+// hist_merge
+void stats_merge(StatsTable *into, const StatsTable *from);
+void stats_print(const StatsTable *table, FILE *out);
+void stats_write_json(const StatsTable *table, FILE *out);
+int stats_dump_json(const StatsTable *table, const char *path);
+
+// Per-tool counters and phase histograms in the Prometheus text format,
+// every metric name starting with prefix. Safe to call from another thread
+// while calls are being recorded.
+void stats_write_prometheus(const StatsTable *table, const char *prefix, FILE *out);
+
+extern const char *const stat_phase_names[STAT_COUNT];
+
+#endif
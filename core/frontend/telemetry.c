@@ -0,0 +1,308 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mcp_client.h"
+#include "telemetry.h"
+
+// GPU load in per mille: under the devfreq device on L4T 32 and later, at
+// a fixed platform path on older releases
+static const char *const gpu_load_paths[] = {
+    "/sys/devices/gpu.0/load",
+    "/sys/devices/platform/gpu.0/load",
+    "/sys/devices/platform/17000000.ga10b/load",
+    "/sys/devices/platform/17000000.gv11b/load",
+    "/sys/devices/platform/bus@0/17000000.gpu/load",
+};
+
+// EMC clock in Hz; only in debugfs, so only readable as root
+static const char *const emc_paths[] = {
+    "/sys/kernel/debug/bpmp/debug/clk/emc/rate",
+    "/sys/kernel/debug/clk/emc/clk_rate",
+};
+
+static const char *const gpu_names[] = { "gpu", "ga10b", "gv11b", "gp10b" };
+
+// Thermal zones that are not a die temperature: PMIC-Die on Nano, TX1 and
+// TX2 always reads 100 C, and thermal-fan-est is the fan governor's estimate
+static const char *const skipped_zones[] = { "PMIC-Die", "thermal-fan-est" };
+
+static int open_first(const char *const *paths, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int fd = open(paths[i], O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) return fd;
+    }
+    return -1;
+}
+
+// The GPU's devfreq node: its cur_freq, and the load file of its device
+static void open_gpu_devfreq(McpTelemetry *telemetry) {
+    DIR *dir = opendir("/sys/class/devfreq");
+    struct dirent *entry;
+    char path[512];
+    
+    if (!dir) return;
+    while (telemetry->gpu_freq_fd < 0 && (entry = readdir(dir))) {
+        int gpu = 0;
+        for (size_t i = 0; i < sizeof(gpu_names) / sizeof(gpu_names[0]); i++) {
+            if (strstr(entry->d_name, gpu_names[i])) gpu = 1;
+        }
+        if (!gpu) continue;
+        snprintf(path, sizeof(path), "/sys/class/devfreq/%s/cur_freq", entry->d_name);
+        telemetry->gpu_freq_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (telemetry->gpu_load_fd < 0) {
+            snprintf(path, sizeof(path), "/sys/class/devfreq/%s/device/load", entry->d_name);
+            telemetry->gpu_load_fd = open(path, O_RDONLY | O_CLOEXEC);
+        }
+    }
+    closedir(dir);
+}
+
+static int read_text(int fd, char *buf, size_t size) {
+    ssize_t n = fd >= 0 ? pread(fd, buf, size - 1, 0) : -1;
+    
+    if (n <= 0) return -1;
+    buf[n] = 0;
+    return 0;
+}
+
+static int zone_skipped(int zone) {
+    char path[64], type[64];
+    
+    snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/type", zone);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    int text = read_text(fd, type, sizeof(type));
+    if (fd >= 0) close(fd);
+    if (text != 0) return 0;
+    type[strcspn(type, "\n")] = 0;
+    for (size_t i = 0; i < sizeof(skipped_zones) / sizeof(skipped_zones[0]); i++) {
+        if (strcmp(type, skipped_zones[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static long read_long(int fd) {
+    char buf[64];
+    char *end;
+    
+    if (read_text(fd, buf, sizeof(buf)) != 0) return -1;
+    long value = strtol(buf, &end, 10);
+    return end == buf || value < 0 ? -1 : value;
+}
+
+static long meminfo_kb(const char *text, const char *key) {
+    const char *at = strstr(text, key);
+    return at ? strtol(at + strlen(key), NULL, 10) : -1;
+}
+
+static long read_ram_used_mb(int fd) {
+    char buf[4096];
+    
+    if (read_text(fd, buf, sizeof(buf)) != 0) return -1;
+    long total = meminfo_kb(buf, "MemTotal:"), available = meminfo_kb(buf, "MemAvailable:");
+    return total < 0 || available < 0 ? -1 : (total - available) / 1024;
+}
+
+static void take_sample(McpTelemetry *telemetry, DeviceSample *sample) {
+    long hz;
+    
+    sample->at_us = (int64_t)(mcp_now_ms() * 1000.0);
+    sample->gpu_load = read_long(telemetry->gpu_load_fd);
+    hz = read_long(telemetry->gpu_freq_fd);
+    sample->gpu_mhz = hz < 0 ? -1 : hz / 1000000;
+    hz = read_long(telemetry->emc_fd);
+    sample->emc_mhz = hz < 0 ? -1 : hz / 1000000;
+    sample->temp_mc = -1;
+    for (size_t i = 0; i < telemetry->nzones; i++) {
+        long temp = read_long(telemetry->zone_fds[i]);
+        if (temp > sample->temp_mc) sample->temp_mc = temp;
+    }
+    sample->ram_used_mb = read_ram_used_mb(telemetry->meminfo_fd);
+}
+
+static void publish(McpTelemetry *telemetry, const DeviceSample *sample) {
+    uint64_t seq = telemetry->seq;
+    DeviceSample *slot = &telemetry->ring[telemetry->count % TELEMETRY_RING];
+    
+    __atomic_store_n(&telemetry->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->at_us, sample->at_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->gpu_load, sample->gpu_load, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->gpu_mhz, sample->gpu_mhz, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->emc_mhz, sample->emc_mhz, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->temp_mc, sample->temp_mc, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->ram_used_mb, sample->ram_used_mb, __ATOMIC_RELAXED);
+    __atomic_store_n(&telemetry->count, telemetry->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&telemetry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void *sample_loop(void *arg) {
+    McpTelemetry *telemetry = arg;
+    DeviceSample sample;
+    
+    while (!__atomic_load_n(&telemetry->stop, __ATOMIC_ACQUIRE)) {
+        poll(NULL, 0, telemetry->interval_ms);
+        take_sample(telemetry, &sample);
+        publish(telemetry, &sample);
+    }
+    return NULL;
+}
+
+static void close_sources(McpTelemetry *telemetry) {
+    int fds[] = { telemetry->gpu_load_fd, telemetry->gpu_freq_fd, telemetry->emc_fd, telemetry->meminfo_fd };
+    
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    for (size_t i = 0; i < telemetry->nzones; i++) close(telemetry->zone_fds[i]);
+    telemetry->nzones = 0;
+}
+
+int telemetry_start(McpTelemetry *telemetry, int interval_ms) {
+    DeviceSample sample;
+    char path[64];
+    
+    memset(telemetry, 0, sizeof(*telemetry));
+    telemetry->gpu_freq_fd = -1;
+    telemetry->gpu_load_fd = -1;
+    telemetry->interval_ms = interval_ms > 0 ? interval_ms : TELEMETRY_DEFAULT_MS;
+    open_gpu_devfreq(telemetry);
+    if (telemetry->gpu_load_fd < 0) {
+        telemetry->gpu_load_fd = open_first(gpu_load_paths, sizeof(gpu_load_paths) / sizeof(gpu_load_paths[0]));
+    }
+    telemetry->emc_fd = open_first(emc_paths, sizeof(emc_paths) / sizeof(emc_paths[0]));
+    telemetry->meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    for (int i = 0; i < TELEMETRY_MAX_ZONES; i++) {
+        snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/temp", i);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) break;
+        if (zone_skipped(i)) close(fd);
+        else telemetry->zone_fds[telemetry->nzones++] = fd;
+    }
+    if (telemetry->gpu_load_fd < 0 && telemetry->gpu_freq_fd < 0 && telemetry->emc_fd < 0 &&
+        telemetry->meminfo_fd < 0 && telemetry->nzones == 0) {
+        return -1;
+    }
+    
+    // The first reading is there before the first call
+    take_sample(telemetry, &sample);
+    publish(telemetry, &sample);
+    if (pthread_create(&telemetry->thread, NULL, sample_loop, telemetry) != 0) {
+        close_sources(telemetry);
+        return -1;
+    }
+    telemetry->running = 1;
+    return 0;
+}
+
+void telemetry_stop(McpTelemetry *telemetry) {
+    if (!telemetry->running) return;
+    __atomic_store_n(&telemetry->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(telemetry->thread, NULL);
+    close_sources(telemetry);
+    telemetry->running = 0;
+}
+
+static void worst(long *into, long value, int lowest) {
+    if (value < 0) return;
+    if (*into < 0 || (lowest ? value < *into : value > *into)) *into = value;
+}
+
+static void fold_sample(DeviceState *state, const DeviceSample *sample) {
+    state->samples++;
+    worst(&state->gpu_load, __atomic_load_n(&sample->gpu_load, __ATOMIC_RELAXED), 0);
+    worst(&state->gpu_mhz, __atomic_load_n(&sample->gpu_mhz, __ATOMIC_RELAXED), 1);
+    worst(&state->emc_mhz, __atomic_load_n(&sample->emc_mhz, __ATOMIC_RELAXED), 1);
+    worst(&state->temp_mc, __atomic_load_n(&sample->temp_mc, __ATOMIC_RELAXED), 0);
+    worst(&state->ram_used_mb, __atomic_load_n(&sample->ram_used_mb, __ATOMIC_RELAXED), 0);
+}
+
+static void reset_state(DeviceState *state) {
+    state->samples = 0;
+    state->gpu_load = state->gpu_mhz = state->emc_mhz = state->temp_mc = state->ram_used_mb = -1;
+}
+
+void telemetry_window(McpTelemetry *telemetry, double start_ms, double end_ms, DeviceState *state) {
+    int64_t start_us = (int64_t)(start_ms * 1000.0), end_us = (int64_t)(end_ms * 1000.0);
+    
+    // A reader that keeps losing to the sampler gives up; that takes a
+    // reading every few microseconds
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint64_t seq = __atomic_load_n(&telemetry->seq, __ATOMIC_ACQUIRE);
+        reset_state(state);
+        if (seq & 1) continue;
+        
+        uint64_t count = __atomic_load_n(&telemetry->count, __ATOMIC_RELAXED);
+        for (uint64_t k = count; k > 0 && count - k < TELEMETRY_RING; k--) {
+            const DeviceSample *sample = &telemetry->ring[(k - 1) % TELEMETRY_RING];
+            int64_t at_us = __atomic_load_n(&sample->at_us, __ATOMIC_RELAXED);
+            if (at_us > end_us) continue;
+            if (at_us < start_us && state->samples > 0) break;
+            fold_sample(state, sample);
+            if (at_us < start_us) break;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&telemetry->seq, __ATOMIC_RELAXED) == seq) return;
+    }
+    reset_state(state);
+}
+
+static void fold_value(long *into, long value, int lowest) {
+    long current = STAT_LOAD(*into);
+    
+    if (value >= 0 && (current < 0 || (lowest ? value < current : value > current))) STAT_SET(*into, value);
+}
+
+void device_fold(DeviceState *into, const DeviceState *from) {
+    long samples = STAT_LOAD(from->samples);
+    
+    if (samples <= 0) return;
+    if (STAT_LOAD(into->samples) == 0) {
+        STAT_SET(into->gpu_load, -1);
+        STAT_SET(into->gpu_mhz, -1);
+        STAT_SET(into->emc_mhz, -1);
+        STAT_SET(into->temp_mc, -1);
+        STAT_SET(into->ram_used_mb, -1);
+    }
+    fold_value(&into->gpu_load, STAT_LOAD(from->gpu_load), 0);
+    fold_value(&into->gpu_mhz, STAT_LOAD(from->gpu_mhz), 1);
+    fold_value(&into->emc_mhz, STAT_LOAD(from->emc_mhz), 1);
+    fold_value(&into->temp_mc, STAT_LOAD(from->temp_mc), 0);
+    fold_value(&into->ram_used_mb, STAT_LOAD(from->ram_used_mb), 0);
+    STAT_ADD(into->samples, samples);
+}
+
+void device_write_json(const DeviceState *state, FILE *out) {
+    fprintf(out, "{\"samples\":%ld", state->samples);
+    if (state->gpu_load >= 0) fprintf(out, ",\"gpu_load_pct\":%.1f", state->gpu_load / 10.0);
+    if (state->gpu_mhz >= 0) fprintf(out, ",\"gpu_mhz\":%ld", state->gpu_mhz);
+    if (state->emc_mhz >= 0) fprintf(out, ",\"emc_mhz\":%ld", state->emc_mhz);
+    if (state->temp_mc >= 0) fprintf(out, ",\"temp_c\":%.1f", state->temp_mc / 1000.0);
+    if (state->ram_used_mb >= 0) fprintf(out, ",\"ram_used_mb\":%ld", state->ram_used_mb);
+    fputc('}', out);
+}
+
+void device_print(const DeviceState *state, FILE *out) {
+    const char *sep = "";
+    
+    if (state->gpu_load >= 0 || state->gpu_mhz >= 0) {
+        fprintf(out, "GPU");
+        if (state->gpu_load >= 0) fprintf(out, " %.1f%%", state->gpu_load / 10.0);
+        if (state->gpu_mhz >= 0) fprintf(out, " at %ld MHz", state->gpu_mhz);
+        sep = ", ";
+    }
+    if (state->emc_mhz >= 0) {
+        fprintf(out, "%sEMC %ld MHz", sep, state->emc_mhz);
+        sep = ", ";
+    }
+    if (state->temp_mc >= 0) {
+        fprintf(out, "%s%.1f C", sep, state->temp_mc / 1000.0);
+        sep = ", ";
+    }
+    if (state->ram_used_mb >= 0) fprintf(out, "%s%ld MB RAM", sep, state->ram_used_mb);
+    fprintf(out, " (%ld reading%s)", state->samples, state->samples == 1 ? "" : "s");
+}
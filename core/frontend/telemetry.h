@@ -0,0 +1,68 @@
+#ifndef PHASE3_TELEMETRY_H
+#define PHASE3_TELEMETRY_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Jetson device state next to call latency: a thread of its own reads GPU
+// load and clock, EMC clock, the hottest thermal zone (PMIC-Die and
+// thermal-fan-est left out) and RAM in use from sysfs and procfs every
+// interval, the same files tegrastats reads, through descriptors opened
+// once. Calls take the readings of their own time span
+// from a small ring, so a slow generate can be told apart as throttled
+// (GPU clock down, temperature up) or memory-bound (RAM, EMC).
+#define TELEMETRY_DEFAULT_MS 100
+#define TELEMETRY_RING 64       // readings kept; at 100 ms, the last 6.4 s of a call
+#define TELEMETRY_MAX_ZONES 16
+
+// The device over one call, or over every call of a tool. Each value is
+// the worst one seen: highest load, temperature and RAM, lowest clocks. -1
+// marks one this device has no reading for; samples is 0 with no sampler.
+typedef struct {
+    long samples;
+    long gpu_load;          // per mille
+    long gpu_mhz;
+    long emc_mhz;
+    long temp_mc;           // milli-degrees Celsius
+    long ram_used_mb;
+} DeviceState;
+
+typedef struct {
+    int64_t at_us;          // mcp_now_ms() in us when it was read
+    long gpu_load, gpu_mhz, emc_mhz, temp_mc, ram_used_mb;
+} DeviceSample;
+
+typedef struct {
+    int gpu_load_fd, gpu_freq_fd, emc_fd, meminfo_fd;
+    int zone_fds[TELEMETRY_MAX_ZONES];
+    size_t nzones;
+    int interval_ms;
+    pthread_t thread;
+    int stop;
+    int running;
+    // Seqlock: odd while the sampler writes a reading, which readers then
+    // retry. count is the readings taken; the newest is ring[(count - 1) %
+    // TELEMETRY_RING].
+    uint64_t seq;
+    uint64_t count;
+    DeviceSample ring[TELEMETRY_RING];
+} McpTelemetry;
+
+// Open what this device has and start sampling every interval_ms; -1 if
+// there is nothing to read or no thread
+int telemetry_start(McpTelemetry *telemetry, int interval_ms);
+void telemetry_stop(McpTelemetry *telemetry);
+
+// The readings taken between start_ms and end_ms, or the last one before
+// end_ms for a call shorter than the interval
+void telemetry_window(McpTelemetry *telemetry, double start_ms, double end_ms, DeviceState *state);
+
+// Fold from into the worst case kept in into. Stores with STAT_SET
+// (stats.h), so a scrape may read into meanwhile.
+void device_fold(DeviceState *into, const DeviceState *from);
+void device_write_json(const DeviceState *state, FILE *out);
+// One line of prose, e.g. "GPU 97.0% at 624 MHz, EMC 1600 MHz, 68.5 C, 6120 MB RAM"
+void device_print(const DeviceState *state, FILE *out);
+
+#endif
@@ -0,0 +1,664 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "json_scan.h"
+#include "shm_ring.h"
+#include "transport.h"
+
+// Growable byte buffer for the transports that keep their own copies
+typedef struct {
+    char *data;
+    size_t len, cap;
+} Buf;
+
+static int buf_append(Buf *buf, const void *bytes, size_t len) {
+    if (buf->len + len + 1 > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 256;
+        while (cap < buf->len + len + 1) cap *= 2;
+        char *data = realloc(buf->data, cap);
+        if (!data) return -1;
+        buf->data = data;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, bytes, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+static int buf_append_str(Buf *buf, const char *str) {
+    return buf_append(buf, str, strlen(str));
+}
+
+static void buf_drop(Buf *buf, size_t len) {
+    if (len == 0) return;
+    memmove(buf->data, buf->data + len, buf->len - len);
+    buf->len -= len;
+}
+
+// Replies ready to be peeked, in arrival order, each its own copy
+#define READY_MAX 256
+
+typedef struct {
+    uint32_t tag;
+    Buf body;
+} Ready;
+
+typedef struct {
+    Ready items[READY_MAX];
+    size_t head, count;
+} ReadyQueue;
+
+// Takes over body on success
+static int ready_push(ReadyQueue *queue, uint32_t tag, Buf *body) {
+    if (queue->count == READY_MAX) return -1;
+    Ready *ready = &queue->items[(queue->head + queue->count++) % READY_MAX];
+    ready->tag = tag;
+    ready->body = *body;
+    memset(body, 0, sizeof(*body));
+    return 0;
+}
+
+static int ready_peek(ReadyQueue *queue, McpFrame *frame) {
+    if (queue->count == 0) return 0;
+    Ready *ready = &queue->items[queue->head];
+    memset(frame, 0, sizeof(*frame));
+    frame->tag = ready->tag;
+    frame->part[0] = (const unsigned char *)ready->body.data;
+    frame->len[0] = ready->body.len;
+    frame->size = ready->body.len;
+    return 1;
+}
+
+static void ready_pop(ReadyQueue *queue) {
+    if (queue->count == 0) return;
+    free(queue->items[queue->head].body.data);
+    queue->head = (queue->head + 1) % READY_MAX;
+    queue->count--;
+}
+
+static void ready_free(ReadyQueue *queue) {
+    while (queue->count > 0) ready_pop(queue);
+}
+
+// Fields of one JSON-RPC message that decide where it goes
+typedef struct {
+    int has_id;
+    long id;
+    int has_method;         // a request or notification, not a reply
+    const char *params;
+    size_t params_len;
+} MessageFields;
+
+static void read_field(void *userdata, const char *key, size_t key_len, const char *value, size_t value_len) {
+    MessageFields *fields = userdata;
+    char number[32];
+    
+    if (key_len == 2 && memcmp(key, "id", 2) == 0 && value_len < sizeof(number)) {
+        memcpy(number, value, value_len);
+        number[value_len] = '\0';
+        char *end;
+        fields->id = strtol(number, &end, 10);
+        fields->has_id = end != number && *end == '\0';
+    } else if (key_len == 6 && memcmp(key, "method", 6) == 0) {
+        fields->has_method = 1;
+    } else if (key_len == 6 && memcmp(key, "params", 6) == 0) {
+        fields->params = value;
+        fields->params_len = value_len;
+    }
+}
+
+static int message_fields(const char *json, size_t len, MessageFields *fields) {
+    memset(fields, 0, sizeof(*fields));
+    return json_each_member(json, len, read_field, fields);
+}
+
+static int is_array(const char *json, size_t len) {
+    size_t i = 0;
+    while (i < len && (json[i] == ' ' || json[i] == '\t' || json[i] == '\r' || json[i] == '\n')) i++;
+    return i < len && json[i] == '[';
+}
+
+// Shared memory rings (shm_ring.h)
+static int shm_send(McpTransport *t, uint32_t tag, uint32_t flags, const void *body, size_t len) {
+    return shm_ring_send(t->state, tag, flags, body, len);
+}
+
+static int shm_peek(McpTransport *t, McpFrame *frame) {
+    return shm_ring_peek(t->state, frame);
+}
+
+static void shm_pop(McpTransport *t, const McpFrame *frame) {
+    shm_ring_pop(t->state, frame);
+}
+
+static int shm_alive(McpTransport *t) {
+    return shm_ring_server_alive(t->state);
+}
+
+static void shm_wait(McpTransport *t, long timeout_us) {
+    shm_ring_wait(t->state, timeout_us);
+}
+
+static int shm_wait_fd(McpTransport *t, short *events) {
+    *events = POLLIN;
+    return shm_ring_fd(t->state);
+}
+
+static void shm_close(McpTransport *t) {
+    shm_ring_detach(t->state);
+    free(t->state);
+}
+
+static const McpTransportOps shm_ops = {
+    "shared memory", 1, 0, shm_send, shm_peek, shm_pop, shm_alive, shm_wait, shm_wait_fd, shm_close
+};
+
+int transport_open_shm(McpTransport *t, const char *name) {
+    memset(t, 0, sizeof(*t));
+    if (strlen(name) >= sizeof(t->target)) return -1;
+    ShmRing *ring = malloc(sizeof(ShmRing));
+    if (!ring) return -1;
+    if (shm_ring_attach(ring, name) != 0) {
+        free(ring);
+        return -1;
+    }
+    t->ops = &shm_ops;
+    t->state = ring;
+    t->session = ring->session;
+    strcpy(t->target, name);
+    return 0;
+}
+
+// An MCP server spawned with its stdin and stdout on a socket pair, speaking
+// newline-delimited JSON-RPC like the admin workers behind web_server.py.
+// Such servers take no batches, so a batch is written as one line per item
+// and its replies are collected back into an array.
+#define STDIO_PENDING 256
+#define STDIO_BATCHES 16
+#define STDIO_MAX_QUEUED (1 << 20)      // unwritten request bytes
+#define STDIO_MAX_LINE (16 << 20)
+#define STDIO_INIT_TIMEOUT_MS 10000
+#define STDIO_INIT_TAG 0xffffffffu
+
+typedef struct {
+    long id;
+    uint32_t tag;
+    int batch;              // index into batches, -1 for a single call
+} StdioPending;
+
+typedef struct {
+    uint32_t tag;
+    size_t expected, received;
+    Buf body;
+    int used;
+} StdioBatch;
+
+typedef struct {
+    pid_t pid;
+    int fd;                 // our end; the server has the other as stdin and stdout
+    int eof;
+    Buf out;                // request lines not written yet
+    Buf in;                 // bytes read, up to a partial last line
+    StdioPending pending[STDIO_PENDING];
+    size_t npending;
+    StdioBatch batches[STDIO_BATCHES];
+    ReadyQueue ready;
+} StdioServer;
+
+static void stdio_flush(StdioServer *server) {
+    while (server->out.len > 0) {
+        ssize_t n = send(server->fd, server->out.data, server->out.len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) server->eof = 1;
+            return;
+        }
+        buf_drop(&server->out, (size_t)n);
+    }
+}
+
+// One line per message: raw newlines can only be whitespace between tokens
+static int stdio_queue_line(StdioServer *server, const char *json, size_t len) {
+    size_t start = server->out.len;
+    
+    if (buf_append(&server->out, json, len) != 0 || buf_append(&server->out, "\n", 1) != 0) return -1;
+    for (size_t i = start; i < server->out.len - 1; i++) {
+        if (server->out.data[i] == '\n' || server->out.data[i] == '\r') server->out.data[i] = ' ';
+    }
+    return 0;
+}
+
+static int stdio_register(StdioServer *server, long id, uint32_t tag, int batch) {
+    if (server->npending == STDIO_PENDING) return -1;
+    StdioPending *pending = &server->pending[server->npending++];
+    pending->id = id;
+    pending->tag = tag;
+    pending->batch = batch;
+    return 0;
+}
+
+typedef struct {
+    StdioServer *server;
+    uint32_t tag;
+    int batch;
+    int failed;
+} BatchSplit;
+
+static void split_item(void *userdata, const char *value, size_t value_len) {
+    BatchSplit *split = userdata;
+    MessageFields fields;
+    
+    if (split->failed) return;
+    if (message_fields(value, value_len, &fields) != 0 ||
+        stdio_queue_line(split->server, value, value_len) != 0 ||
+        (fields.has_id && stdio_register(split->server, fields.id, split->tag, split->batch) != 0)) {
+        split->failed = 1;
+        return;
+    }
+    if (fields.has_id) split->server->batches[split->batch].expected++;
+}
+
+static int stdio_send(McpTransport *t, uint32_t tag, uint32_t flags, const void *body, size_t len) {
+    StdioServer *server = t->state;
+    const char *json = body;
+    
+    if (flags & TRANSPORT_FRAME_CBOR) return -1;
+    if (server->out.len > STDIO_MAX_QUEUED || server->npending == STDIO_PENDING) return 1;
+    
+    if (is_array(json, len)) {
+        int batch = 0;
+        while (batch < STDIO_BATCHES && server->batches[batch].used) batch++;
+        if (batch == STDIO_BATCHES) return 1;
+        
+        // Roll back a batch that does not fit whole
+        size_t queued = server->out.len, registered = server->npending;
+        StdioBatch *entry = &server->batches[batch];
+        memset(entry, 0, sizeof(*entry));
+        entry->tag = tag;
+        entry->used = 1;
+        BatchSplit split = { server, tag, batch, 0 };
+        if (json_each_element(json, len, split_item, &split) != 0 || split.failed || entry->expected == 0) {
+            int full = split.failed && server->npending == STDIO_PENDING;
+            server->out.len = queued;
+            server->npending = registered;
+            entry->used = 0;
+            return full ? 1 : -1;
+        }
+        if (buf_append(&entry->body, "[", 1) != 0) return -1;
+    } else {
+        MessageFields fields;
+        if (message_fields(json, len, &fields) != 0 || !fields.has_id) return -1;
+        if (stdio_queue_line(server, json, len) != 0) return -1;
+        stdio_register(server, fields.id, tag, -1);
+    }
+    stdio_flush(server);
+    return 0;
+}
+
+// Route one reply line to its call, or into the batch it belongs to
+static void stdio_route(StdioServer *server, const char *line, size_t len) {
+    MessageFields fields;
+    
+    // Server notifications, server-to-client requests and stray output
+    if (message_fields(line, len, &fields) != 0 || fields.has_method || !fields.has_id) return;
+    size_t i = 0;
+    while (i < server->npending && server->pending[i].id != fields.id) i++;
+    if (i == server->npending) return;
+    
+    StdioPending pending = server->pending[i];
+    server->pending[i] = server->pending[--server->npending];
+    Buf body = { 0 };
+    if (pending.batch < 0) {
+        if (buf_append(&body, line, len) == 0 && ready_push(&server->ready, pending.tag, &body) != 0) free(body.data);
+        return;
+    }
+    StdioBatch *batch = &server->batches[pending.batch];
+    if (batch->received++ > 0) buf_append(&batch->body, ",", 1);
+    buf_append(&batch->body, line, len);
+    if (batch->received < batch->expected) return;
+    buf_append(&batch->body, "]", 1);
+    if (ready_push(&server->ready, batch->tag, &batch->body) != 0) free(batch->body.data);
+    memset(batch, 0, sizeof(*batch));
+}
+
+static void stdio_read(StdioServer *server) {
+    char chunk[16384];
+    
+    stdio_flush(server);
+    while (!server->eof) {
+        ssize_t n = recv(server->fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) server->eof = 1;
+        if (n <= 0) break;
+        if (buf_append(&server->in, chunk, (size_t)n) != 0) server->eof = 1;
+    }
+    
+    size_t start = 0;
+    char *newline;
+    while (start < server->in.len && (newline = memchr(server->in.data + start, '\n', server->in.len - start))) {
+        stdio_route(server, server->in.data + start, (size_t)(newline - server->in.data) - start);
+        start = (size_t)(newline - server->in.data) + 1;
+    }
+    buf_drop(&server->in, start);
+    if (server->in.len > STDIO_MAX_LINE) server->eof = 1;
+}
+
+static int stdio_peek(McpTransport *t, McpFrame *frame) {
+    StdioServer *server = t->state;
+    
+    if (server->ready.count == 0) stdio_read(server);
+    return ready_peek(&server->ready, frame);
+}
+
+static void stdio_pop(McpTransport *t, const McpFrame *frame) {
+    (void)frame;
+    ready_pop(&((StdioServer *)t->state)->ready);
+}
+
+static int stdio_alive(McpTransport *t) {
+    StdioServer *server = t->state;
+    
+    if (server->pid > 0 && waitpid(server->pid, NULL, WNOHANG) != 0) server->pid = 0;
+    return server->pid > 0 && !server->eof;
+}
+
+static void stdio_wait(McpTransport *t, long timeout_us) {
+    StdioServer *server = t->state;
+    struct pollfd fd = { server->fd, (short)(POLLIN | (server->out.len > 0 ? POLLOUT : 0)), 0 };
+    
+    if (server->ready.count == 0 && !server->eof) poll(&fd, 1, (int)((timeout_us + 999) / 1000));
+}
+
+static int stdio_wait_fd(McpTransport *t, short *events) {
+    StdioServer *server = t->state;
+    
+    if (server->ready.count > 0 || server->eof) return -1;
+    *events = (short)(POLLIN | (server->out.len > 0 ? POLLOUT : 0));
+    return server->fd;
+}
+
+static void stdio_close(McpTransport *t) {
+    StdioServer *server = t->state;
+    
+    // EOF on stdin ends an MCP server; one that lingers is terminated
+    close(server->fd);
+    for (int i = 0; i < 50 && server->pid > 0 && waitpid(server->pid, NULL, WNOHANG) == 0; i++) {
+        struct timespec ts = { 0, 2000000 };
+        nanosleep(&ts, NULL);
+    }
+    if (server->pid > 0 && waitpid(server->pid, NULL, WNOHANG) == 0) {
+        kill(server->pid, SIGTERM);
+        waitpid(server->pid, NULL, 0);
+    }
+    free(server->out.data);
+    free(server->in.data);
+    for (int i = 0; i < STDIO_BATCHES; i++) free(server->batches[i].body.data);
+    ready_free(&server->ready);
+    free(server);
+}
+
+static const McpTransportOps stdio_ops = {
+    "stdio", 0, 1, stdio_send, stdio_peek, stdio_pop, stdio_alive, stdio_wait, stdio_wait_fd, stdio_close
+};
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// The MCP session handshake: initialize, wait for its reply, then confirm
+static int stdio_initialize(McpTransport *t) {
+    static const char initialize[] =
+        "{\"jsonrpc\":\"2.0\",\"id\":0,\"method\":\"initialize\",\"params\":{\"protocolVersion\":\"2024-11-05\","
+        "\"capabilities\":{},\"clientInfo\":{\"name\":\"phase3-frontend\",\"version\":\"1.0\"}}}";
+    static const char initialized[] = "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/initialized\"}";
+    StdioServer *server = t->state;
+    McpFrame frame;
+    
+    if (stdio_send(t, STDIO_INIT_TAG, 0, initialize, sizeof(initialize) - 1) != 0) return -1;
+    double give_up_ms = now_ms() + STDIO_INIT_TIMEOUT_MS;
+    while (!stdio_peek(t, &frame)) {
+        if (!stdio_alive(t) || now_ms() >= give_up_ms) return -1;
+        stdio_wait(t, 10000);
+    }
+    stdio_pop(t, &frame);
+    if (stdio_queue_line(server, initialized, sizeof(initialized) - 1) != 0) return -1;
+    stdio_flush(server);
+    return 0;
+}
+
+int transport_open_stdio(McpTransport *t, const char *command) {
+    int fds[2];
+    
+    memset(t, 0, sizeof(*t));
+    if (strlen(command) >= sizeof(t->target)) return -1;
+    StdioServer *server = calloc(1, sizeof(StdioServer));
+    if (!server) return -1;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        free(server);
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        free(server);
+        return -1;
+    }
+    server->pid = pid;
+    server->fd = fds[0];
+    t->ops = &stdio_ops;
+    t->state = server;
+    strcpy(t->target, command);
+    if (stdio_initialize(t) != 0) {
+        transport_close(t);
+        return -1;
+    }
+    return 0;
+}
+
+// In-process mock with the canned replies of the old test build: no server,
+// no copies through the kernel, so it measures the client alone
+typedef struct {
+    ReadyQueue ready;
+} MockServer;
+
+static const struct { const char *tool; const char *text; } mock_replies[] = {
+    { "get_status", "{\\\"status\\\": \\\"healthy\\\", \\\"server\\\": \\\"phase3-admin\\\", "
+                    "\\\"version\\\": \\\"1.0.0\\\", \\\"frontend_running\\\": true}" },
+    { "get_agent_config", "{\\\"model\\\": \\\"gpt-4\\\", \\\"temperature\\\": 0.7, \\\"max_tokens\\\": 1000}" },
+    { "db_status", "{\\\"connected\\\": true, \\\"sessions\\\": 0, \\\"settings\\\": 3}" },
+    { "get_settings", "{\\\"debug_level\\\": 1, \\\"frontend_port\\\": 8080, \\\"agent_model\\\": \\\"gpt-4\\\"}" },
+    { "start_frontend", "Frontend: Started on port 8080" },
+};
+
+typedef struct {
+    const char *name, *arguments;
+    size_t name_len, arguments_len;
+    const char *value;      // the one argument a mock reply echoes
+    size_t value_len;
+} MockCall;
+
+static void read_param(void *userdata, const char *key, size_t key_len, const char *value, size_t value_len) {
+    MockCall *call = userdata;
+    
+    if (key_len == 4 && memcmp(key, "name", 4) == 0) {
+        call->name = value;
+        call->name_len = value_len;
+    } else if (key_len == 9 && memcmp(key, "arguments", 9) == 0) {
+        call->arguments = value;
+        call->arguments_len = value_len;
+    }
+}
+
+static void read_argument(void *userdata, const char *key, size_t key_len, const char *value, size_t value_len) {
+    MockCall *call = userdata;
+    
+    if ((key_len == 6 && memcmp(key, "prompt", 6) == 0) || (key_len == 5 && memcmp(key, "level", 5) == 0)) {
+        call->value = value;
+        call->value_len = value_len;
+    }
+}
+
+static int tool_is(const MockCall *call, const char *tool) {
+    size_t len = strlen(tool);
+    return call->name_len == len + 2 && memcmp(call->name + 1, tool, len) == 0;
+}
+
+// Append the reply to one request object; notifications get none
+static int mock_reply(Buf *out, const char *json, size_t len) {
+    MessageFields fields;
+    MockCall call = { 0 };
+    char head[64];
+    
+    if (message_fields(json, len, &fields) != 0) return -1;
+    if (!fields.has_id) return 0;
+    if (fields.params) json_each_member(fields.params, fields.params_len, read_param, &call);
+    if (call.arguments) json_each_member(call.arguments, call.arguments_len, read_argument, &call);
+    if (!call.name || call.name_len < 2 || call.name[0] != '"') {
+        snprintf(head, sizeof(head), "{\"jsonrpc\":\"2.0\",\"id\":%ld,\"error\":", fields.id);
+        return buf_append_str(out, head) || buf_append_str(out, "{\"code\":-32602,\"message\":\"Missing tool name\"}}");
+    }
+    
+    snprintf(head, sizeof(head), "{\"jsonrpc\":\"2.0\",\"id\":%ld,", fields.id);
+    if (buf_append_str(out, head) != 0) return -1;
+    for (size_t i = 0; i < sizeof(mock_replies) / sizeof(mock_replies[0]); i++) {
+        if (tool_is(&call, mock_replies[i].tool)) {
+            return buf_append_str(out, "\"result\":{\"content\":[{\"type\":\"text\",\"text\":\"") ||
+                   buf_append_str(out, mock_replies[i].text) || buf_append_str(out, "\"}]}}");
+        }
+    }
+    
+    // Echo the prompt as written, escapes and all, inside the text string
+    const char *value = call.value ? call.value : "";
+    size_t value_len = call.value_len;
+    if (value_len >= 2 && value[0] == '"') {
+        value++;
+        value_len -= 2;
+    }
+    if (tool_is(&call, "generate") || tool_is(&call, "set_debug")) {
+        const char *lead = tool_is(&call, "generate") ? "Mock text for '" : "Debug: Level set to ";
+        return buf_append_str(out, "\"result\":{\"content\":[{\"type\":\"text\",\"text\":\"") ||
+               buf_append_str(out, lead) || buf_append(out, value, value_len) ||
+               buf_append_str(out, tool_is(&call, "generate") ? "'\"}]}}" : "\"}]}}");
+    }
+    return buf_append_str(out, "\"error\":{\"code\":-32601,\"message\":\"Unknown tool: ") ||
+           buf_append(out, call.name + 1, call.name_len - 2) || buf_append_str(out, "\"}}");
+}
+
+static int mock_answer(Buf *out, const char *json, size_t len) {
+    return mock_reply(out, json, len) != 0 ? -1 : 0;
+}
+
+typedef struct {
+    Buf *out;
+    size_t replies;
+    int failed;
+} MockBatch;
+
+static void mock_item(void *userdata, const char *value, size_t value_len) {
+    MockBatch *batch = userdata;
+    size_t before = batch->out->len;
+
+    if (batch->failed) return;
+    if (batch->replies > 0 && buf_append(batch->out, ",", 1) != 0) batch->failed = 1;
+    size_t start = batch->out->len;
+    if (batch->failed || mock_answer(batch->out, value, value_len) != 0) {
+        batch->failed = 1;
+    } else if (batch->out->len == start) {
+        batch->out->len = before;   // a notification
+    } else {
+        batch->replies++;
+    }
+}
+
+static int mock_send(McpTransport *t, uint32_t tag, uint32_t flags, const void *body, size_t len) {
+    MockServer *server = t->state;
+    Buf reply = { 0 };
+
+    if (flags & TRANSPORT_FRAME_CBOR) return -1;
+    if (server->ready.count == READY_MAX) return 1;
+    int failed;
+    if (is_array(body, len)) {
+        MockBatch batch = { &reply, 0, 0 };
+        failed = buf_append(&reply, "[", 1) != 0 || json_each_element(body, len, mock_item, &batch) != 0 ||
+                 batch.failed || buf_append(&reply, "]", 1) != 0;
+    } else {
+        failed = mock_answer(&reply, body, len) != 0;
+    }
+    if (failed || reply.len == 0 || ready_push(&server->ready, tag, &reply) != 0) {
+        free(reply.data);
+        return -1;
+    }
+    return 0;
+}
+
+static int mock_peek(McpTransport *t, McpFrame *frame) {
+    return ready_peek(&((MockServer *)t->state)->ready, frame);
+}
+
+static void mock_pop(McpTransport *t, const McpFrame *frame) {
+    (void)frame;
+    ready_pop(&((MockServer *)t->state)->ready);
+}
+
+static int mock_alive(McpTransport *t) {
+    (void)t;
+    return 1;
+}
+
+// Replies are there as soon as the request is
+static void mock_wait(McpTransport *t, long timeout_us) {
+    (void)t;
+    (void)timeout_us;
+}
+
+static int mock_wait_fd(McpTransport *t, short *events) {
+    (void)t;
+    (void)events;
+    return -1;
+}
+
+static void mock_close(McpTransport *t) {
+    ready_free(&((MockServer *)t->state)->ready);
+    free(t->state);
+}
+
+static const McpTransportOps mock_ops = {
+    "mock", 0, 1, mock_send, mock_peek, mock_pop, mock_alive, mock_wait, mock_wait_fd, mock_close
+};
+
+int transport_open_mock(McpTransport *t) {
+    memset(t, 0, sizeof(*t));
+    t->state = calloc(1, sizeof(MockServer));
+    if (!t->state) return -1;
+    t->ops = &mock_ops;
+    strcpy(t->target, "in-process");
+    return 0;
+}
+
+void transport_close(McpTransport *t) {
+    if (t->ops) t->ops->close(t);
+    memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,58 @@
+#ifndef PHASE3_TRANSPORT_H
+#define PHASE3_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Transports that exchange whole request and reply bodies instead of HTTP
+// transfers: the shared memory rings, a server spawned on stdio pipes and
+// the in-process mock. Each request is sent with a tag chosen by the client
+// and its reply comes back with the same tag, in whatever order the server
+// finishes them. Nothing blocks: send refuses while the transport is full
+// and peek reports nothing until a whole reply is there.
+#define TRANSPORT_FRAME_CBOR 1
+
+typedef struct {
+    uint32_t tag;
+    uint32_t flags;
+    const unsigned char *part[2];   // the body, split where it wraps
+    size_t len[2];
+    size_t size;            // bytes the frame takes in the transport
+} McpFrame;
+
+typedef struct McpTransport McpTransport;
+
+typedef struct {
+    const char *name;
+    int cbor;               // carries CBOR bodies; otherwise calls go as JSON
+    int streams;            // carries streamed calls, answered in one piece;
+                            // otherwise those stay on HTTP
+    // 0 once queued, 1 while too full to take it, -1 for a body that can
+    // never be sent
+    int (*send)(McpTransport *t, uint32_t tag, uint32_t flags, const void *body, size_t len);
+    // 1 with the next reply in frame, left in place until pop; 0 for none
+    int (*peek)(McpTransport *t, McpFrame *frame);
+    void (*pop)(McpTransport *t, const McpFrame *frame);
+    int (*alive)(McpTransport *t);
+    // Sleep until a reply may have arrived, at most timeout_us
+    void (*wait)(McpTransport *t, long timeout_us);
+    // The same as a descriptor for the caller's own poll, with the poll
+    // events to wait for; -1 when peek should simply be tried again
+    int (*wait_fd)(McpTransport *t, short *events);
+    void (*close)(McpTransport *t);
+} McpTransportOps;
+
+struct McpTransport {
+    const McpTransportOps *ops;     // NULL while calls go over HTTP
+    void *state;
+    uint32_t session;       // tells this client's replies from a predecessor's
+    char target[128];       // segment name or command, for the stats
+};
+
+// Each fails with -1 and leaves t closed
+int transport_open_shm(McpTransport *t, const char *name);
+int transport_open_stdio(McpTransport *t, const char *command);
+int transport_open_mock(McpTransport *t);
+void transport_close(McpTransport *t);
+
+#endif
@@ -0,0 +1,238 @@
+"""
+Shared memory transport for a frontend on the same host; the layout and
+framing are described in frontend/shm_ring.h. The adapter creates the
+segment, reads request frames from one ring and runs each through a handler
+on a thread pool, so a slow tool does not hold up the calls behind it, then
+writes the reply to the other ring in the framing the request came in. Each
+ring has a FIFO next to the segment as its doorbell, so an idle adapter
+sleeps until a frontend rings.
+"""
+
+import atexit
+import ctypes
+import json
+import mmap
+import os
+import select
+import threading
+import time
+import zlib
+from concurrent.futures import ThreadPoolExecutor
+
+try:
+    import cbor2 as cbor
+except ImportError:
+    import cbor_codec as cbor
+
+DEFAULT_NAME = '/phase3_mcp'
+MAGIC = 0x524d3350
+VERSION = 2
+DATA = 4096
+HEADER = 16
+FRAME_CBOR = 1
+REQUEST_HEAD, REQUEST_TAIL, REPLY_HEAD, REPLY_TAIL = 64, 128, 192, 256
+# How soon the reader looks again at a request frame still being written
+POLL = int(os.environ.get("PHASE3_SHM_POLL_US", "100")) / 1e6
+# Longest sleep on the doorbell, so close() is noticed
+IDLE = 1.0
+# Longest wait between tries to fit a reply into a full ring
+FULL_BACKOFF = 0.01
+# A frame that still fails its CRC after this long is dropped
+TORN = 0.1
+
+def pid_alive(pid):
+    if not pid:
+        return False
+    try:
+        os.kill(pid, 0)
+    except PermissionError:
+        return True
+    except OSError:
+        return False
+    return True
+
+class Ring:
+    """One direction of the segment. Python issues no memory fences, so the
+    producer publishes a CRC with every frame and the consumer takes a
+    mismatch as a frame still being written."""
+    
+    def __init__(self, buf, head, tail, data, capacity):
+        self.buf = buf
+        self.head = ctypes.c_uint64.from_buffer(buf, head)
+        self.tail = ctypes.c_uint64.from_buffer(buf, tail)
+        self.data = data
+        self.capacity = capacity
+        self.torn_since = None
+    
+    def _read(self, at, size):
+        offset = at & (self.capacity - 1)
+        first = min(size, self.capacity - offset)
+        start = self.data + offset
+        return self.buf[start:start + first] + self.buf[self.data:self.data + size - first]
+    
+    def _write(self, at, payload):
+        offset = at & (self.capacity - 1)
+        first = min(len(payload), self.capacity - offset)
+        start = self.data + offset
+        self.buf[start:start + first] = payload[:first]
+        self.buf[self.data:self.data + len(payload) - first] = payload[first:]
+    
+    @staticmethod
+    def frame_size(length):
+        return HEADER + ((length + 7) & ~7)
+    
+    def send(self, tag, flags, body):
+        """Append a frame; False while the ring is too full to take it"""
+        size = self.frame_size(len(body))
+        head = self.head.value
+        if head - self.tail.value + size > self.capacity:
+            return False
+        header = len(body).to_bytes(4, 'little') + tag.to_bytes(4, 'little') + \
+                 zlib.crc32(body).to_bytes(4, 'little') + flags.to_bytes(4, 'little')
+        self._write(head, header)
+        self._write(head + HEADER, body)
+        self.head.value = head + size
+        return True
+    
+    def receive(self):
+        """The next complete frame as (tag, flags, body), or None"""
+        tail, head = self.tail.value, self.head.value
+        if head == tail:
+            return None
+        header = self._read(tail, HEADER)
+        length, tag, crc, flags = (int.from_bytes(header[i:i + 4], 'little') for i in range(0, HEADER, 4))
+        size = self.frame_size(length)
+        if head - tail < HEADER or size > self.capacity:
+            self._drop(tail, head, size)
+            return None
+        body = self._read(tail + HEADER, length) if size <= head - tail else None
+        if body is None or zlib.crc32(body) != crc:
+            now = time.monotonic()
+            if self.torn_since is None:
+                self.torn_since = now
+            elif now - self.torn_since > TORN:
+                self._drop(tail, head, size)
+            return None
+        self.torn_since = None
+        self.tail.value = tail + size
+        return tag, flags, body
+    
+    def _drop(self, tail, head, size):
+        self.tail.value = tail + size if size <= head - tail else head
+        self.torn_since = None
+
+class ShmAdapter:
+    """Serve requests from the segment name with handle(request) -> reply"""
+    
+    def __init__(self, handle, name=DEFAULT_NAME, capacity=1 << 20, workers=8):
+        if capacity < 4096 or capacity & (capacity - 1):
+            raise ValueError("ring capacity must be a power of two of at least 4096")
+        self.handle = handle
+        self.path = '/dev/shm/' + name.lstrip('/')
+        self.capacity = capacity
+        self.pool = ThreadPoolExecutor(max_workers=workers)
+        self.send_lock = threading.Lock()
+        self.running = False
+        
+        # A fresh segment, so a frontend still mapping the old one sees its
+        # server gone instead of a ring reset under it
+        if os.path.exists(self.path):
+            os.unlink(self.path)
+        fd = os.open(self.path, os.O_RDWR | os.O_CREAT | os.O_EXCL, 0o600)
+        try:
+            os.ftruncate(fd, DATA + 2 * capacity)
+            self.buf = mmap.mmap(fd, DATA + 2 * capacity)
+        finally:
+            os.close(fd)
+        # Doorbells, opened read-write so neither end ever blocks or sees EOF
+        self.bells = [self.path + '.requests', self.path + '.replies']
+        for path in self.bells:
+            if os.path.exists(path):
+                os.unlink(path)
+            os.mkfifo(path, 0o600)
+        self.request_bell, self.reply_bell = (os.open(path, os.O_RDWR | os.O_NONBLOCK) for path in self.bells)
+        self.fields = (ctypes.c_uint32 * 6).from_buffer(self.buf)
+        self.requests = Ring(self.buf, REQUEST_HEAD, REQUEST_TAIL, DATA, capacity)
+        self.replies = Ring(self.buf, REPLY_HEAD, REPLY_TAIL, DATA + capacity, capacity)
+        self.fields[1] = VERSION
+        self.fields[2] = capacity
+        self.fields[3] = os.getpid()
+        # Magic last: a frontend attaching before this sees no server
+        self.fields[0] = MAGIC
+    
+    def start(self):
+        self.running = True
+        atexit.register(self.close)
+        threading.Thread(target=self._read_requests, daemon=True).start()
+        return self
+    
+    def close(self):
+        if not self.running:
+            return
+        self.running = False
+        self.fields[3] = 0
+        for path in [self.path] + self.bells:
+            try:
+                os.unlink(path)
+            except FileNotFoundError:
+                pass
+    
+    def _read_requests(self):
+        while self.running:
+            frame = self.requests.receive()
+            if frame is None:
+                # A frame published after the drain rings the bell again
+                self._drain(self.request_bell)
+                frame = self.requests.receive()
+            if frame is None:
+                writing = self.requests.head.value != self.requests.tail.value
+                select.select([self.request_bell], [], [], POLL if writing else IDLE)
+                continue
+            self.pool.submit(self._answer, *frame)
+    
+    @staticmethod
+    def _drain(bell):
+        try:
+            while os.read(bell, 256):
+                pass
+        except BlockingIOError:
+            pass
+    
+    @staticmethod
+    def _ring(bell):
+        try:
+            os.write(bell, b'\0')
+        except BlockingIOError:
+            pass       # a full FIFO has the frontend's attention already
+    
+    def _answer(self, tag, flags, body):
+        codec = cbor if flags & FRAME_CBOR else None
+        request_id = None
+        try:
+            data = codec.loads(body) if codec else json.loads(body)
+        except ValueError as e:
+            reply = {"jsonrpc": "2.0", "error": {"code": -32700, "message": f"Parse error: {e}"}, "id": None}
+        else:
+            request_id = data.get("id") if isinstance(data, dict) else None
+            try:
+                reply = self.handle(data)
+            except Exception as e:
+                reply = {"jsonrpc": "2.0", "error": {"code": -32603, "message": str(e)}, "id": request_id}
+        out = codec.dumps(reply) if codec else json.dumps(reply).encode()
+        if self.replies.frame_size(len(out)) > self.capacity:
+            reply = {"jsonrpc": "2.0", "error": {"code": -32603, "message": "Reply larger than the ring"},
+                     "id": request_id}
+            out = codec.dumps(reply) if codec else json.dumps(reply).encode()
+        self._send(tag, flags & FRAME_CBOR, out)
+    
+    def _send(self, tag, flags, out):
+        # One producer at a time; a reply for a frontend that went away
+        # while the ring was full is dropped
+        with self.send_lock:
+            delay = POLL
+            while not self.replies.send(tag, flags, out):
+                if not self.running or not pid_alive(self.fields[4]):
+                    return
+                time.sleep(delay)
+                delay = min(delay * 2, FULL_BACKOFF)
+            self._ring(self.reply_bell)
@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+"""Round trips for the CBOR framing on /mcp: cbor_codec.py against the
+RFC 8949 examples and cbor2 (when installed), then against the frontend's
+C codec (frontend/cbor.c), built into a shared library with the system C
+compiler. Run with python3 test_cbor_codec.py."""
+
+import ctypes
+import ctypes.util
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, HERE)
+import cbor_codec
+
+try:
+    import cbor2
+except ImportError:
+    cbor2 = None
+
+# RFC 8949 Appendix A: encoding in hex and the value it stands for. The
+# first group is also what cbor_codec writes; the rest it only reads
+# (shorter floats, indefinite lengths, tags).
+RFC_VECTORS = [
+    ("00", 0), ("17", 23), ("1818", 24), ("1864", 100), ("1903e8", 1000), ("1a000f4240", 1000000),
+    ("1b000000e8d4a51000", 1000000000000), ("1bffffffffffffffff", 18446744073709551615),
+    ("20", -1), ("29", -10), ("3863", -100), ("3903e7", -1000),
+    ("3bffffffffffffffff", -18446744073709551616),
+    ("fb3ff199999999999a", 1.1), ("fbc010666666666666", -4.1), ("fb7e37e43c8800759c", 1.0e300),
+    ("f4", False), ("f5", True), ("f6", None),
+    ("60", ""), ("6161", "a"), ("6449455446", "IETF"), ("62225c", "\"\\"), ("62c3bc", "\u00fc"),
+    ("63e6b0b4", "\u6c34"), ("64f0908591", "\U00010151"),
+    ("80", []), ("83010203", [1, 2, 3]), ("8301820203820405", [1, [2, 3], [4, 5]]),
+    ("a0", {}), ("a26161016162820203", {"a": 1, "b": [2, 3]}),
+    ("826161a161626163", ["a", {"b": "c"}]),
+]
+RFC_DECODE_ONLY = [
+    ("f90000", 0.0), ("f93c00", 1.0), ("f93e00", 1.5), ("f97bff", 65504.0), ("fa47c35000", 100000.0),
+    ("f90001", 5.960464477539063e-08), ("f9c400", -4.0), ("fb3ff0000000000000", 1.0),
+    ("9fff", []), ("9f018202039f0405ffff", [1, [2, 3], [4, 5]]),
+    ("bf61610161629f0203ffff", {"a": 1, "b": [2, 3]}),
+    ("7f657374726561646d696e67ff", "streaming"), ("5f42010243030405ff", b"\x01\x02\x03\x04\x05"),
+    ("c074323031332d30332d32315432303a30343a30305a", "2013-03-21T20:04:00Z"),
+    ("d82076687474703a2f2f7777772e6578616d706c652e636f6d", "http://www.example.com"),
+]
+
+# Values of the JSON data model that break codecs most often: length
+# prefixes at each width, integers at each head size, floats, nesting
+LENGTHS = [0, 1, 23, 24, 255, 256, 65535, 65536]
+VALUES = [
+    0, 23, 24, 255, 256, 65535, 65536, 2**32 - 1, 2**32, 2**64 - 1,
+    -1, -24, -25, -256, -257, -65536, -65537, -2**32, -2**32 - 1, -2**63, -2**64,
+    0.0, -0.0, 0.5, -1.25, 3.141592653589793, 1e-310, 1.7976931348623157e308, -2.5e-5,
+    True, False, None,
+    "ascii", "esc \" \\ / \b \f \n \r \t \x01", "caf\u00e9 \u6c34 \U0001f600",
+    [], {}, [[[]]], {"a": {"b": {"c": {}}}},
+    [1, -2, 3.5, "four", None, True, [5, {"six": [7]}]],
+    {"jsonrpc": "2.0", "id": 42, "method": "tools/call",
+     "params": {"name": "generate", "arguments": {"prompt": "x" * 300, "max_tokens": -1, "temperature": 0.7}}},
+] + ["s" * n for n in LENGTHS] + [list(range(n)) for n in (23, 24, 256)] + \
+    [{str(i): i for i in range(n)} for n in (23, 24, 256)]
+
+def nested(depth):
+    value = 0
+    for _ in range(depth):
+        value = [value]
+    return value
+
+class PythonCodec(unittest.TestCase):
+    def test_rfc_vectors_decode(self):
+        for hexdata, value in RFC_VECTORS + RFC_DECODE_ONLY:
+            with self.subTest(hexdata=hexdata):
+                self.assertEqual(cbor_codec.loads(bytes.fromhex(hexdata)), value)
+
+    def test_rfc_vectors_encode(self):
+        for hexdata, value in RFC_VECTORS:
+            with self.subTest(hexdata=hexdata):
+                self.assertEqual(cbor_codec.dumps(value).hex(), hexdata)
+
+    def test_round_trip(self):
+        for value in VALUES + [b"", b"\x00\xff" * 200]:
+            with self.subTest(value=repr(value)[:60]):
+                decoded = cbor_codec.loads(cbor_codec.dumps(value))
+                self.assertEqual(decoded, value)
+                self.assertEqual(type(decoded), type(value))
+        self.assertEqual(math.copysign(1, cbor_codec.loads(cbor_codec.dumps(-0.0))), -1)
+
+    def test_length_prefixes(self):
+        for n, head in ((23, "77"), (24, "7818"), (255, "78ff"), (256, "790100"), (65536, "7a00010000")):
+            with self.subTest(n=n):
+                self.assertTrue(cbor_codec.dumps("s" * n).hex().startswith(head))
+
+    def test_truncated(self):
+        for value in ([1, [2, 3], {"a": "bc"}], "s" * 300, 2**40, -2**40, 1.5, {"k": [None, True]}):
+            data = cbor_codec.dumps(value)
+            for cut in range(len(data)):
+                with self.subTest(value=repr(value)[:40], cut=cut):
+                    with self.assertRaises(ValueError):
+                        cbor_codec.loads(data[:cut])
+
+    def test_invalid(self):
+        for hexdata in ("ff", "1c", "1f", "3f", "f8", "0001", "a18001", "a1a00001", "6180", "9f01",
+                        "5f6161ff", "7f4161ff", "5f5f41ffff"):
+            with self.subTest(hexdata=hexdata):
+                with self.assertRaises(ValueError):
+                    cbor_codec.loads(bytes.fromhex(hexdata))
+        with self.assertRaises(ValueError):
+            cbor_codec.loads(cbor_codec.dumps(nested(cbor_codec.MAX_DEPTH + 2)))
+        with self.assertRaises(ValueError):
+            cbor_codec.dumps(nested(cbor_codec.MAX_DEPTH + 2))
+        with self.assertRaises(ValueError):
+            cbor_codec.dumps(2**64)
+        with self.assertRaises(TypeError):
+            cbor_codec.dumps(object())
+
+    @unittest.skipUnless(cbor2, "cbor2 not installed")
+    def test_against_cbor2(self):
+        for value in VALUES:
+            with self.subTest(value=repr(value)[:60]):
+                self.assertEqual(cbor_codec.loads(cbor2.dumps(value)), value)
+                self.assertEqual(cbor2.loads(cbor_codec.dumps(value)), value)
+
+class JsonScanReply(ctypes.Structure):
+    _fields_ = [("has_id", ctypes.c_int), ("id", ctypes.c_long), ("has_error", ctypes.c_int),
+                ("error_code", ctypes.c_long), ("text", ctypes.c_void_p), ("text_len", ctypes.c_size_t),
+                ("message", ctypes.c_void_p), ("message_len", ctypes.c_size_t)]
+
+CBOR_WRITE = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t)
+CBOR_REPLY = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.POINTER(JsonScanReply))
+
+def build_c_codec(directory):
+    """frontend/cbor.c as a shared library, or None without a C compiler"""
+    cc = os.environ.get("CC") or shutil.which("cc") or shutil.which("gcc")
+    if not cc:
+        return None
+    frontend = os.path.join(HERE, "frontend")
+    path = os.path.join(directory, "libphase3_cbor.so")
+    sources = [os.path.join(frontend, name) for name in ("cbor.c", "json_scan.c", "arena.c")]
+    result = subprocess.run([cc, "-std=c99", "-shared", "-fPIC", "-o", path] + sources + ["-lm"],
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    if result.returncode != 0:
+        raise RuntimeError("cannot build frontend/cbor.c:\n" + result.stdout.decode(errors="replace"))
+    lib = ctypes.CDLL(path)
+    lib.cbor_from_json.argtypes = [CBOR_WRITE, ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.cbor_write_json.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.cbor_scan_replies.argtypes = [ctypes.c_char_p, ctypes.c_size_t, CBOR_REPLY, ctypes.c_void_p]
+    return lib
+
+class CCodec(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp = tempfile.mkdtemp(prefix="phase3_cbor_")
+        cls.lib = build_c_codec(cls.tmp)
+        if not cls.lib:
+            shutil.rmtree(cls.tmp)
+            raise unittest.SkipTest("no C compiler")
+        cls.libc = ctypes.CDLL(ctypes.util.find_library("c"))
+        cls.libc.fopen.restype = ctypes.c_void_p
+        cls.libc.fopen.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+        cls.libc.fclose.argtypes = [ctypes.c_void_p]
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.tmp)
+
+    def c_to_json(self, data):
+        """cbor_write_json: its status and the JSON text written"""
+        path = os.path.join(self.tmp, "out.json")
+        out = self.libc.fopen(path.encode(), b"w")
+        status = self.lib.cbor_write_json(out, data, len(data))
+        self.libc.fclose(out)
+        with open(path, encoding="utf-8") as f:
+            return status, f.read()
+
+    def c_from_json(self, text):
+        """cbor_from_json: its status and the CBOR bytes written"""
+        chunks = []
+        def write(out, data, length):
+            chunks.append(ctypes.string_at(data, length))
+            return 0
+        data = text.encode()
+        status = self.lib.cbor_from_json(CBOR_WRITE(write), None, data, len(data))
+        return status, b"".join(chunks)
+
+    def c_replies(self, data):
+        replies = []
+        def seen(userdata, reply):
+            r = reply.contents
+            replies.append({"id": r.id if r.has_id else None,
+                            "error": r.error_code if r.has_error else None,
+                            "text": ctypes.string_at(r.text, r.text_len).decode(),
+                            "message": ctypes.string_at(r.message, r.message_len).decode()})
+        status = self.lib.cbor_scan_replies(data, len(data), CBOR_REPLY(seen), None)
+        return status, replies
+
+    def test_python_to_c(self):
+        for value in VALUES:
+            with self.subTest(value=repr(value)[:60]):
+                status, text = self.c_to_json(cbor_codec.dumps(value))
+                self.assertEqual(status, 0)
+                self.assertEqual(json.loads(text), value)
+
+    def test_c_reads_rfc_vectors(self):
+        for hexdata, value in RFC_VECTORS + RFC_DECODE_ONLY:
+            if isinstance(value, bytes):
+                value = value.hex()
+            # Integers outside 64 bits are not produced by either side
+            if isinstance(value, int) and not isinstance(value, bool) and value < -2**63:
+                continue
+            with self.subTest(hexdata=hexdata):
+                status, text = self.c_to_json(bytes.fromhex(hexdata))
+                self.assertEqual(status, 0)
+                self.assertEqual(json.loads(text), value)
+
+    def test_c_to_python(self):
+        for value in VALUES:
+            if isinstance(value, int) and not isinstance(value, bool) and value < -2**63:
+                continue
+            with self.subTest(value=repr(value)[:60]):
+                status, data = self.c_from_json(json.dumps(value))
+                self.assertEqual(status, 0)
+                decoded = cbor_codec.loads(data)
+                self.assertEqual(decoded, value)
+                self.assertEqual(type(decoded), type(value))
+
+    def test_python_c_python(self):
+        for value in VALUES:
+            if isinstance(value, int) and not isinstance(value, bool) and value < -2**63:
+                continue
+            with self.subTest(value=repr(value)[:60]):
+                status, text = self.c_to_json(cbor_codec.dumps(value))
+                self.assertEqual(status, 0)
+                status, data = self.c_from_json(text)
+                self.assertEqual(status, 0)
+                self.assertEqual(cbor_codec.loads(data), value)
+
+    def test_json_numbers(self):
+        for text, value in (("-0", 0), ("1e2", 100.0), ("1E-2", 0.01), ("-1.5e+3", -1500.0),
+                            ("18446744073709551616", 1.8446744073709552e19), ("-9223372036854775808", -2**63)):
+            with self.subTest(text=text):
+                status, data = self.c_from_json(text)
+                self.assertEqual(status, 0)
+                self.assertEqual(cbor_codec.loads(data), value)
+
+    def test_replies(self):
+        reply = {"jsonrpc": "2.0", "id": 7, "result": {"content": [{"type": "text", "text": "caf\u00e9 " * 20},
+                                                               {"type": "text", "text": "second"}]}}
+        error = {"jsonrpc": "2.0", "id": -3, "error": {"code": -32601, "message": "Unknown tool",
+                                                       "data": {"code": 1, "message": "inner"}}}
+        status, replies = self.c_replies(cbor_codec.dumps(reply))
+        self.assertEqual(status, 0)
+        self.assertEqual(replies, [{"id": 7, "error": None, "text": "caf\u00e9 " * 20, "message": ""}])
+        status, replies = self.c_replies(cbor_codec.dumps([reply, error]))
+        self.assertEqual(status, 1)
+        self.assertEqual(replies[1], {"id": -3, "error": -32601, "text": "", "message": "Unknown tool"})
+        # Indefinite-length containers, as the C encoder writes them; chunked
+        # text has no single span to point at and is skipped
+        head = "bf62696405" "66726573756c74bf" "67636f6e74656e749f" "bf6474657874"
+        status, replies = self.c_replies(bytes.fromhex(head + "6468696869" + "ffffffff"))
+        self.assertEqual((status, replies), (0, [{"id": 5, "error": None, "text": "hihi", "message": ""}]))
+        status, replies = self.c_replies(bytes.fromhex(head + "7f626869626869ff" + "ffffffff"))
+        self.assertEqual((status, replies), (0, [{"id": 5, "error": None, "text": "", "message": ""}]))
+
+    def test_truncated(self):
+        for value in (VALUES[-10], [1, [2, 3], {"a": "bc"}], "s" * 300, -2**40, 1.5,
+                      {"id": 1, "result": {"content": [{"text": "t"}]}}):
+            data = cbor_codec.dumps(value)
+            for cut in range(len(data)):
+                with self.subTest(value=repr(value)[:40], cut=cut):
+                    self.assertEqual(self.c_to_json(data[:cut]), (-1, ""))
+                    self.assertEqual(self.c_replies(data[:cut])[0], -1)
+
+    def test_invalid_cbor(self):
+        for hexdata in ("ff", "1c", "1f", "f8", "0001", "9f01", "5f6161ff", "7f4161ff", "61",
+                        "81" * 70 + "00"):
+            with self.subTest(hexdata=hexdata[:20]):
+                self.assertEqual(self.c_to_json(bytes.fromhex(hexdata)), (-1, ""))
+        # Well-formed items of the wrong shape are skipped, like the JSON scanner
+        empty = {"id": None, "error": None, "text": "", "message": ""}
+        for value, status in ((1, 0), ("text", 0), ([1], 1), ({"id": "x", "result": {"content": [1]}}, 0)):
+            with self.subTest(value=value):
+                self.assertEqual(self.c_replies(cbor_codec.dumps(value)), (status, [empty]))
+
+    def test_invalid_json(self):
+        for text in ("", "{not json}", '{"a" 1}', '{"a":1,}', "[1,]", "[1 2]", "01", "1.", "-", "1e",
+                     '"\\x"', '"\\u12g4"', '"open', "tru", "nul", "1 2", "{} {}",
+                     "[" * 70 + "]" * 70):
+            with self.subTest(text=text[:20]):
+                self.assertEqual(self.c_from_json(text)[0], -1)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -4,41 +4,427 @@ Phase 3 Web Server
 HTTP interface for C frontend communication
 """
 
-from flask import Flask, request, jsonify
+from flask import Flask, Response, request, jsonify, stream_with_context
+import gzip
+import hashlib
 import json
+import os
 import asyncio
+import itertools
 import subprocess
 import sys
+import threading
+import time
 from pathlib import Path
 
+try:
+    from compression import zstd      # Python 3.14+
+    zstd_compress = zstd.compress
+except ImportError:
+    try:
+        import zstandard
+        zstd_compress = zstandard.ZstdCompressor(level=3).compress
+    except ImportError:
+        zstd_compress = None
+
+try:
+    import cbor2 as cbor
+except ImportError:
+    import cbor_codec as cbor
+
 app = Flask(__name__)
 
+ADMIN_CMD = ['bash', '-c',
+             'cd /home/petr/jetson/phase3 && source mcp_env/bin/activate && exec python3 mcp_server_admin.py']
+# Seconds a request may wait on its admin worker; clients give up sooner
+# (see the per-tool deadlines in frontend/mcp_client.c)
+CALL_TIMEOUT = float(os.environ.get("PHASE3_CALL_TIMEOUT", "30"))
+
+class AdminWorker:
+    """One resident mcp_server_admin process spoken to over its stdio pipes.
+    Requests are written as JSON lines under a worker-local id; a reader
+    thread matches replies back to their waiters, so several calls can be
+    outstanding on one worker at once."""
+    
+    def __init__(self):
+        self.proc = subprocess.Popen(ADMIN_CMD, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     text=True, bufsize=1)
+        self.lock = threading.Lock()
+        self.pending = {}
+        self.next_id = itertools.count(1)
+        self.alive = True
+        threading.Thread(target=self._read_replies, daemon=True).start()
+        
+        # MCP session handshake, once per process instead of once per call
+        try:
+            self.wait(self.send({"jsonrpc": "2.0", "method": "initialize", "params": {
+                "protocolVersion": "2024-11-05",
+                "capabilities": {},
+                "clientInfo": {"name": "phase3-web", "version": "1.0"},
+            }}))
+            self.send({"jsonrpc": "2.0", "method": "notifications/initialized"}, notify=True)
+        except Exception:
+            self.stop()
+            raise
+    
+    def outstanding(self):
+        return len(self.pending)
+    
+    def send(self, data, notify=False):
+        """Write one request; returns the slot to wait on, None for notifications"""
+        message = dict(data)
+        slot = None
+        with self.lock:
+            if not self.alive:
+                raise RuntimeError("admin worker exited")
+            if not notify:
+                wire_id = next(self.next_id)
+                slot = {"event": threading.Event(), "reply": None, "id": data.get("id"), "wire_id": wire_id}
+                self.pending[wire_id] = slot
+                message["id"] = wire_id
+            try:
+                self.proc.stdin.write(json.dumps(message) + "\n")
+                self.proc.stdin.flush()
+            except OSError:
+                self.alive = False
+                raise RuntimeError("admin worker exited")
+        return slot
+    
+    def wait(self, slot):
+        if not slot["event"].wait(CALL_TIMEOUT):
+            # A worker this far behind is stuck; retire it so the pool stops
+            # picking it as the least busy one once the slot is dropped
+            with self.lock:
+                self.pending.pop(slot["wire_id"], None)
+            self.stop()
+            raise RuntimeError("admin worker timed out")
+        if slot["reply"] is None:
+            raise RuntimeError("admin worker exited")
+        reply = slot["reply"]
+        reply["id"] = slot["id"]
+        return reply
+    
+    def _read_replies(self):
+        for line in self.proc.stdout:
+            try:
+                reply = json.loads(line)
+            except ValueError:
+                continue
+            # Server-initiated notifications and requests carry no id of ours
+            with self.lock:
+                slot = self.pending.pop(reply.get("id"), None) if isinstance(reply, dict) else None
+            if slot:
+                slot["reply"] = reply
+                slot["event"].set()
+        
+        with self.lock:
+            self.alive = False
+            orphans, self.pending = list(self.pending.values()), {}
+        for slot in orphans:
+            slot["event"].set()
+    
+    def stop(self):
+        self.alive = False
+        self.proc.terminate()
+
+class AdminPool:
+    """Fixed set of warm admin workers; each call goes to the least busy one.
+    A dead worker is replaced in the background, and calls keep going to the
+    live ones meanwhile."""
+    
+    def __init__(self, size):
+        self.size = size
+        self.workers = []
+        self.spawning = 0
+        self.lock = threading.Lock()
+        self.changed = threading.Condition(self.lock)
+    
+    def start(self):
+        """Spawn the workers up front so the first calls find them warm"""
+        with self.lock:
+            while len(self.workers) < self.size:
+                self.workers.append(AdminWorker())
+    
+    def _respawn(self):
+        # Outside the lock: the handshake can take up to CALL_TIMEOUT
+        try:
+            worker = AdminWorker()
+        except Exception:
+            worker = None
+        with self.lock:
+            self.spawning -= 1
+            if worker:
+                self.workers.append(worker)
+            self.changed.notify_all()
+    
+    def _pick(self):
+        with self.lock:
+            for worker in [w for w in self.workers if not w.alive]:
+                self.workers.remove(worker)
+                worker.stop()
+            missing = self.size - len(self.workers) - self.spawning
+            self.spawning += missing
+        for _ in range(missing):
+            threading.Thread(target=self._respawn, daemon=True).start()
+        
+        with self.lock:
+            # Only a pool with no live worker left waits on a respawn
+            while not self.workers and self.spawning:
+                self.changed.wait()
+            if not self.workers:
+                raise RuntimeError("admin worker failed to start")
+            return min(self.workers, key=lambda w: w.outstanding())
+    
+    def submit(self, data):
+        worker = self._pick()
+        return worker, worker.send(data, notify="id" not in data)
+    
+    def result(self, submitted):
+        worker, slot = submitted
+        return worker.wait(slot) if slot else None
+
+admin_pool = AdminPool(int(os.environ.get("PHASE3_WORKERS", "2")))
+
+def call_admin_server(data):
+    """Run one JSON-RPC request through a resident admin MCP server"""
+    return admin_pool.result(admin_pool.submit(data))
+
+def sse_event(payload, event=None):
+    frame = f"event: {event}\n" if event else ""
+    return frame + f"data: {json.dumps(payload)}\n\n"
+
+def stream_reply(reply):
+    """Yield the text content of a reply as SSE delta frames, then the full reply.
+    The admin server answers generate in one piece, so this only replays a
+    finished reply: the first frame leaves once the whole text exists, and a
+    client timing it sees the total latency, not time to first token. Real
+    token streaming needs a model server that hands out deltas as it decodes."""
+    for item in reply.get("result", {}).get("content", []):
+        text = item.get("text", "")
+        start = 0
+        # Split on word boundaries so the client can render progressively
+        while start < len(text):
+            end = text.find(" ", start)
+            end = len(text) if end < 0 else end + 1
+            yield sse_event({"delta": text[start:end]})
+            start = end
+    yield sse_event({k: v for k, v in reply.items() if k != "result"}, event="done")
+
+# Tools whose replies only change when server state does; they carry an ETag
+# so clients can revalidate a cached reply with If-None-Match
+READ_ONLY_TOOLS = {"get_status", "get_agent_config", "db_status", "get_settings"}
+
+def reply_etag(reply):
+    """Tag the result alone; the id differs on every request"""
+    body = json.dumps(reply.get("result"), sort_keys=True, separators=(",", ":"))
+    return '"' + hashlib.sha1(body.encode()).hexdigest() + '"'
+
+# Binary framing for /mcp: a client that sends application/cbor gets CBOR
+# back when it also accepts it. The hop to the admin workers stays JSON.
+CBOR_TYPE = 'application/cbor'
+
+def read_request():
+    if request.mimetype == CBOR_TYPE:
+        return cbor.loads(request.get_data())
+    return request.get_json()
+
+def encode_reply(reply, status=200):
+    if CBOR_TYPE in request.headers.get('Accept', ''):
+        response = Response(cbor.dumps(reply), status=status, mimetype=CBOR_TYPE)
+    else:
+        response = jsonify(reply)
+        response.status_code = status
+    response.vary.add('Accept')
+    return response
+
+def rpc_error(code, message, request_id=None):
+    return {"jsonrpc": "2.0", "error": {"code": code, "message": message}, "id": request_id}
+
+def call_batch(batch):
+    """Answer a JSON-RPC 2.0 batch; one reply per request that carries an id"""
+    if not batch:
+        return rpc_error(-32600, "Invalid Request: empty batch")
+    
+    # Submit everything first so the items run concurrently across workers
+    submitted = []
+    for item in batch:
+        if not isinstance(item, dict):
+            submitted.append(rpc_error(-32600, "Invalid Request"))
+            continue
+        try:
+            submitted.append(admin_pool.submit(item))
+        except Exception as e:
+            submitted.append(rpc_error(-32603, str(e), item.get("id")))
+    
+    replies = []
+    for item, entry in zip(batch, submitted):
+        if isinstance(entry, tuple):
+            try:
+                entry = admin_pool.result(entry)
+            except Exception as e:
+                entry = rpc_error(-32603, str(e), item.get("id"))
+        # Notifications (no id) get no reply
+        if not isinstance(item, dict) or "id" in item:
+            replies.append(entry)
+    return replies
+
 @app.route('/mcp', methods=['POST'])
 def mcp_proxy():
     """Proxy MCP requests to the admin server"""
     try:
-        data = request.get_json()
+        data = read_request()
         
-        # Call admin MCP server via subprocess
-        cmd = [
-            'bash', '-c', 
-            f'cd /home/petr/jetson/phase3 && source mcp_env/bin/activate && echo \'{json.dumps(data)}\' | python3 mcp_server_admin.py'
-        ]
+        if isinstance(data, list):
+            return encode_reply(call_batch(data))
         
-        result = subprocess.run(cmd, capture_output=True, text=True, timeout=30)
+        if 'text/event-stream' in request.headers.get('Accept', ''):
+            reply = call_admin_server(data)
+            return Response(stream_with_context(stream_reply(reply)),
+                            mimetype='text/event-stream',
+                            headers={'Cache-Control': 'no-cache'})
         
-        if result.returncode == 0:
-            return jsonify(json.loads(result.stdout))
-        else:
-            return jsonify({"error": result.stderr}), 500
+        reply = call_admin_server(data)
+        tool = data.get("params", {}).get("name") if isinstance(data, dict) else None
+        if tool in READ_ONLY_TOOLS and isinstance(reply, dict) and "result" in reply:
+            etag = reply_etag(reply)
+            if etag in request.headers.get('If-None-Match', ''):
+                return Response(status=304, headers={'ETag': etag})
+            response = encode_reply(reply)
+            response.headers['ETag'] = etag
+            return response
+        return encode_reply(reply)
             
     except Exception as e:
-        return jsonify({"error": str(e)}), 500
+        return encode_reply({"error": str(e)}, 500)
+
+WATCH_HEARTBEAT = 15
+
+def tool_fields(tool):
+    """Call a read-only tool; its text content is a JSON object of fields"""
+    reply = call_admin_server({"jsonrpc": "2.0", "method": "tools/call",
+                               "params": {"name": tool, "arguments": {}}, "id": "watch"})
+    if "error" in reply:
+        raise RuntimeError(reply["error"].get("message", "tool call failed"))
+    text = "".join(item.get("text", "") for item in reply.get("result", {}).get("content", []))
+    try:
+        fields = json.loads(text)
+    except ValueError:
+        fields = None
+    return fields if isinstance(fields, dict) else {"text": text}
+
+def watch_events(tool, interval):
+    """Snapshot once, then only changed fields (removed ones as null). The
+    admin server has no change notifications, so the resident worker is
+    polled here, next to it, rather than by every watching client."""
+    previous = None
+    quiet = 0.0
+    while True:
+        try:
+            fields = tool_fields(tool)
+        except Exception as e:
+            yield sse_event({"message": str(e)}, event="error")
+            fields = None
+        
+        if fields is not None and previous is None:
+            yield sse_event(fields, event="snapshot")
+            previous, quiet = fields, 0.0
+        elif fields is not None:
+            delta = {k: v for k, v in fields.items() if k not in previous or previous[k] != v}
+            delta.update({k: None for k in previous if k not in fields})
+            if delta:
+                yield sse_event(delta, event="delta")
+                quiet = 0.0
+            previous = fields
+        
+        # A comment now and then lets both ends notice a dead connection
+        if quiet >= WATCH_HEARTBEAT:
+            yield ": ping\n\n"
+            quiet = 0.0
+        time.sleep(interval)
+        quiet += interval
+
+@app.route('/mcp/watch')
+def mcp_watch():
+    """Push a read-only tool's fields as they change over one SSE connection"""
+    tool = request.args.get('tool', 'get_status')
+    if tool not in READ_ONLY_TOOLS:
+        return jsonify(rpc_error(-32602, f"Cannot watch {tool}")), 400
+    try:
+        interval = min(max(float(request.args.get('interval', 1)), 0.2), 60)
+    except ValueError:
+        interval = 1.0
+    return Response(stream_with_context(watch_events(tool, interval)),
+                    mimetype='text/event-stream',
+                    headers={'Cache-Control': 'no-cache'})
+
+# Below this the headers outweigh what compression saves
+COMPRESS_MIN_BYTES = 512
+
+def accepted_encodings():
+    """Codings named in Accept-Encoding, minus any refused with q=0"""
+    accepted = set()
+    for item in request.headers.get('Accept-Encoding', '').split(','):
+        name, _, params = item.partition(';')
+        if params.replace(' ', '') not in ('q=0', 'q=0.0'):
+            accepted.add(name.strip().lower())
+    return accepted
+
+@app.after_request
+def compress_response(response):
+    """Compress JSON and CBOR bodies for clients that ask; event streams go
+    out as is so deltas are not held back in the compressor"""
+    response.vary.add('Accept-Encoding')
+    if response.is_streamed or response.status_code != 200 or response.mimetype not in ('application/json', CBOR_TYPE):
+        return response
+    if 'Content-Encoding' in response.headers:
+        return response
+    body = response.get_data()
+    if len(body) < COMPRESS_MIN_BYTES:
+        return response
+    
+    accepted = accepted_encodings()
+    if zstd_compress and 'zstd' in accepted:
+        body, encoding = zstd_compress(body), 'zstd'
+    elif 'gzip' in accepted:
+        body, encoding = gzip.compress(body, compresslevel=5), 'gzip'
+    else:
+        return response
+    response.set_data(body)
+    response.headers['Content-Encoding'] = encoding
+    return response
 
 @app.route('/health')
 def health():
     return jsonify({"status": "healthy", "service": "phase3-web"})
 
+def answer_shm(data):
+    """Requests from the shared memory adapter: plain replies, since a frontend
+    on that transport streams, revalidates and compresses nothing"""
+    if isinstance(data, list):
+        return call_batch(data)
+    return call_admin_server(data)
+
 if __name__ == '__main__':
-    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8080
-    app.run(host='0.0.0.0', port=port, debug=False)
+    # web_server.py [PORT | unix:PATH] [shm[:NAME]]
+    args = sys.argv[1:]
+    shm = next((arg for arg in args if arg == 'shm' or arg.startswith('shm:')), None)
+    if shm:
+        args.remove(shm)
+    target = args[0] if args else '8080'
+    try:
+        admin_pool.start()
+    except Exception as e:
+        # Calls will retry the spawn; the server still answers /health
+        print(f"Admin workers not started: {e}", file=sys.stderr)
+    if shm:
+        # Same-host frontends can skip HTTP: phase3_frontend --shm NAME
+        from shm_adapter import DEFAULT_NAME, ShmAdapter
+        ShmAdapter(answer_shm, shm[len('shm:'):] or DEFAULT_NAME).start()
+    if target.startswith('unix:'):
+        path = target[len('unix:'):]
+        # A socket file left by a previous run would make bind fail
+        if os.path.exists(path):
+            os.unlink(path)
+        app.run(host=f'unix://{path}', debug=False)
+    else:
+        app.run(host='0.0.0.0', port=int(target), debug=False)